@@ -0,0 +1,18 @@
+#include "alloc_counter.h"
+#ifdef __linux__
+#include <dlfcn.h>
+#endif
+
+bool allocation_stats(AllocationStats &stats) {
+#ifdef __linux__
+  typedef AllocationStats (*StatsFunc)();
+  // defined by the preloaded counter, if any
+  static StatsFunc stats_func = reinterpret_cast<StatsFunc>(dlsym(RTLD_DEFAULT, "mpvjs_allocation_stats"));
+  if (stats_func) {
+    stats = stats_func();
+    return true;
+  }
+#endif
+  (void)stats;
+  return false;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Heap allocations made through malloc, calloc and realloc by the whole process, including the c++ runtime, node and
+ * v8. Counted by bench/malloc_counter.cpp, which bench/run.js preloads on linux. Js objects live in the v8 heap and are
+ * not counted.
+ */
+struct AllocationStats {
+  uint64_t count;
+  uint64_t bytes;
+};
+
+/**
+ * Returns false if the counter is not preloaded, and allocations cannot be counted
+ */
+bool allocation_stats(AllocationStats &stats);
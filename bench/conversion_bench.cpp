@@ -0,0 +1,304 @@
+#include <node.h>
+#include <uv.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include "mpv_node.h"
+#include "helpers.h"
+#include "alloc_counter.h"
+
+using namespace v8;
+using namespace std;
+
+/**
+ * Builds synthetic node trees shaped like values mpv returns. All memory is taken from an arena, so trees are freed
+ * with the builder.
+ */
+class TreeBuilder {
+public:
+  mpv_node str(const string &value) {
+    mpv_node node;
+    node.format = MPV_FORMAT_STRING;
+    node.u.string = _arena.copy_string(value.c_str(), value.size());
+    return node;
+  }
+
+  mpv_node int64(int64_t value) {
+    mpv_node node;
+    node.format = MPV_FORMAT_INT64;
+    node.u.int64 = value;
+    return node;
+  }
+
+  mpv_node number(double value) {
+    mpv_node node;
+    node.format = MPV_FORMAT_DOUBLE;
+    node.u.double_ = value;
+    return node;
+  }
+
+  mpv_node flag(bool value) {
+    mpv_node node;
+    node.format = MPV_FORMAT_FLAG;
+    node.u.flag = value ? 1 : 0;
+    return node;
+  }
+
+  mpv_node bytes(size_t size) {
+    mpv_node node;
+    node.format = MPV_FORMAT_BYTE_ARRAY;
+    node.u.ba = _arena.alloc<mpv_byte_array>();
+    node.u.ba->size = size;
+    node.u.ba->data = _arena.alloc<uint8_t>(size);
+    for (size_t q = 0; q < size; ++q) {
+      static_cast<uint8_t*>(node.u.ba->data)[q] = static_cast<uint8_t>(q * 31);
+    }
+    return node;
+  }
+
+  mpv_node list(const vector<mpv_node> &items) {
+    mpv_node node;
+    node.format = MPV_FORMAT_NODE_ARRAY;
+    node.u.list = make_list(items.size());
+    node.u.list->keys = nullptr;
+    copy(items.begin(), items.end(), node.u.list->values);
+    return node;
+  }
+
+  mpv_node map(const vector<pair<string, mpv_node>> &items) {
+    mpv_node node;
+    node.format = MPV_FORMAT_NODE_MAP;
+    node.u.list = make_list(items.size());
+    node.u.list->keys = _arena.alloc<char*>(items.size());
+    for (size_t q = 0; q < items.size(); ++q) {
+      node.u.list->keys[q] = _arena.copy_string(items[q].first.c_str(), items[q].first.size());
+      node.u.list->values[q] = items[q].second;
+    }
+    return node;
+  }
+
+private:
+  NodeArena _arena;
+
+  mpv_node_list *make_list(size_t count) {
+    mpv_node_list *list = _arena.alloc<mpv_node_list>();
+    list->num = static_cast<int>(count);
+    list->values = _arena.alloc<mpv_node>(count);
+    return list;
+  }
+};
+
+struct Payload {
+  const char *name;
+  mpv_node node;
+};
+
+/**
+ * playlist with 10k entries, as returned for a large music library
+ */
+static mpv_node make_playlist(TreeBuilder &b) {
+  vector<mpv_node> items;
+  for (int q = 0; q < 10000; ++q) {
+    string n = to_string(q);
+    vector<pair<string, mpv_node>> fields = {
+      { "filename", b.str("/media/library/Artist " + to_string(q / 100) + "/Album " + to_string(q / 10)
+                          + "/" + n + " - Track " + n + ".flac") },
+      { "title", b.str("Track " + n) },
+      { "id", b.int64(q + 1) }
+    };
+    if (q == 0) {
+      fields.emplace_back("current", b.flag(true));
+      fields.emplace_back("playing", b.flag(true));
+    }
+    items.push_back(b.map(fields));
+  }
+  return b.list(items);
+}
+
+/**
+ * track-list of a file with 200 tracks, mostly subtitles
+ */
+static mpv_node make_track_list(TreeBuilder &b) {
+  vector<mpv_node> items;
+  for (int q = 0; q < 200; ++q) {
+    bool video = q == 0, audio = q > 0 && q < 20;
+    vector<pair<string, mpv_node>> fields = {
+      { "id", b.int64(q + 1) },
+      { "type", b.str(video ? "video" : audio ? "audio" : "sub") },
+      { "src-id", b.int64(q) },
+      { "title", b.str("Track " + to_string(q)) },
+      { "lang", b.str(q % 3 ? "eng" : "jpn") },
+      { "default", b.flag(q < 2) },
+      { "forced", b.flag(false) },
+      { "selected", b.flag(q < 2) },
+      { "external", b.flag(false) },
+      { "codec", b.str(video ? "h264" : audio ? "aac" : "ass") },
+      { "ff-index", b.int64(q) }
+    };
+    if (video) {
+      fields.emplace_back("demux-w", b.int64(1920));
+      fields.emplace_back("demux-h", b.int64(1080));
+      fields.emplace_back("demux-fps", b.number(23.976));
+      fields.emplace_back("decoder-desc", b.str("h264 (H.264 / AVC / MPEG-4 AVC / MPEG-4 part 10)"));
+    } else if (audio) {
+      fields.emplace_back("demux-channel-count", b.int64(6));
+      fields.emplace_back("demux-channels", b.str("5.1"));
+      fields.emplace_back("demux-samplerate", b.int64(48000));
+      fields.emplace_back("decoder-desc", b.str("aac (AAC (Advanced Audio Coding))"));
+    }
+    items.push_back(b.map(fields));
+  }
+  return b.list(items);
+}
+
+/**
+ * deeply nested metadata with non-ascii values
+ */
+static mpv_node make_metadata(TreeBuilder &b, int depth) {
+  vector<pair<string, mpv_node>> fields;
+  for (int q = 0; q < 4; ++q) {
+    string key = "tag-" + to_string(depth) + "-" + to_string(q);
+    if (depth > 0) {
+      fields.emplace_back(key, make_metadata(b, depth - 1));
+    } else {
+      fields.emplace_back(key, b.str(q % 2 ? "Ünïcödé värde №" + to_string(q) : "plain value " + to_string(q)));
+    }
+  }
+  fields.emplace_back("comment", b.str("encoded by a synthetic benchmark"));
+  return b.map(fields);
+}
+
+/**
+ * large byte arrays: a cover image and a list of thumbnails
+ */
+static mpv_node make_byte_arrays(TreeBuilder &b) {
+  vector<mpv_node> thumbnails;
+  for (int q = 0; q < 64; ++q) {
+    thumbnails.push_back(b.bytes(4096));
+  }
+  return b.map({ { "cover", b.bytes(1024 * 1024) }, { "thumbnails", b.list(thumbnails) } });
+}
+
+/**
+ * Runs fn repeatedly and returns a result record with timings and heap allocations per iteration.
+ * Allocations are null if the counter is not preloaded.
+ */
+template<class F>
+static Local<Object> measure(Isolate *i, const char *payload, const char *direction, int iterations, F fn) {
+  // the first run fills conversion caches and makes sure everything is paged in
+  fn();
+
+  uint64_t total = 0, min = UINT64_MAX;
+  AllocationStats before, after;
+  bool counted = allocation_stats(before);
+  for (int q = 0; q < iterations; ++q) {
+    uint64_t start = uv_hrtime();
+    fn();
+    uint64_t elapsed = uv_hrtime() - start;
+    total += elapsed;
+    if (elapsed < min) {
+      min = elapsed;
+    }
+  }
+  counted = counted && allocation_stats(after);
+
+  Local<Context> ctx = i->GetCurrentContext();
+  Local<Object> result = Object::New(i);
+  result->Set(ctx, make_string(i, "payload"), make_string(i, payload));
+  result->Set(ctx, make_string(i, "direction"), make_string(i, direction));
+  result->Set(ctx, make_string(i, "iterations"), Integer::New(i, iterations));
+  result->Set(ctx, make_string(i, "meanNs"), Number::New(i, static_cast<double>(total) / iterations));
+  result->Set(ctx, make_string(i, "minNs"), Number::New(i, static_cast<double>(min)));
+  if (counted) {
+    result->Set(ctx, make_string(i, "allocationsPerIteration"),
+                Number::New(i, static_cast<double>(after.count - before.count) / iterations));
+    result->Set(ctx, make_string(i, "allocatedBytesPerIteration"),
+                Number::New(i, static_cast<double>(after.bytes - before.bytes) / iterations));
+  } else {
+    result->Set(ctx, make_string(i, "allocationsPerIteration"), Null(i));
+    result->Set(ctx, make_string(i, "allocatedBytesPerIteration"), Null(i));
+  }
+  return result;
+}
+
+/**
+ * run(options?: { iterations?: number, filter?: string }): an array of result records.
+ * Each payload is converted to js values and back, and to json and back.
+ */
+static void Run(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  Local<Context> ctx = i->GetCurrentContext();
+
+  int iterations = 20;
+  string filter;
+  if (args.Length() > 0 && args[0]->IsObject()) {
+    Local<Object> options = args[0].As<Object>();
+    Local<Value> iterations_value = options->Get(ctx, make_string(i, "iterations")).ToLocalChecked();
+    if (iterations_value->IsNumber()) {
+      iterations = static_cast<int>(iterations_value->NumberValue(ctx).FromMaybe(iterations));
+    }
+    Local<Value> filter_value = options->Get(ctx, make_string(i, "filter")).ToLocalChecked();
+    if (filter_value->IsString()) {
+      filter = string_to_cc(filter_value);
+    }
+  }
+
+  if (iterations < 1) {
+    throw_js(i, "run: iterations should be a positive number");
+    return;
+  }
+
+  TreeBuilder builder;
+  vector<Payload> payloads = {
+    { "playlist-10k", make_playlist(builder) },
+    { "track-list-200", make_track_list(builder) },
+    { "metadata-deep", make_metadata(builder, 6) },
+    { "byte-arrays", make_byte_arrays(builder) }
+  };
+
+  NodeArena arena;
+  Local<Array> results = Array::New(i);
+  auto add = [&](Local<Object> result) {
+    results->Set(ctx, results->Length(), result);
+  };
+
+  for (auto &payload : payloads) {
+    if (!filter.empty() && string(payload.name).find(filter) == string::npos) {
+      continue;
+    }
+
+    const mpv_node &node = payload.node;
+
+    add(measure(i, payload.name, "mpv-to-js", iterations, [&]() {
+      HandleScope scope(i);
+      mpv_node_to_v8_value(i, &node);
+    }));
+
+    Local<Value> value = mpv_node_to_v8_value(i, &node);
+    add(measure(i, payload.name, "js-to-mpv", iterations, [&]() {
+      AutoMpvNode converted(i, value, &arena);
+    }));
+
+    add(measure(i, payload.name, "mpv-to-json", iterations, [&]() {
+      string json;
+      write_node_json(node, json);
+    }));
+
+    string json;
+    write_node_json(node, json);
+    add(measure(i, payload.name, "json-to-mpv", iterations, [&]() {
+      string error;
+      AutoMpvNode parsed(json.c_str(), json.size(), error, &arena);
+    }));
+  }
+
+  release_conversion_cache();
+  args.GetReturnValue().Set(results);
+}
+
+void Init(Local<Object> exports) {
+  NODE_SET_METHOD(exports, "run", Run);
+}
+
+NODE_MODULE(mpvjs_bench, Init);
@@ -0,0 +1,53 @@
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "alloc_counter.h"
+
+// Preloaded into the benchmark process with LD_PRELOAD, so malloc calls from everywhere in the process end up here:
+// the conversion code, the shared c++ runtime, node and v8. The real allocator is called through glibc's internal
+// entry points, since looking it up with dlsym could itself allocate.
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static std::atomic<uint64_t> allocation_count(0);
+static std::atomic<uint64_t> allocation_bytes(0);
+
+static inline void count_allocation(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+extern "C" {
+
+__attribute__((visibility("default"))) AllocationStats mpvjs_allocation_stats() {
+  return AllocationStats { allocation_count.load(std::memory_order_relaxed),
+                           allocation_bytes.load(std::memory_order_relaxed) };
+}
+
+__attribute__((visibility("default"))) void *malloc(size_t size) {
+  count_allocation(size);
+  return __libc_malloc(size);
+}
+
+__attribute__((visibility("default"))) void *calloc(size_t count, size_t size) {
+  count_allocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+__attribute__((visibility("default"))) void *realloc(void *ptr, size_t size) {
+  // shrinking or freeing through realloc is not an allocation
+  if (!ptr || size) {
+    count_allocation(size);
+  }
+  return __libc_realloc(ptr, size);
+}
+
+__attribute__((visibility("default"))) void free(void *ptr) {
+  __libc_free(ptr);
+}
+
+}
@@ -0,0 +1,67 @@
+"use strict";
+
+// Runs conversion benchmarks and prints results as json to stdout.
+// Build the benchmark module first with `npm run build-bench`.
+// Usage: node bench/run.js [--iterations N] [--filter PAYLOAD] [--output FILE]
+// On linux the script restarts itself with the malloc counter preloaded, so heap allocations are counted; elsewhere
+// allocation columns are null.
+
+const path = require('path');
+const fs = require('fs');
+const child_process = require('child_process');
+
+const buildDir = path.join(path.resolve(__dirname), '..', 'build', 'Release');
+const mallocCounter = path.join(buildDir, 'mpvjs_malloc_counter.so');
+
+if (process.platform === 'linux' && !process.env.MPVJS_BENCH_PRELOADED && fs.existsSync(mallocCounter)) {
+  let preload = process.env.LD_PRELOAD ? mallocCounter + ':' + process.env.LD_PRELOAD : mallocCounter;
+  let child = child_process.spawnSync(process.execPath, process.execArgv.concat(process.argv.slice(1)), {
+    stdio: 'inherit',
+    env: Object.assign({}, process.env, { LD_PRELOAD: preload, MPVJS_BENCH_PRELOADED: '1' })
+  });
+  if (child.error) {
+    throw child.error;
+  }
+  process.exit(child.status === null ? 1 : child.status);
+}
+
+function parseArgs(argv) {
+  let options = { iterations: 20, filter: '', output: '' };
+  for (let q = 0; q < argv.length; ++q) {
+    let arg = argv[q];
+    if (arg === '--iterations') {
+      options.iterations = parseInt(argv[++q], 10);
+    } else if (arg === '--filter') {
+      options.filter = argv[++q] || '';
+    } else if (arg === '--output') {
+      options.output = argv[++q] || '';
+    } else {
+      throw new Error('unknown argument: ' + arg);
+    }
+  }
+
+  if (!(options.iterations > 0)) {
+    throw new Error('--iterations should be a positive number');
+  }
+  return options;
+}
+
+let options = parseArgs(process.argv.slice(2));
+let bench = require(path.join(buildDir, 'mpvjs_bench.node'));
+
+let report = {
+  date: new Date().toISOString(),
+  node: process.version,
+  v8: process.versions.v8,
+  platform: process.platform,
+  arch: process.arch,
+  iterations: options.iterations,
+  results: bench.run({ iterations: options.iterations, filter: options.filter })
+};
+
+let text = JSON.stringify(report, null, 2) + '\n';
+if (options.output) {
+  fs.writeFileSync(options.output, text);
+} else {
+  process.stdout.write(text);
+}
@@ -1,9 +1,13 @@
 {
+  "variables": {
+    "build_bench%": 0
+  },
   "targets": [
     {
       "target_name": "mpvjs",
       "sources": [
-        "module/main.cpp", "module/mpv_player.cpp", "module/helpers.cpp", "module/mpv_node.cpp"
+        "module/main.cpp", "module/mpv_player.cpp", "module/helpers.cpp", "module/mpv_node.cpp",
+        "module/log_sink.cpp"
       ],
       "dependencies": [ "action_before_build" ],
       "ldflags": [ "-Wl,-Bsymbolic" ],
@@ -69,5 +73,57 @@
         }
       ]
     }
+  ],
+  "conditions": [
+    ["build_bench==1", {
+      "targets": [
+        {
+          "target_name": "mpvjs_bench",
+          "sources": [
+            "bench/conversion_bench.cpp", "bench/alloc_counter.cpp", "module/helpers.cpp", "module/mpv_node.cpp"
+          ],
+          "include_dirs": [ "module" ],
+          "dependencies": [ "action_before_build" ],
+          "ldflags": [ "-Wl,-Bsymbolic" ],
+          "cxxflags": [ "-fexceptions" ],
+          "conditions": [
+            ["OS=='win'", {
+              "include_dirs": [ "./deps" ],
+              "libraries": [
+                "-l../deps/win_libs/mpv-1"
+              ]
+            }, "OS=='linux'", {
+              "libraries": [
+                "-L../deps/mpv-build/mpv/build/",
+                "-L../deps/mpv-build/build_libs/lib/",
+                "-l:libmpv.a",
+                "-l:libavcodec.a",
+                "-l:libavformat.a",
+                "-l:libavutil.a",
+                "-l:libavfilter.a",
+                "-l:libavdevice.a",
+                "-l:libswscale.a",
+                "-l:libswresample.a",
+                "-l:libass.a",
+                "-lpulse",
+                "-lfribidi",
+                "-ldl"
+              ]
+            }]
+          ]
+        }
+      ]
+    }],
+    ["build_bench==1 and OS=='linux'", {
+      "targets": [
+        {
+          "target_name": "mpvjs_malloc_counter",
+          "type": "loadable_module",
+          "product_extension": "so",
+          "sources": [ "bench/malloc_counter.cpp" ],
+          "include_dirs": [ "bench" ]
+        }
+      ]
+    }]
   ]
 }
@@ -44,7 +44,47 @@ declare namespace libmpvjs {
     Trace = 70
   }
 
+  enum EventId {
+    Shutdown = 1,
+    LogMessage = 2,
+    GetPropertyReply = 3,
+    SetPropertyReply = 4,
+    CommandReply = 5,
+    StartFile = 6,
+    EndFile = 7,
+    FileLoaded = 8,
+    Idle = 11,
+    Tick = 14,
+    ClientMessage = 16,
+    VideoReconfig = 17,
+    AudioReconfig = 18,
+    Seek = 20,
+    PlaybackRestart = 21,
+    PropertyChange = 22,
+    QueueOverflow = 24
+  }
+
+  /**
+   * Compact description of a single event delivered to onEvents handler.
+   * Only fields relevant to the event type are present.
+   */
+  interface EventRecord {
+    event: EventId;
+    name?: string;
+    value?: any;
+    text?: string;
+    level?: LogLevel;
+    prefix?: string;
+    reason?: EndFileReason;
+    error?: ErrorCode;
+  }
+
   interface PlayerOptions {
+    /**
+     * Receives all events at once. Deprecated events (like tick, sent for every frame) are included only if there is
+     * a handler or a listener for them.
+     */
+    onEvents?: (events: EventRecord[]) => void;
     onLog?: (text: string, level: LogLevel, prefix: string) => void;
     onFileStart?: () => void;
     onFileEnd?: (reason: EndFileReason, error_code: ErrorCode) => void;
@@ -56,19 +96,215 @@ declare namespace libmpvjs {
     onPlaybackRestart?: () => void;
     onQueueOverflow?: () => void;
     logLevel?: string;
+    /**
+     * Region of the canvas to draw into. Players with a viewport share the rendering context of the canvas, which is
+     * requested with premultipliedAlpha, preserveDrawingBuffer, no alpha and no antialiasing.
+     */
+    viewport?: Viewport;
+    /**
+     * Limits how long events are processed before control is returned to the event loop, 4 ms by default.
+     * The rest of events is processed on the next loop iteration. 0 means no limit.
+     */
+    eventBudgetMs?: number;
+    /**
+     * Limits how many events are processed before control is returned to the event loop. No limit by default.
+     */
+    eventBudgetCount?: number;
   }
 
   type PropertyObserver = (value: any) => void;
 
+  interface ObserveOptions {
+    /**
+     * Changes coming more often are held and delivered once the interval elapses
+     */
+    minIntervalMs?: number;
+    /**
+     * If false, all values held during the interval are delivered as an array. True by default.
+     */
+    latestOnly?: boolean;
+    /**
+     * Format mpv should deliver values in. Scalar formats are much cheaper to convert than the default 'node'.
+     */
+    format?: PropertyFormat;
+    /**
+     * Deliver PropertyPatch objects describing changes since the previous delivery instead of full values.
+     * The first delivery contains the full value. Can be used only with 'node' format.
+     */
+    diff?: boolean;
+  }
+
+  interface GetPropertyOptions {
+    lazy?: boolean;
+  }
+
+  /**
+   * A change of an observed value. If full is set, it is the whole new value and other fields are absent.
+   * Otherwise the value is a list: apply splice to the previous list first, then apply changed items.
+   */
+  interface PropertyPatch {
+    full?: any;
+    length?: number;
+    changed?: {
+      /** index in the new list */
+      index: number;
+      /** changed and added fields of a map item */
+      fields?: { [name: string]: any };
+      /** names of fields removed from a map item */
+      deleted?: string[];
+      /** the new value of an item that is not a map */
+      value?: any;
+    }[];
+    splice?: { index: number, remove: number, items: any[] };
+  }
+
+  type LogLevelName = 'no' | 'fatal' | 'error' | 'warn' | 'info' | 'v' | 'debug' | 'trace';
+
+  interface LogSinkOptions {
+    /**
+     * Maximal number of buffered messages, the oldest messages are dropped when it is exceeded. 1000 by default.
+     */
+    capacity?: number;
+    /**
+     * Least severe level of messages to keep, 'v' by default
+     */
+    level?: LogLevelName;
+    /**
+     * Levels for messages with specific prefixes, a level for 'ffmpeg' also applies to 'ffmpeg/video'
+     */
+    prefixLevels?: { [prefix: string]: LogLevelName };
+    /**
+     * Maximal number of messages with the same prefix kept per rate interval, the rest are summarized in one message.
+     * No limit by default.
+     */
+    rateLimit?: number;
+    rateIntervalMs?: number;
+    /**
+     * If set, buffered messages are delivered to this function every deliverIntervalMs (100 by default)
+     */
+    onLogs?: (records: LogRecord[]) => void;
+    deliverIntervalMs?: number;
+  }
+
+  interface LogRecord {
+    text: string;
+    level: LogLevel;
+    prefix: string;
+  }
+
+  type WatchCondition = { crosses: number[] } | { below: number } | { changed: true };
+
+  type PropertyFormat = 'node' | 'double' | 'int64' | 'flag' | 'string';
+
+  /**
+   * A region of the player canvas, in canvas pixels from the top left corner
+   */
+  interface Viewport {
+    x: number;
+    y: number;
+    width: number;
+    height: number;
+  }
+
   class MpvPlayer {
-    constructor(canvas: HTMLCanvasElement, options: PlayerOptions);
+    constructor(canvas: HTMLCanvasElement|OffscreenCanvas, options: PlayerOptions);
     dispose(): void;
 
     create(): void;
     command(name: string, ...args: any[]): any;
-    getProperty(name: string): any;
+    /**
+     * Returns the current value of a property.
+     * With lazy option, maps and lists of the value are converted only when their items are read. They are read-only,
+     * and lists are array-like objects inheriting array methods rather than real arrays (Array.isArray returns false).
+     * This is much cheaper for large values like playlist or metadata when only a part of them is used.
+     */
+    getProperty(name: string, options?: GetPropertyOptions): any;
     setProperty(name: string, value: any): void;
-    observeProperty(name: string, handler: PropertyObserver): void;
+
+    /**
+     * Returns a property value serialized to json without creating js objects for it.
+     * Keys are named as in objects returned by getProperty, byte arrays are written as null.
+     */
+    getPropertyJSON(name: string): string;
+
+    /**
+     * Sets a property to a value given as json text, which is parsed natively
+     */
+    setPropertyJSON(name: string, json: string): void;
+    /**
+     * Returns an id that can be passed to unobserveProperty
+     */
+    observeProperty(name: string, handler: PropertyObserver, options?: ObserveOptions): number;
+
+    /**
+     * Returns false if there is no observer with this id
+     */
+    unobserveProperty(id: number): boolean;
+
+    /**
+     * Returns the full value last delivered to an observer created with diff option
+     */
+    getObservedSnapshot(id: number): any;
+
+    /**
+     * Returns an array over shared memory kept up to date with values of given numeric or flag properties, so the
+     * values can be read without calling into the player. Element 0 is a generation counter and element n + 1 is the
+     * value of names[n] (flags are 0 or 1, unavailable values are NaN).
+     * The counter is odd while a value is being updated; a read is consistent if the counter is even and has not
+     * changed after the values were read.
+     */
+    mirrorProperties(names: string[]): Float64Array;
+
+    /**
+     * Stops updating an array returned by mirrorProperties. Mirrors not stopped this way last as long as the player.
+     * Returns false if the array is not an active mirror.
+     */
+    unmirrorProperties(mirror: Float64Array): boolean;
+
+    /**
+     * Calls handler only when a numeric property meets the condition, the condition is checked natively on each change.
+     * marker is the crossed value for crosses (handler is called for each crossed value), the threshold for below, and
+     * undefined for changed. Returns an id that can be passed to unwatch.
+     */
+    watch(name: string, condition: WatchCondition, handler: (value: any, marker?: number) => void): number;
+
+    /**
+     * Returns false if there is no watch with this id
+     */
+    unwatch(id: number): boolean;
+
+    /**
+     * Subscribes to an event by its mpv name (like 'file-loaded') or id. The listener receives the same arguments as
+     * the corresponding on* handler in PlayerOptions. mpv does not generate events nobody is subscribed to.
+     * Property changes should be observed with observeProperty.
+     */
+    on(event: string|EventId, listener: (...args: any[]) => void): void;
+
+    /**
+     * Returns false if the listener has not been subscribed to the event
+     */
+    off(event: string|EventId, listener: (...args: any[]) => void): boolean;
+
+    /**
+     * Collects log messages into a native buffer instead of calling onLog handlers for each of them.
+     * Pass null to route log messages back to handlers.
+     */
+    setLogSink(options: LogSinkOptions|null): void;
+
+    /**
+     * Returns and removes all messages collected by the log sink
+     */
+    drainLogs(): LogRecord[];
+    setRenderTarget(target: WebGLFramebuffer|WebGLTexture|null, width?: number, height?: number): void;
+
+    /**
+     * Copies every frame to a 2d canvas or to a region of the player canvas.
+     * Regions are copied from the render target when one is set. Canvas mirrors copy from the player canvas, so they
+     * are not updated while a render target is set.
+     */
+    addMirror(target: HTMLCanvasElement|OffscreenCanvas|Viewport): number;
+    removeMirror(mirror_id: number): boolean;
+    setViewport(viewport: Viewport|null): void;
     cmds: CommandInterface;
     props: PropsInterface;
   }
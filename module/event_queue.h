@@ -0,0 +1,51 @@
+#ifndef ELECTRON_MPV_EVENT_QUEUE_H
+#define ELECTRON_MPV_EVENT_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Bounded lock-free queue passing values from exactly one producer thread to exactly one consumer thread.
+ * push fails when the queue is full, pop fails when it is empty, neither ever blocks.
+ */
+template<class T, size_t Capacity>
+class SpscQueue {
+public:
+  bool push(const T &value) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+
+    _items[tail & (Capacity - 1)] = value;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &value) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+
+    value = _items[head & (Capacity - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity should be a power of two");
+
+  static const size_t CACHE_LINE_SIZE = 64;
+
+  // keep the indexes on separate cache lines, each of them is written by one thread only.
+  // Padding is used instead of alignas, as new does not honour extended alignment before c++17
+  T _items[Capacity];
+  char _items_padding[CACHE_LINE_SIZE];
+  std::atomic<size_t> _head { 0 };
+  char _head_padding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> _tail { 0 };
+  char _tail_padding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+#endif //ELECTRON_MPV_EVENT_QUEUE_H
@@ -1,3 +1,4 @@
+#include <cstring>
 #include "helpers.h"
 
 using namespace v8;
@@ -51,3 +52,72 @@ void mpv_name_for_js(string &name) {
     }
   }
 }
+
+Local<String> as_js_string(const Local<Value> &value) {
+  if (value.IsEmpty()) {
+    return Local<String>();
+  } else if (value->IsString()) {
+    return CastLocal<String>(value);
+  } else if (value->IsStringObject()) {
+    return CastLocal<StringObject>(value)->ValueOf();
+  } else {
+    return Local<String>();
+  }
+}
+
+size_t utf8_capacity(const Local<String> &str) {
+  // a utf-16 code unit takes at most three bytes in utf-8 (a surrogate pair takes four bytes for two units)
+  static const int MAX_ESTIMATED_LENGTH = 4096;
+  int length = str->Length();
+  if (length <= MAX_ESTIMATED_LENGTH) {
+    return static_cast<size_t>(length) * 3 + 1;
+  }
+  return static_cast<size_t>(str->Utf8Length()) + 1;
+}
+
+size_t write_utf8(const Local<String> &str, char *buffer, size_t capacity, bool to_mpv_name) {
+  int written = str->WriteUtf8(buffer, static_cast<int>(capacity), nullptr,
+                               String::NO_NULL_TERMINATION | String::REPLACE_INVALID_UTF8);
+  size_t length = static_cast<size_t>(written);
+  buffer[length] = 0;
+
+  if (to_mpv_name) {
+    char *end = buffer + length;
+    for (char *c = buffer; (c = static_cast<char*>(memchr(c, '_', static_cast<size_t>(end - c)))) != nullptr; ++c) {
+      *c = '-';
+    }
+  }
+  return length;
+}
+
+Utf8String::Utf8String(Isolate *i, const Local<Value> &value, bool to_mpv_name) {
+  Local<String> str = as_js_string(value);
+  if (str.IsEmpty() && (value.IsEmpty() || !value->ToString(i->GetCurrentContext()).ToLocal(&str))) {
+    _valid = false;
+    _inline[0] = 0;
+    return;
+  }
+
+  size_t capacity = utf8_capacity(str);
+  reserve(capacity);
+  _length = write_utf8(str, _data, capacity, to_mpv_name);
+}
+
+void Utf8String::append(char separator, const Local<String> &str, bool to_mpv_name) {
+  size_t capacity = utf8_capacity(str);
+  reserve(_length + 1 + capacity);
+  _data[_length++] = separator;
+  _length += write_utf8(str, _data + _length, capacity, to_mpv_name);
+}
+
+void Utf8String::reserve(size_t capacity) {
+  if (capacity <= _capacity) {
+    return;
+  }
+
+  std::unique_ptr<char[]> heap(new char[capacity]);
+  memcpy(heap.get(), _data, _length);
+  _heap = move(heap);
+  _data = _heap.get();
+  _capacity = capacity;
+}
@@ -7,6 +7,11 @@
 #define BUILD_DEBUG
 //#define BUILD_GL_DEBUG
 
+// context-aware modules can be loaded into several contexts at once, including worker threads
+#ifdef NODE_MODULE_INIT
+#define BUILD_CONTEXT_AWARE
+#endif
+
 #ifdef BUILD_DEBUG
 #define DEBUG(...) std::fprintf(stderr, __VA_ARGS__)
 #else
@@ -42,6 +47,58 @@ void js_name_for_mpv(std::string &name);
 void js_name_for_mpv(char *name);
 void mpv_name_for_js(std::string &name);
 
+/**
+ * Returns a js string or the value of a string object, or an empty handle for other values
+ */
+v8::Local<v8::String> as_js_string(const v8::Local<v8::Value> &value);
+
+/**
+ * Size of a buffer enough to hold a js string converted to null-terminated utf-8 by write_utf8.
+ * Short strings get an upper bound which costs nothing to compute, long ones are measured exactly.
+ */
+size_t utf8_capacity(const v8::Local<v8::String> &str);
+
+/**
+ * Writes a js string as null-terminated utf-8 into a buffer of capacity bytes, as returned by utf8_capacity(str).
+ * If to_mpv_name is set, '_' is replaced by '-' while the string is still hot in cache, as js_name_for_mpv does.
+ * Returns the length of the written string.
+ */
+size_t write_utf8(const v8::Local<v8::String> &str, char *buffer, size_t capacity, bool to_mpv_name = false);
+
+/**
+ * UTF-8 copy of a js string, for passing names of commands and properties to mpv.
+ * Strings fitting into the inline buffer (almost all names) are converted without heap allocations.
+ * Other values are converted with ToString, and the result is not valid if the conversion fails.
+ */
+class Utf8String {
+public:
+  Utf8String(v8::Isolate *i, const v8::Local<v8::Value> &value, bool to_mpv_name = false);
+
+  /**
+   * Appends a separator and another string, for making qualified property names like "metadata/by-key/title"
+   */
+  void append(char separator, const v8::Local<v8::String> &str, bool to_mpv_name = false);
+
+  const char *c_str()const { return _data; }
+  size_t length()const { return _length; }
+  bool empty()const { return _length == 0; }
+  bool valid()const { return _valid; }
+  char operator[](size_t index)const { return _data[index]; }
+
+private:
+  static const size_t INLINE_SIZE = 128;
+
+  char _inline[INLINE_SIZE];
+  std::unique_ptr<char[]> _heap;
+  char *_data = _inline;
+  size_t _length = 0;
+  size_t _capacity = INLINE_SIZE;
+  bool _valid = true;
+
+  void reserve(size_t capacity);
+  Utf8String(const Utf8String &); // disable copying
+};
+
 template<class T, class F>
 inline v8::Local<T> CastLocal(const v8::Local<F> &value) {
   return v8::Local<T>::Cast(value);
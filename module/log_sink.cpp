@@ -0,0 +1,145 @@
+#include <chrono>
+#include "log_sink.h"
+
+using namespace std;
+
+static int64_t now_us() {
+  return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const struct {
+  const char *name;
+  mpv_log_level level;
+} log_levels[] = {
+  { "no", MPV_LOG_LEVEL_NONE },
+  { "fatal", MPV_LOG_LEVEL_FATAL },
+  { "error", MPV_LOG_LEVEL_ERROR },
+  { "warn", MPV_LOG_LEVEL_WARN },
+  { "info", MPV_LOG_LEVEL_INFO },
+  { "v", MPV_LOG_LEVEL_V },
+  { "debug", MPV_LOG_LEVEL_DEBUG },
+  { "trace", MPV_LOG_LEVEL_TRACE }
+};
+
+bool LogSink::levelFromName(const string &name, mpv_log_level &level) {
+  for (auto &l : log_levels) {
+    if (name == l.name) {
+      level = l.level;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *LogSink::levelName(mpv_log_level level) {
+  for (auto &l : log_levels) {
+    if (level == l.level) {
+      return l.name;
+    }
+  }
+  return "trace";
+}
+
+LogSink::LogSink(const Options &options) : _options(options) {
+  if (!_options.capacity) {
+    _options.capacity = 1;
+  }
+  _ring.resize(_options.capacity);
+}
+
+mpv_log_level LogSink::requestLevel()const {
+  mpv_log_level result = _options.level;
+  for (auto &item : _options.prefix_levels) {
+    if (item.second > result) {
+      result = item.second;
+    }
+  }
+  return result;
+}
+
+mpv_log_level LogSink::levelFor(const string &prefix)const {
+  // the longest filter matching the prefix as a whole or up to a slash wins
+  const pair<const string, mpv_log_level> *best = nullptr;
+  for (auto &item : _options.prefix_levels) {
+    const string &key = item.first;
+    bool matches = prefix.compare(0, key.size(), key) == 0
+                   && (prefix.size() == key.size() || prefix[key.size()] == '/');
+    if (matches && (!best || key.size() > best->first.size())) {
+      best = &item;
+    }
+  }
+  return best ? best->second : _options.level;
+}
+
+void LogSink::add(const mpv_event_log_message *msg) {
+  string prefix(msg->prefix ? msg->prefix : "");
+  if (msg->log_level > levelFor(prefix)) {
+    return;
+  }
+
+  lock_guard<mutex> lock(_lock);
+
+  if (_options.rate_limit) {
+    int64_t now = now_us();
+    RateWindow &window = _windows[prefix];
+    if (now - window.start >= _options.rate_interval_us) {
+      closeWindow(prefix, window);
+      window.start = now;
+    }
+
+    if (++window.count > _options.rate_limit) {
+      ++window.suppressed;
+      if (msg->log_level < window.worst) {
+        window.worst = msg->log_level;
+      }
+      return;
+    }
+  }
+
+  push({ msg->log_level, prefix, msg->text ? msg->text : "" });
+}
+
+void LogSink::drain(vector<LogRecord> &records) {
+  lock_guard<mutex> lock(_lock);
+
+  if (_options.rate_limit) {
+    // windows that are already over should report what they have suppressed without waiting for the next message
+    int64_t now = now_us();
+    for (auto &item : _windows) {
+      if (now - item.second.start >= _options.rate_interval_us) {
+        closeWindow(item.first, item.second);
+      }
+    }
+  }
+
+  records.reserve(records.size() + _size + 1);
+  if (_dropped) {
+    records.push_back({ MPV_LOG_LEVEL_WARN, "log",
+                        to_string(_dropped) + " log messages have been dropped, the log buffer is full\n" });
+    _dropped = 0;
+  }
+
+  for (size_t q = 0; q < _size; ++q) {
+    LogRecord &record = _ring[(_head + q) % _ring.size()];
+    records.push_back(move(record));
+  }
+  _head = _size = 0;
+}
+
+void LogSink::closeWindow(const string &prefix, RateWindow &window) {
+  if (window.suppressed) {
+    push({ window.worst, prefix, to_string(window.suppressed) + " messages suppressed by the rate limit\n" });
+  }
+  window = RateWindow();
+}
+
+void LogSink::push(LogRecord &&record) {
+  if (_size == _ring.size()) {
+    _head = (_head + 1) % _ring.size();
+    --_size;
+    ++_dropped;
+  }
+
+  _ring[(_head + _size) % _ring.size()] = move(record);
+  ++_size;
+}
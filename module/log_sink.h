@@ -0,0 +1,68 @@
+#ifndef ELECTRON_MPV_LOG_SINK_H
+#define ELECTRON_MPV_LOG_SINK_H
+
+#include <mpv/client.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdint>
+
+struct LogRecord {
+  mpv_log_level level;
+  std::string prefix;
+  std::string text;
+};
+
+/**
+ * Bounded storage for mpv log messages, filled on the event thread and drained on the main thread.
+ * Messages are filtered by level, which can be set separately for each prefix (a filter for "ffmpeg" also applies to
+ * "ffmpeg/video"). If a prefix logs more than rate_limit messages per rate interval, the rest of messages of this
+ * interval are replaced by a single summary record. When the buffer is full, the oldest messages are dropped, and a
+ * record telling how many messages were lost is delivered with the next drain.
+ */
+class LogSink {
+public:
+  struct Options {
+    size_t capacity = 1000;
+    mpv_log_level level = MPV_LOG_LEVEL_V;
+    std::map<std::string, mpv_log_level> prefix_levels;
+    size_t rate_limit = 0; // 0 means no limit
+    int64_t rate_interval_us = 1000000;
+  };
+
+  explicit LogSink(const Options &options);
+
+  void add(const mpv_event_log_message *msg);
+  void drain(std::vector<LogRecord> &records);
+
+  /**
+   * The most verbose level a message should have to be accepted by any filter, mpv should be asked for this level.
+   */
+  mpv_log_level requestLevel()const;
+
+  static bool levelFromName(const std::string &name, mpv_log_level &level);
+  static const char *levelName(mpv_log_level level);
+
+private:
+  struct RateWindow {
+    int64_t start = 0;
+    size_t count = 0;
+    size_t suppressed = 0;
+    mpv_log_level worst = MPV_LOG_LEVEL_TRACE;
+  };
+
+  mpv_log_level levelFor(const std::string &prefix)const;
+  void closeWindow(const std::string &prefix, RateWindow &window);
+  void push(LogRecord &&record);
+
+  Options _options;
+  std::mutex _lock;
+  std::vector<LogRecord> _ring;
+  size_t _head = 0, _size = 0, _dropped = 0;
+  std::map<std::string, RateWindow> _windows;
+
+  LogSink(const LogSink &); // disable copying
+};
+
+#endif //ELECTRON_MPV_LOG_SINK_H
@@ -1,10 +1,21 @@
 #include <node.h>
 #include "mpv_player.h"
+#include "helpers.h"
 
 using namespace v8;
 
+#ifdef BUILD_CONTEXT_AWARE
+
+NODE_MODULE_INIT(/* exports, module, context */) {
+  MpvPlayer::Init(exports, context);
+}
+
+#else
+
 void Init(Local<Object> exports) {
-  MpvPlayer::Init(exports);
+  MpvPlayer::Init(exports, Isolate::GetCurrent()->GetCurrentContext());
 }
 
 NODE_MODULE(libmpvjs, Init);
+
+#endif
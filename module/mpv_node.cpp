@@ -1,109 +1,1220 @@
 #include <mpv/client.h>
 #include <string>
 #include <cstring>
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 #include "mpv_node.h"
 #include "helpers.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MPV_NODE_HAVE_SSE2
+#endif
+
 using namespace v8;
 using namespace std;
 
-string dump_node(const mpv_node &node) {
-  switch (node.format) {
+string dump_node(const mpv_node &node) {
+  switch (node.format) {
+    case MPV_FORMAT_NONE:
+      return "<none>";
+
+    case MPV_FORMAT_STRING:
+      return string(node.u.string) + " : addr " + to_string(reinterpret_cast<uint64_t>(static_cast<void*>(node.u.string)));
+
+    case MPV_FORMAT_INT64:
+      return to_string(node.u.int64);
+
+    case MPV_FORMAT_DOUBLE:
+      return to_string(node.u.double_);
+
+    case MPV_FORMAT_FLAG:
+      return to_string(static_cast<bool>(node.u.flag));
+
+    case MPV_FORMAT_NODE_ARRAY: {
+      string children = "[\n";
+      for (int q = 0; q < node.u.list->num; ++q) {
+        children += dump_node(node.u.list->values[q]) + "\n";
+      }
+      children += "]";
+      return children;
+    }
+
+    case MPV_FORMAT_NODE_MAP: {
+      string children = "[\n";
+      for (int q = 0; q < node.u.list->num; ++q) {
+        children += string(node.u.list->keys[q]) + " -> " + dump_node(node.u.list->values[q]) + "\n";
+      }
+      children += "]";
+      return children;
+    }
+
+    case MPV_FORMAT_BYTE_ARRAY:
+      return "<byte array with size " + to_string(node.u.ba->size) + ">";
+
+    default:
+      return "<unexpected node with format " + to_string(node.format) + ">";
+  }
+}
+
+static void write_json_string(const char *str, bool key, string &out) {
+  static const char hex[] = "0123456789abcdef";
+
+  out += '"';
+  for (const char *c = str; *c; ++c) {
+    unsigned char ch = static_cast<unsigned char>(*c);
+    switch (ch) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      default:
+        if (ch < 0x20) {
+          out += "\\u00";
+          out += hex[ch >> 4];
+          out += hex[ch & 0xf];
+        } else if (key && ch == '-') {
+          // keys are named as in objects returned by mpv_node_to_v8_value
+          out += '_';
+        } else {
+          out += static_cast<char>(ch);
+        }
+    }
+  }
+  out += '"';
+}
+
+static void write_json_double(double value, string &out) {
+  if (!std::isfinite(value)) {
+    // the same as JSON.stringify does
+    out += "null";
+    return;
+  }
+
+  // use the shortest representation that reads back to the same value
+  char buf[32];
+  for (int precision = 15; precision <= 17; ++precision) {
+    snprintf(buf, sizeof buf, "%.*g", precision, value);
+    if (strtod(buf, nullptr) == value) {
+      break;
+    }
+  }
+  out += buf;
+}
+
+void write_node_json(const mpv_node &node, string &out) {
+  switch (node.format) {
+    case MPV_FORMAT_STRING:
+      write_json_string(node.u.string, false, out);
+      break;
+
+    case MPV_FORMAT_INT64:
+      out += to_string(node.u.int64);
+      break;
+
+    case MPV_FORMAT_DOUBLE:
+      write_json_double(node.u.double_, out);
+      break;
+
+    case MPV_FORMAT_FLAG:
+      out += node.u.flag ? "true" : "false";
+      break;
+
+    case MPV_FORMAT_NODE_ARRAY: {
+      out += '[';
+      for (int q = 0; q < node.u.list->num; ++q) {
+        if (q > 0) {
+          out += ',';
+        }
+        write_node_json(node.u.list->values[q], out);
+      }
+      out += ']';
+    } break;
+
+    case MPV_FORMAT_NODE_MAP: {
+      out += '{';
+      for (int q = 0; q < node.u.list->num; ++q) {
+        if (q > 0) {
+          out += ',';
+        }
+        write_json_string(node.u.list->keys[q], true, out);
+        out += ':';
+        write_node_json(node.u.list->values[q], out);
+      }
+      out += '}';
+    } break;
+
+    default:
+      // byte arrays have no json representation
+      out += "null";
+  }
+}
+
+mpv_node mpv_data_as_node(mpv_format format, const void *data) {
+  mpv_node node;
+  node.format = data ? format : MPV_FORMAT_NONE;
+
+  switch (node.format) {
+    case MPV_FORMAT_NODE:
+      return *static_cast<const mpv_node*>(data);
+
+    case MPV_FORMAT_FLAG:
+      node.u.flag = *static_cast<const int*>(data);
+      break;
+
+    case MPV_FORMAT_DOUBLE:
+      node.u.double_ = *static_cast<const double*>(data);
+      break;
+
+    case MPV_FORMAT_INT64:
+      node.u.int64 = *static_cast<const int64_t*>(data);
+      break;
+
+    case MPV_FORMAT_STRING:
+    case MPV_FORMAT_OSD_STRING:
+      node.format = MPV_FORMAT_STRING;
+      node.u.string = *static_cast<char* const*>(data);
+      break;
+
+    default:
+      node.format = MPV_FORMAT_NONE;
+      break;
+  }
+
+  return node;
+}
+
+bool mpv_format_from_name(const string &name, mpv_format &format) {
+  static const struct {
+    const char *name;
+    mpv_format format;
+  } formats[] = {
+    { "node", MPV_FORMAT_NODE },
+    { "double", MPV_FORMAT_DOUBLE },
+    { "int64", MPV_FORMAT_INT64 },
+    { "flag", MPV_FORMAT_FLAG },
+    { "string", MPV_FORMAT_STRING }
+  };
+
+  for (auto &f : formats) {
+    if (name == f.name) {
+      format = f.format;
+      return true;
+    }
+  }
+  return false;
+}
+
+static size_t flat_align(size_t size) {
+  return (size + alignof(mpv_node) - 1) & ~(alignof(mpv_node) - 1);
+}
+
+template<class T>
+static T *flat_alloc(char *&cursor, size_t count = 1) {
+  T *result = reinterpret_cast<T*>(cursor);
+  cursor += flat_align(sizeof(T) * count);
+  return result;
+}
+
+size_t flat_string_size(const char *str) {
+  return str ? flat_align(strlen(str) + 1) : 0;
+}
+
+char *flat_string_copy(const char *str, char *&cursor) {
+  if (!str) {
+    return nullptr;
+  }
+
+  size_t length = strlen(str);
+  char *result = flat_alloc<char>(cursor, length + 1);
+  memcpy(result, str, length + 1);
+  return result;
+}
+
+size_t flat_node_size(const mpv_node &node) {
+  switch (node.format) {
+    case MPV_FORMAT_STRING:
+      return flat_string_size(node.u.string);
+
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+      int count = node.u.list->num;
+      size_t size = flat_align(sizeof(mpv_node_list)) + flat_align(sizeof(mpv_node) * count);
+      if (node.format == MPV_FORMAT_NODE_MAP) {
+        size += flat_align(sizeof(char*) * count);
+        for (int q = 0; q < count; ++q) {
+          size += flat_string_size(node.u.list->keys[q]);
+        }
+      }
+      for (int q = 0; q < count; ++q) {
+        size += flat_node_size(node.u.list->values[q]);
+      }
+      return size;
+    }
+
+    case MPV_FORMAT_BYTE_ARRAY:
+      return flat_align(sizeof(mpv_byte_array)) + flat_align(node.u.ba->size);
+
+    default:
+      return 0;
+  }
+}
+
+void flat_node_copy(mpv_node &dst, const mpv_node &src, char *&cursor) {
+  switch (src.format) {
+    case MPV_FORMAT_STRING:
+      dst.format = MPV_FORMAT_STRING;
+      dst.u.string = flat_string_copy(src.u.string, cursor);
+      break;
+
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP: {
+      int count = src.u.list->num;
+      dst.format = src.format;
+      dst.u.list = flat_alloc<mpv_node_list>(cursor);
+      dst.u.list->num = count;
+      dst.u.list->values = flat_alloc<mpv_node>(cursor, count);
+      dst.u.list->keys = nullptr;
+
+      if (src.format == MPV_FORMAT_NODE_MAP) {
+        dst.u.list->keys = flat_alloc<char*>(cursor, count);
+        for (int q = 0; q < count; ++q) {
+          dst.u.list->keys[q] = flat_string_copy(src.u.list->keys[q], cursor);
+        }
+      }
+
+      for (int q = 0; q < count; ++q) {
+        flat_node_copy(dst.u.list->values[q], src.u.list->values[q], cursor);
+      }
+    } break;
+
+    case MPV_FORMAT_BYTE_ARRAY:
+      dst.format = MPV_FORMAT_BYTE_ARRAY;
+      dst.u.ba = flat_alloc<mpv_byte_array>(cursor);
+      dst.u.ba->size = src.u.ba->size;
+      dst.u.ba->data = flat_alloc<uint8_t>(cursor, src.u.ba->size);
+      memcpy(dst.u.ba->data, src.u.ba->data, src.u.ba->size);
+      break;
+
+    default:
+      dst = src;
+      break;
+  }
+}
+
+/**
+ * Keys of js objects describing well-known mpv structures: items of track-list, playlist and chapter-list, video-params
+ * and audio-params (see libmpvjs.d.ts). Maps having only these keys get objects of a stable shape.
+ */
+static const char *well_known_keys[] = {
+  // track-list items
+  "id", "type", "src_id", "title", "lang", "albumart", "default", "forced", "selected", "external", "external_filename",
+  "codec", "ff_index", "decoder_desc", "demux_w", "demux_h", "demux_channel_count", "demux_channels",
+  "demux_samplerate", "demux_fps", "audio_channels", "replaygain_track_peak", "replaygain_track_gain",
+  "replaygain_album_peak", "replaygain_album_gain",
+  // playlist items
+  "filename", "current", "playing",
+  // chapter-list items
+  "time",
+  // audio-params
+  "format", "samplerate", "channels", "hr_channels", "channel_count",
+  // video-params
+  "pixelformat", "w", "h", "dw", "dh", "aspect", "par", "colormatrix", "colorlevels", "primaries", "gamma",
+  "sig_peak", "light", "chroma_location", "rotate", "stereo_in"
+};
+
+/**
+ * Conversion of mpv nodes keeps some v8 objects between calls. Each thread runs at most one isolate at a time, so these
+ * objects are kept per thread. Sizes of caches are limited, values not fitting into them are converted each time.
+ *
+ * Maps returned by mpv (track-list, playlist, metadata and so on) repeat the same few dozen keys over and over, so
+ * js names for these keys are kept as internalized strings.
+ *
+ * Maps of well-known structures are converted by instantiating an object template having all keys of the map, so
+ * objects are created with their final shape at once instead of going through a chain of transitions, and all objects
+ * with the same set of keys share the shape. Templates are keyed by the sequence of keys.
+ */
+struct ConversionCache {
+  static const size_t MAX_KEYS = 512;
+  static const size_t MAX_SHAPES = 64;
+
+  struct Shape {
+    vector<string> keys;
+    unique_ptr<Persistent<ObjectTemplate>> tpl;
+  };
+
+  struct Key {
+    string mpv_name;
+    unique_ptr<Persistent<String>> js_name;
+  };
+
+  explicit ConversionCache(Isolate *i) : isolate(i) { }
+
+  Isolate *isolate;
+  unordered_multimap<size_t, Key> keys; // keyed by hash of mpv names, so lookups need no copy of the name
+  unordered_multimap<size_t, Shape> shapes;
+  unordered_map<size_t, bool> rejected_shapes; // hashes of key sequences known to have keys not in well_known_keys
+  unique_ptr<Persistent<ObjectTemplate>> lazy_map; // template for lazily converted maps
+  unique_ptr<Persistent<FunctionTemplate>> lazy_list; // class of lazily converted lists
+  Persistent<Context> lazy_list_context; // the context lazy_list_ctor belongs to
+  Persistent<Function> lazy_list_ctor;
+};
+
+static thread_local ConversionCache *conversion_cache = nullptr;
+
+static ConversionCache *cache_for(Isolate *i) {
+  if (!conversion_cache || conversion_cache->isolate != i) {
+    release_conversion_cache();
+    conversion_cache = new ConversionCache(i);
+  }
+  return conversion_cache;
+}
+
+static Local<String> js_key(Isolate *i, const char *mpv_key) {
+  ConversionCache *cache = cache_for(i);
+
+  size_t hash = 14695981039346656037ULL;
+  for (const char *c = mpv_key; *c; ++c) {
+    hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ULL;
+  }
+
+  auto range = cache->keys.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.mpv_name == mpv_key) {
+      return it->second.js_name->Get(i);
+    }
+  }
+
+  string js_name(mpv_key);
+  mpv_name_for_js(js_name);
+  Local<String> result = String::NewFromUtf8(i, js_name.c_str(), NewStringType::kInternalized,
+                                             static_cast<int>(js_name.size())).ToLocalChecked();
+  if (cache->keys.size() < ConversionCache::MAX_KEYS) {
+    ConversionCache::Key key { mpv_key, unique_ptr<Persistent<String>>(new Persistent<String>(i, result)) };
+    cache->keys.emplace(hash, move(key));
+  }
+  return result;
+}
+
+static bool is_well_known_key(const char *mpv_key) {
+  string js_name(mpv_key);
+  mpv_name_for_js(js_name);
+  for (auto key : well_known_keys) {
+    if (js_name == key) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Returns a template for objects with keys of the given map, or an empty handle if the map is not a well-known one.
+ */
+static Local<ObjectTemplate> shape_template(Isolate *i, const mpv_node_list *list) {
+  ConversionCache *cache = cache_for(i);
+
+  size_t hash = 14695981039346656037ULL;
+  for (int j = 0; j < list->num; ++j) {
+    for (const char *c = list->keys[j]; *c; ++c) {
+      hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ULL;
+    }
+    hash = (hash ^ 0xff) * 1099511628211ULL; // key separator
+  }
+
+  auto range = cache->shapes.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    const vector<string> &keys = it->second.keys;
+    if (keys.size() != static_cast<size_t>(list->num)) {
+      continue;
+    }
+
+    bool equal = true;
+    for (int j = 0; j < list->num && equal; ++j) {
+      equal = keys[j] == list->keys[j];
+    }
+    if (equal) {
+      return it->second.tpl->Get(i);
+    }
+  }
+
+  if (cache->rejected_shapes.count(hash) || cache->shapes.size() >= ConversionCache::MAX_SHAPES) {
+    return Local<ObjectTemplate>();
+  }
+
+  for (int j = 0; j < list->num; ++j) {
+    if (!is_well_known_key(list->keys[j])) {
+      if (cache->rejected_shapes.size() < ConversionCache::MAX_SHAPES) {
+        cache->rejected_shapes[hash] = true;
+      }
+      return Local<ObjectTemplate>();
+    }
+  }
+
+  ConversionCache::Shape shape;
+  Local<ObjectTemplate> tpl = ObjectTemplate::New(i);
+  for (int j = 0; j < list->num; ++j) {
+    shape.keys.emplace_back(list->keys[j]);
+    tpl->Set(js_key(i, list->keys[j]), Undefined(i));
+  }
+  shape.tpl.reset(new Persistent<ObjectTemplate>(i, tpl));
+  cache->shapes.emplace(hash, move(shape));
+  return tpl;
+}
+
+void release_conversion_cache() {
+  if (conversion_cache) {
+    for (auto &item : conversion_cache->keys) {
+      item.second.js_name->Reset();
+    }
+    for (auto &item : conversion_cache->shapes) {
+      item.second.tpl->Reset();
+    }
+    if (conversion_cache->lazy_map) {
+      conversion_cache->lazy_map->Reset();
+    }
+    if (conversion_cache->lazy_list) {
+      conversion_cache->lazy_list->Reset();
+    }
+    conversion_cache->lazy_list_context.Reset();
+    conversion_cache->lazy_list_ctor.Reset();
+    delete conversion_cache;
+    conversion_cache = nullptr;
+  }
+}
+
+/**
+ * Returns the length of the leading run of ascii characters
+ */
+static size_t ascii_prefix_length(const char *str, size_t length) {
+  size_t pos = 0;
+
+#ifdef MPV_NODE_HAVE_SSE2
+  for (; pos + 16 <= length; pos += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + pos));
+    if (_mm_movemask_epi8(chunk) != 0) {
+      break;
+    }
+  }
+#else
+  for (; pos + 8 <= length; pos += 8) {
+    uint64_t word;
+    memcpy(&word, str + pos, sizeof word);
+    if (word & 0x8080808080808080ULL) {
+      break;
+    }
+  }
+#endif
+
+  while (pos < length && !(static_cast<unsigned char>(str[pos]) & 0x80)) {
+    ++pos;
+  }
+  return pos;
+}
+
+/**
+ * Checks a multibyte utf-8 sequence starting at s. Returns its length if it is valid, otherwise returns the length of
+ * its maximal invalid part, which should be replaced by a single U+FFFD.
+ */
+static size_t utf8_sequence(const unsigned char *s, size_t available, bool &valid) {
+  size_t length;
+  unsigned char lower = 0x80, upper = 0xbf; // allowed range of the second byte, excluding overlongs and surrogates
+  unsigned char lead = s[0];
+
+  if (lead >= 0xc2 && lead <= 0xdf) {
+    length = 2;
+  } else if (lead == 0xe0) {
+    length = 3;
+    lower = 0xa0;
+  } else if (lead == 0xed) {
+    length = 3;
+    upper = 0x9f;
+  } else if (lead >= 0xe1 && lead <= 0xef) {
+    length = 3;
+  } else if (lead == 0xf0) {
+    length = 4;
+    lower = 0x90;
+  } else if (lead == 0xf4) {
+    length = 4;
+    upper = 0x8f;
+  } else if (lead >= 0xf1 && lead <= 0xf3) {
+    length = 4;
+  } else {
+    valid = false;
+    return 1;
+  }
+
+  size_t q = 1;
+  for (; q < length && q < available; ++q) {
+    unsigned char min = q == 1 ? lower : 0x80, max = q == 1 ? upper : 0xbf;
+    if (s[q] < min || s[q] > max) {
+      break;
+    }
+  }
+
+  valid = q == length;
+  return q;
+}
+
+Local<String> mpv_string_to_v8(Isolate *i, const char *str, size_t length) {
+  size_t pos = ascii_prefix_length(str, length);
+  if (pos == length) {
+    return String::NewFromOneByte(i, reinterpret_cast<const uint8_t*>(str), NewStringType::kNormal,
+                                  static_cast<int>(length)).ToLocalChecked();
+  }
+
+  // the string is copied only if it has invalid sequences
+  string repaired;
+  bool repairing = false;
+  size_t copied = 0;
+
+  auto bytes = reinterpret_cast<const unsigned char*>(str);
+  while (pos < length) {
+    if (bytes[pos] < 0x80) {
+      pos += ascii_prefix_length(str + pos, length - pos);
+      continue;
+    }
+
+    bool valid;
+    size_t sequence_length = utf8_sequence(bytes + pos, length - pos, valid);
+    if (!valid) {
+      if (!repairing) {
+        repaired.reserve(length + 16);
+        repairing = true;
+      }
+      repaired.append(str + copied, pos - copied);
+      repaired += "\xef\xbf\xbd";
+      copied = pos + sequence_length;
+    }
+    pos += sequence_length;
+  }
+
+  if (repairing) {
+    repaired.append(str + copied, length - copied);
+    str = repaired.data();
+    length = repaired.size();
+  }
+  return String::NewFromUtf8(i, str, NewStringType::kNormal, static_cast<int>(length)).ToLocalChecked();
+}
+
+Local<String> mpv_string_to_v8(Isolate *i, const char *str) {
+  return mpv_string_to_v8(i, str, strlen(str));
+}
+
+/**
+ * A node tree allocated by mpv, shared by array buffers pointing into its byte arrays
+ */
+struct ForeignTree {
+  mpv_node node;
+
+  ~ForeignTree() {
+    mpv_free_node_contents(&node);
+  }
+};
+
+/**
+ * An array buffer backed by a byte array of a foreign tree, the tree is released after all such buffers are collected
+ */
+struct ExternalBuffer {
+  Persistent<ArrayBuffer> handle;
+  shared_ptr<ForeignTree> tree;
+  size_t size;
+};
+
+/**
+ * Byte arrays smaller than this are copied, tracking an external buffer costs more than copying a small one
+ */
+static const size_t EXTERNAL_BUFFER_MIN_SIZE = 16 * 1024;
+
+static Local<Value> node_to_v8(Isolate *i, const mpv_node *node, vector<ExternalBuffer*> *externals) {
+  switch (node->format) {
+    case MPV_FORMAT_FLAG:
+      return Boolean::New(i, node->u.flag != 0);
+
+    case MPV_FORMAT_DOUBLE:
+      return Number::New(i, node->u.double_);
+
+    case MPV_FORMAT_STRING:
+      return mpv_string_to_v8(i, node->u.string);
+
+    case MPV_FORMAT_NONE:
+      return Null(i);
+
+    case MPV_FORMAT_INT64:
+      // consider returning this value as a string?
+      return Number::New(i, static_cast<double>(node->u.int64));
+
+    case MPV_FORMAT_NODE_ARRAY: {
+      auto arr = Array::New(i, node->u.list->num);
+      for (int j = 0; j < node->u.list->num; ++j) {
+        arr->Set(static_cast<uint32_t>(j), node_to_v8(i, &node->u.list->values[j], externals));
+      }
+      return arr;
+    } break;
+
+    case MPV_FORMAT_NODE_MAP: {
+      Local<Object> obj;
+      Local<ObjectTemplate> tpl = shape_template(i, node->u.list);
+      if (tpl.IsEmpty() || !tpl->NewInstance(i->GetCurrentContext()).ToLocal(&obj)) {
+        obj = Object::New(i);
+      }
+
+      for (int j = 0; j < node->u.list->num; ++j) {
+        obj->Set(js_key(i, node->u.list->keys[j]), node_to_v8(i, &node->u.list->values[j], externals));
+      }
+      return obj;
+    } break;
+
+    case MPV_FORMAT_BYTE_ARRAY: {
+      if (externals && node->u.ba->size >= EXTERNAL_BUFFER_MIN_SIZE) {
+        auto buf = ArrayBuffer::New(i, node->u.ba->data, node->u.ba->size, ArrayBufferCreationMode::kExternalized);
+        auto external = new ExternalBuffer;
+        external->handle.Reset(i, buf);
+        external->size = node->u.ba->size;
+        external->handle.SetWeak(external, [](const WeakCallbackInfo<ExternalBuffer> &info) {
+          // only resetting the handle is allowed in the first pass, the rest is done in the second one
+          info.GetParameter()->handle.Reset();
+          info.SetSecondPassCallback([](const WeakCallbackInfo<ExternalBuffer> &info) {
+            ExternalBuffer *external = info.GetParameter();
+            info.GetIsolate()->AdjustAmountOfExternalAllocatedMemory(-static_cast<int64_t>(external->size));
+            delete external;
+          });
+        }, WeakCallbackType::kParameter);
+        i->AdjustAmountOfExternalAllocatedMemory(static_cast<int64_t>(external->size));
+        externals->push_back(external);
+        return buf;
+      }
+
+      auto buf = ArrayBuffer::New(i, node->u.ba->size);
+      memcpy(buf->GetContents().Data(), node->u.ba->data, node->u.ba->size);
+      return buf;
+    } break;
+
+    default:
+      throw_js(i, ("while converting mpv_node to v8 object: unexpected format = " + to_string(node->format)).c_str());
+      return Local<Value>();
+  }
+}
+
+Local<Value> mpv_node_to_v8_value(Isolate *i, const mpv_node *node) {
+  return node_to_v8(i, node, nullptr);
+}
+
+Local<Value> mpv_node_to_v8_value(Isolate *i, AutoForeignMpvNode &foreign) {
+  vector<ExternalBuffer*> externals;
+  Local<Value> result = node_to_v8(i, &foreign.node, &externals);
+
+  if (!externals.empty()) {
+    // buffers cannot be collected before we return, they are referenced by local handles
+    auto tree = make_shared<ForeignTree>();
+    tree->node = foreign.node;
+    foreign.node.format = MPV_FORMAT_NONE;
+    for (auto external : externals) {
+      external->tree = tree;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * A map or a list of a foreign tree exposed to js through interceptors. Items are converted on first access and kept
+ * for later ones, so reading the same item twice gives the same object.
+ */
+struct LazyNode {
+  Persistent<Object> handle;
+  shared_ptr<ForeignTree> tree;
+  const mpv_node *node;
+  vector<unique_ptr<Persistent<Value>>> items;
+};
+
+static Local<Value> lazy_node_to_v8(Isolate *i, const shared_ptr<ForeignTree> &tree, const mpv_node *node);
+
+static LazyNode *lazy_node_of(const Local<Object> &holder) {
+  return static_cast<LazyNode*>(holder->GetAlignedPointerFromInternalField(0));
+}
+
+/**
+ * Looks up a map item by its js name, the same name js_key gives to the mpv key. Returns -1 if there is no such item.
+ */
+static int lazy_map_index(const mpv_node *map, const char *js_name) {
+  for (int j = 0; j < map->u.list->num; ++j) {
+    const char *k = map->u.list->keys[j], *n = js_name;
+    for (; *k && *n; ++k, ++n) {
+      if (*k != *n && !(*k == '-' && *n == '_')) {
+        break;
+      }
+    }
+    if (!*k && !*n) {
+      return j;
+    }
+  }
+  return -1;
+}
+
+static int lazy_map_index(Isolate *i, const mpv_node *map, Local<Name> property) {
+  if (!property->IsString()) {
+    return -1;
+  }
+  String::Utf8Value name(i, property);
+  return *name ? lazy_map_index(map, *name) : -1;
+}
+
+static Local<Value> lazy_item(Isolate *i, LazyNode *lazy, int index) {
+  auto &cached = lazy->items[static_cast<size_t>(index)];
+  if (cached) {
+    return cached->Get(i);
+  }
+
+  const mpv_node *item = &lazy->node->u.list->values[index];
+  if (item->format != MPV_FORMAT_NODE_MAP && item->format != MPV_FORMAT_NODE_ARRAY
+      && item->format != MPV_FORMAT_BYTE_ARRAY) {
+    // scalars are cheap to convert again and do not have identity
+    return node_to_v8(i, item, nullptr);
+  }
+
+  Local<Value> value = lazy_node_to_v8(i, lazy->tree, item);
+  if (!value.IsEmpty()) {
+    cached.reset(new Persistent<Value>(i, value));
+  }
+  return value;
+}
+
+static void lazy_map_get(Local<Name> property, const PropertyCallbackInfo<Value> &info) {
+  LazyNode *lazy = lazy_node_of(info.Holder());
+  int index = lazy_map_index(info.GetIsolate(), lazy->node, property);
+  if (index >= 0) {
+    info.GetReturnValue().Set(lazy_item(info.GetIsolate(), lazy, index));
+  }
+}
+
+static void lazy_map_query(Local<Name> property, const PropertyCallbackInfo<Integer> &info) {
+  if (lazy_map_index(info.GetIsolate(), lazy_node_of(info.Holder())->node, property) >= 0) {
+    info.GetReturnValue().Set(static_cast<int32_t>(ReadOnly | DontDelete));
+  }
+}
+
+static void lazy_map_enumerate(const PropertyCallbackInfo<Array> &info) {
+  Isolate *i = info.GetIsolate();
+  const mpv_node_list *list = lazy_node_of(info.Holder())->node->u.list;
+  auto keys = Array::New(i, list->num);
+  for (int j = 0; j < list->num; ++j) {
+    keys->Set(i->GetCurrentContext(), static_cast<uint32_t>(j), js_key(i, list->keys[j]));
+  }
+  info.GetReturnValue().Set(keys);
+}
+
+// keys of mpv maps looking like array indices are routed by v8 to indexed interceptors
+
+static void lazy_map_get_indexed(uint32_t index, const PropertyCallbackInfo<Value> &info) {
+  LazyNode *lazy = lazy_node_of(info.Holder());
+  int item = lazy_map_index(lazy->node, to_string(index).c_str());
+  if (item >= 0) {
+    info.GetReturnValue().Set(lazy_item(info.GetIsolate(), lazy, item));
+  }
+}
+
+static void lazy_map_query_indexed(uint32_t index, const PropertyCallbackInfo<Integer> &info) {
+  if (lazy_map_index(lazy_node_of(info.Holder())->node, to_string(index).c_str()) >= 0) {
+    info.GetReturnValue().Set(static_cast<int32_t>(ReadOnly | DontDelete));
+  }
+}
+
+static void lazy_list_get(uint32_t index, const PropertyCallbackInfo<Value> &info) {
+  LazyNode *lazy = lazy_node_of(info.Holder());
+  if (index < static_cast<uint32_t>(lazy->node->u.list->num)) {
+    info.GetReturnValue().Set(lazy_item(info.GetIsolate(), lazy, static_cast<int>(index)));
+  }
+}
+
+static void lazy_list_query(uint32_t index, const PropertyCallbackInfo<Integer> &info) {
+  if (index < static_cast<uint32_t>(lazy_node_of(info.Holder())->node->u.list->num)) {
+    info.GetReturnValue().Set(static_cast<int32_t>(ReadOnly | DontDelete));
+  }
+}
+
+static void lazy_list_enumerate(const PropertyCallbackInfo<Array> &info) {
+  Isolate *i = info.GetIsolate();
+  int count = lazy_node_of(info.Holder())->node->u.list->num;
+  auto indices = Array::New(i, count);
+  for (int j = 0; j < count; ++j) {
+    indices->Set(i->GetCurrentContext(), static_cast<uint32_t>(j), Integer::New(i, j));
+  }
+  info.GetReturnValue().Set(indices);
+}
+
+static void lazy_list_length(Local<Name> property, const PropertyCallbackInfo<Value> &info) {
+  if (property->IsString() && property.As<String>()->StrictEquals(make_string(info.GetIsolate(), "length"))) {
+    info.GetReturnValue().Set(lazy_node_of(info.Holder())->node->u.list->num);
+  }
+}
+
+/**
+ * JSON.stringify handles only real arrays as lists, so lazy lists provide toJSON returning one
+ */
+static void lazy_list_to_json(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  Local<Object> self = args.This();
+  // the function can be called on any object, and other objects with an internal field hold something else in it
+  ConversionCache *cache = cache_for(i);
+  if (!cache->lazy_list || !cache->lazy_list->Get(i)->HasInstance(self)) {
+    return;
+  }
+
+  LazyNode *lazy = lazy_node_of(self);
+  if (lazy->node->format != MPV_FORMAT_NODE_ARRAY) {
+    return;
+  }
+
+  auto arr = Array::New(i, lazy->node->u.list->num);
+  for (int j = 0; j < lazy->node->u.list->num; ++j) {
+    arr->Set(i->GetCurrentContext(), static_cast<uint32_t>(j), lazy_item(i, lazy, j));
+  }
+  args.GetReturnValue().Set(arr);
+}
+
+static Local<ObjectTemplate> lazy_map_template(Isolate *i) {
+  ConversionCache *cache = cache_for(i);
+  if (cache->lazy_map) {
+    return cache->lazy_map->Get(i);
+  }
+
+  Local<ObjectTemplate> tpl = ObjectTemplate::New(i);
+  tpl->SetInternalFieldCount(1);
+  tpl->SetHandler(NamedPropertyHandlerConfiguration(lazy_map_get, nullptr, lazy_map_query, nullptr,
+                                                    lazy_map_enumerate));
+  tpl->SetHandler(IndexedPropertyHandlerConfiguration(lazy_map_get_indexed, nullptr, lazy_map_query_indexed));
+  cache->lazy_map.reset(new Persistent<ObjectTemplate>(i, tpl));
+  return tpl;
+}
+
+/**
+ * Lazy lists are not real arrays, but array methods work on them as on any array-like object, so the prototype of
+ * lazy lists inherits from Array.prototype. The prototype chain is set up once per context, so instances are created
+ * with their final shape.
+ */
+static Local<Function> lazy_list_constructor(Isolate *i) {
+  ConversionCache *cache = cache_for(i);
+  Local<Context> ctx = i->GetCurrentContext();
+  if (!cache->lazy_list_ctor.IsEmpty() && cache->lazy_list_context.Get(i) == ctx) {
+    return cache->lazy_list_ctor.Get(i);
+  }
+
+  Local<FunctionTemplate> tpl;
+  if (cache->lazy_list) {
+    tpl = cache->lazy_list->Get(i);
+  } else {
+    tpl = FunctionTemplate::New(i);
+    Local<ObjectTemplate> instance_tpl = tpl->InstanceTemplate();
+    instance_tpl->SetInternalFieldCount(1);
+    instance_tpl->SetHandler(NamedPropertyHandlerConfiguration(lazy_list_length));
+    instance_tpl->SetHandler(IndexedPropertyHandlerConfiguration(lazy_list_get, nullptr, lazy_list_query, nullptr,
+                                                                 lazy_list_enumerate));
+    tpl->PrototypeTemplate()->Set(make_string(i, "toJSON"), FunctionTemplate::New(i, lazy_list_to_json), DontEnum);
+    cache->lazy_list.reset(new Persistent<FunctionTemplate>(i, tpl));
+  }
+
+  Local<Function> ctor;
+  Local<Value> proto;
+  if (!tpl->GetFunction(ctx).ToLocal(&ctor) || !ctor->Get(ctx, make_string(i, "prototype")).ToLocal(&proto)
+      || !proto->IsObject()) {
+    return Local<Function>();
+  }
+  if (proto.As<Object>()->SetPrototype(ctx, Array::New(i)->GetPrototype()).IsNothing()) {
+    return Local<Function>();
+  }
+
+  // weak, so the cache does not keep a closed context alive
+  cache->lazy_list_context.Reset(i, ctx);
+  cache->lazy_list_context.SetWeak();
+  cache->lazy_list_ctor.Reset(i, ctor);
+  cache->lazy_list_ctor.SetWeak();
+  return ctor;
+}
+
+static Local<Value> lazy_node_to_v8(Isolate *i, const shared_ptr<ForeignTree> &tree, const mpv_node *node) {
+  if (node->format != MPV_FORMAT_NODE_MAP && node->format != MPV_FORMAT_NODE_ARRAY) {
+    return node_to_v8(i, node, nullptr);
+  }
+
+  Local<Context> ctx = i->GetCurrentContext();
+  Local<Object> obj;
+  if (node->format == MPV_FORMAT_NODE_ARRAY) {
+    Local<Function> ctor = lazy_list_constructor(i);
+    if (ctor.IsEmpty() || !ctor->NewInstance(ctx).ToLocal(&obj)) {
+      return Local<Value>();
+    }
+  } else if (!lazy_map_template(i)->NewInstance(ctx).ToLocal(&obj)) {
+    return Local<Value>();
+  }
+
+  auto lazy = new LazyNode;
+  lazy->tree = tree;
+  lazy->node = node;
+  lazy->items.resize(static_cast<size_t>(node->u.list->num));
+  lazy->handle.Reset(i, obj);
+  lazy->handle.SetWeak(lazy, [](const WeakCallbackInfo<LazyNode> &info) {
+    // only resetting the handle is allowed in the first pass
+    info.GetParameter()->handle.Reset();
+    info.SetSecondPassCallback([](const WeakCallbackInfo<LazyNode> &info) {
+      LazyNode *lazy = info.GetParameter();
+      for (auto &item : lazy->items) {
+        if (item) {
+          item->Reset();
+        }
+      }
+      delete lazy;
+    });
+  }, WeakCallbackType::kParameter);
+  obj->SetAlignedPointerInInternalField(0, lazy);
+  return obj;
+}
+
+Local<Value> mpv_node_to_lazy_v8_value(Isolate *i, AutoForeignMpvNode &foreign) {
+  if (foreign.node.format != MPV_FORMAT_NODE_MAP && foreign.node.format != MPV_FORMAT_NODE_ARRAY) {
+    return mpv_node_to_v8_value(i, foreign);
+  }
+
+  auto tree = make_shared<ForeignTree>();
+  tree->node = foreign.node;
+  foreign.node.format = MPV_FORMAT_NONE;
+  return lazy_node_to_v8(i, tree, &tree->node);
+}
+
+bool mpv_node_equal(const mpv_node &a, const mpv_node &b) {
+  if (a.format != b.format) {
+    return false;
+  }
+
+  switch (a.format) {
     case MPV_FORMAT_NONE:
-      return "<none>";
+      return true;
 
-    case MPV_FORMAT_STRING:
-      return string(node.u.string) + " : addr " + to_string(reinterpret_cast<uint64_t>(static_cast<void*>(node.u.string)));
+    case MPV_FORMAT_FLAG:
+      return (a.u.flag != 0) == (b.u.flag != 0);
 
     case MPV_FORMAT_INT64:
-      return to_string(node.u.int64);
+      return a.u.int64 == b.u.int64;
 
     case MPV_FORMAT_DOUBLE:
-      return to_string(node.u.double_);
+      return a.u.double_ == b.u.double_;
 
-    case MPV_FORMAT_FLAG:
-      return to_string(static_cast<bool>(node.u.flag));
+    case MPV_FORMAT_STRING:
+      return strcmp(a.u.string, b.u.string) == 0;
 
-    case MPV_FORMAT_NODE_ARRAY: {
-      string children = "[\n";
-      for (int q = 0; q < node.u.list->num; ++q) {
-        children += dump_node(node.u.list->values[q]) + "\n";
+    case MPV_FORMAT_NODE_ARRAY:
+    case MPV_FORMAT_NODE_MAP:
+      if (a.u.list->num != b.u.list->num) {
+        return false;
       }
-      children += "]";
-      return children;
-    }
-
-    case MPV_FORMAT_NODE_MAP: {
-      string children = "[\n";
-      for (int q = 0; q < node.u.list->num; ++q) {
-        children += string(node.u.list->keys[q]) + " -> " + dump_node(node.u.list->values[q]) + "\n";
+      for (int q = 0; q < a.u.list->num; ++q) {
+        if (a.format == MPV_FORMAT_NODE_MAP && strcmp(a.u.list->keys[q], b.u.list->keys[q]) != 0) {
+          return false;
+        }
+        if (!mpv_node_equal(a.u.list->values[q], b.u.list->values[q])) {
+          return false;
+        }
       }
-      children += "]";
-      return children;
-    }
+      return true;
 
     case MPV_FORMAT_BYTE_ARRAY:
-      return "<byte array with size " + to_string(node.u.ba->size) + ">";
+      return a.u.ba->size == b.u.ba->size && memcmp(a.u.ba->data, b.u.ba->data, a.u.ba->size) == 0;
 
     default:
-      return "<unexpected node with format " + to_string(node.format) + ">";
+      return false;
   }
 }
 
-Local<Value> mpv_node_to_v8_value(Isolate *i, const mpv_node *node) {
-  switch (node->format) {
-    case MPV_FORMAT_FLAG:
-      return Boolean::New(i, node->u.flag != 0);
-
-    case MPV_FORMAT_DOUBLE:
-      return Number::New(i, node->u.double_);
+static const mpv_node *map_value(const mpv_node &map, const char *key) {
+  for (int q = 0; q < map.u.list->num; ++q) {
+    if (strcmp(map.u.list->keys[q], key) == 0) {
+      return &map.u.list->values[q];
+    }
+  }
+  return nullptr;
+}
 
-    case MPV_FORMAT_STRING:
-      // handle broken utf-8
-      return String::NewFromUtf8(i, node->u.string);
+/**
+ * Describes how an item of a list has changed: only changed fields for maps, or the whole new value otherwise
+ */
+static Local<Object> item_patch(Isolate *i, const mpv_node &prev, const mpv_node &cur, uint32_t index) {
+  Local<Context> ctx = i->GetCurrentContext();
+  Local<Object> patch = Object::New(i);
+  patch->Set(ctx, make_string(i, "index"), Integer::NewFromUnsigned(i, index));
 
-    case MPV_FORMAT_NONE:
-      return Null(i);
+  if (prev.format != MPV_FORMAT_NODE_MAP || cur.format != MPV_FORMAT_NODE_MAP) {
+    patch->Set(ctx, make_string(i, "value"), mpv_node_to_v8_value(i, &cur));
+    return patch;
+  }
 
-    case MPV_FORMAT_INT64:
-      // consider returning this value as a string?
-      return Number::New(i, static_cast<double>(node->u.int64));
+  Local<Object> fields = Object::New(i);
+  for (int q = 0; q < cur.u.list->num; ++q) {
+    const mpv_node *prev_value = map_value(prev, cur.u.list->keys[q]);
+    if (!prev_value || !mpv_node_equal(*prev_value, cur.u.list->values[q])) {
+      fields->Set(ctx, js_key(i, cur.u.list->keys[q]), mpv_node_to_v8_value(i, &cur.u.list->values[q]));
+    }
+  }
+  patch->Set(ctx, make_string(i, "fields"), fields);
 
-    case MPV_FORMAT_NODE_ARRAY: {
-      auto arr = Array::New(i, node->u.list->num);
-      for (int j = 0; j < node->u.list->num; ++j) {
-        arr->Set(static_cast<uint32_t>(j), mpv_node_to_v8_value(i, &node->u.list->values[j]));
+  Local<Array> deleted;
+  for (int q = 0; q < prev.u.list->num; ++q) {
+    if (!map_value(cur, prev.u.list->keys[q])) {
+      if (deleted.IsEmpty()) {
+        deleted = Array::New(i);
       }
-      return arr;
-    } break;
+      deleted->Set(ctx, deleted->Length(), js_key(i, prev.u.list->keys[q]));
+    }
+  }
+  if (!deleted.IsEmpty()) {
+    patch->Set(ctx, make_string(i, "deleted"), deleted);
+  }
 
-    case MPV_FORMAT_NODE_MAP: {
-      auto obj = Object::New(i);
-      for (int j = 0; j < node->u.list->num; ++j) {
-        string key_name(node->u.list->keys[j]);
-        mpv_name_for_js(key_name);
-        obj->Set(make_string(i, key_name), mpv_node_to_v8_value(i, &node->u.list->values[j]));
-      }
-      return obj;
-    } break;
+  return patch;
+}
 
-    case MPV_FORMAT_BYTE_ARRAY: {
-      auto buf = ArrayBuffer::New(i, node->u.ba->size);
-      memcpy(buf->GetContents().Data(), node->u.ba->data, node->u.ba->size);
-      return buf;
-    } break;
+Local<Value> mpv_node_diff_to_v8_value(Isolate *i, const mpv_node *prev, const mpv_node &cur) {
+  Local<Context> ctx = i->GetCurrentContext();
+  Local<Object> patch = Object::New(i);
 
-    default:
-      throw_js(i, ("while converting mpv_node to v8 object: unexpected format = " + to_string(node->format)).c_str());
+  if (!prev || prev->format != MPV_FORMAT_NODE_ARRAY || cur.format != MPV_FORMAT_NODE_ARRAY) {
+    if (prev && mpv_node_equal(*prev, cur)) {
       return Local<Value>();
+    }
+    patch->Set(ctx, make_string(i, "full"), mpv_node_to_v8_value(i, &cur));
+    return patch;
+  }
+
+  const mpv_node *prev_items = prev->u.list->values, *cur_items = cur.u.list->values;
+  int prev_count = prev->u.list->num, cur_count = cur.u.list->num;
+
+  // skip common head and tail, everything between them is either changed, removed or inserted
+  int head = 0;
+  while (head < prev_count && head < cur_count && mpv_node_equal(prev_items[head], cur_items[head])) {
+    ++head;
+  }
+
+  int tail = 0;
+  while (tail < prev_count - head && tail < cur_count - head
+         && mpv_node_equal(prev_items[prev_count - tail - 1], cur_items[cur_count - tail - 1])) {
+    ++tail;
+  }
+
+  if (head == prev_count && head == cur_count) {
+    return Local<Value>();
+  }
+
+  // items in the middle are paired by position, the rest of the longer side is spliced
+  int prev_middle = prev_count - head - tail, cur_middle = cur_count - head - tail;
+  int paired = prev_middle < cur_middle ? prev_middle : cur_middle;
+
+  Local<Array> changed = Array::New(i);
+  for (int q = head; q < head + paired; ++q) {
+    if (!mpv_node_equal(prev_items[q], cur_items[q])) {
+      changed->Set(ctx, changed->Length(), item_patch(i, prev_items[q], cur_items[q], static_cast<uint32_t>(q)));
+    }
+  }
+
+  patch->Set(ctx, make_string(i, "length"), Integer::New(i, cur_count));
+  patch->Set(ctx, make_string(i, "changed"), changed);
+
+  if (prev_middle != cur_middle) {
+    Local<Object> splice = Object::New(i);
+    splice->Set(ctx, make_string(i, "index"), Integer::New(i, head + paired));
+    splice->Set(ctx, make_string(i, "remove"), Integer::New(i, prev_middle - paired));
+
+    Local<Array> items = Array::New(i, cur_middle - paired);
+    for (int q = 0; q < cur_middle - paired; ++q) {
+      items->Set(ctx, static_cast<uint32_t>(q), mpv_node_to_v8_value(i, &cur_items[head + paired + q]));
+    }
+    splice->Set(ctx, make_string(i, "items"), items);
+    patch->Set(ctx, make_string(i, "splice"), splice);
+  }
+
+  return patch;
+}
+
+void *NodeArena::alloc(size_t size) {
+  return alloc(size, false);
+}
+
+void *NodeArena::alloc_exact(size_t size) {
+  return alloc(size, true);
+}
+
+void *NodeArena::alloc(size_t size, bool exact_chunk) {
+  size = (size + alignof(mpv_node) - 1) & ~(alignof(mpv_node) - 1);
+
+  if (static_cast<size_t>(_end - _cur) < size) {
+    if (_next_chunk < _chunks.size() && _chunks[_next_chunk].size >= size) {
+      // reuse a chunk left from previous trees
+    } else {
+      size_t chunk_size = _chunks.empty() ? MIN_CHUNK_SIZE : _chunks.back().size * 2;
+      if (exact_chunk || chunk_size < size) {
+        chunk_size = size;
+      }
+      _chunks.insert(_chunks.begin() + _next_chunk, Chunk { std::unique_ptr<char[]>(new char[chunk_size]), chunk_size });
+    }
+
+    Chunk &chunk = _chunks[_next_chunk++];
+    _cur = chunk.data.get();
+    _end = _cur + chunk.size;
+  }
+
+  _last = _cur;
+  _cur += size;
+  return _last;
+}
+
+char *NodeArena::copy_string(const char *str, size_t length) {
+  char *result = alloc<char>(length + 1);
+  memcpy(result, str, length);
+  result[length] = 0;
+  return result;
+}
+
+void NodeArena::shrink_last(void *ptr, size_t size) {
+  size = (size + alignof(mpv_node) - 1) & ~(alignof(mpv_node) - 1);
+  if (ptr == _last && _last + size <= _cur) {
+    _cur = _last + size;
+  }
+}
+
+void NodeArena::reset() {
+  size_t retained = 0;
+  for (auto &chunk : _chunks) {
+    retained += chunk.size;
+  }
+  if (retained > MAX_RETAINED_SIZE) {
+    _chunks.clear();
+  }
+
+  _cur = _inline;
+  _end = _inline + INLINE_SIZE;
+  _last = nullptr;
+  _next_chunk = 0;
+}
+
+void AutoMpvNode::use_arena(NodeArena *arena) {
+  if (arena && !arena->in_use) {
+    _arena = arena;
+  } else {
+    _arena = &_own_arena;
   }
+  _arena->in_use = true;
 }
 
-AutoMpvNode::AutoMpvNode(Isolate *i, const Local<Value> &value) {
+AutoMpvNode::AutoMpvNode(Isolate *i, const Local<Value> &value, NodeArena *arena) {
+  use_arena(arena);
   init_node(i, _node, value);
 }
 
-AutoMpvNode::AutoMpvNode(const FunctionCallbackInfo<Value> &args, int first_arg_index) {
+AutoMpvNode::AutoMpvNode(const FunctionCallbackInfo<Value> &args, int first_arg_index, NodeArena *arena) {
+  use_arena(arena);
   int real_arg_count = args.Length() - first_arg_index;
 
   if (real_arg_count <= 0) {
@@ -112,15 +1223,10 @@ AutoMpvNode::AutoMpvNode(const FunctionCallbackInfo<Value> &args, int first_arg_
     init_node(args.GetIsolate(), _node, args[first_arg_index]);
   } else {
     _node.format = MPV_FORMAT_NODE_ARRAY;
-    _node.u.list = new mpv_node_list;
+    _node.u.list = _arena->alloc<mpv_node_list>();
     _node.u.list->num = real_arg_count;
     _node.u.list->keys = nullptr;
-    _node.u.list->values = new mpv_node[real_arg_count];
-
-    for (int q = 0; q < real_arg_count; ++q) {
-      _node.u.list->values[q].format = MPV_FORMAT_NONE;
-      _node.u.list->values[q].u.string = nullptr;
-    }
+    _node.u.list->values = _arena->alloc<mpv_node>(real_arg_count);
 
     for (int q = 0; q < real_arg_count; ++q) {
       init_node(args.GetIsolate(), _node.u.list->values[q], args[q + first_arg_index]);
@@ -128,15 +1234,17 @@ AutoMpvNode::AutoMpvNode(const FunctionCallbackInfo<Value> &args, int first_arg_
   }
 }
 
-AutoMpvNode::AutoMpvNode(const string &cmd_name, const FunctionCallbackInfo<Value> &cmd_args) {
+AutoMpvNode::AutoMpvNode(const Utf8String &cmd_name, const FunctionCallbackInfo<Value> &cmd_args, NodeArena *arena) {
+  use_arena(arena);
+
   if (cmd_args.Length() == 0) {
     init_node_string(_node, cmd_name);
   } else {
     _node.format = MPV_FORMAT_NODE_ARRAY;
-    _node.u.list = new mpv_node_list;
+    _node.u.list = _arena->alloc<mpv_node_list>();
     _node.u.list->num = cmd_args.Length() + 1;
     _node.u.list->keys = nullptr;
-    _node.u.list->values = new mpv_node[cmd_args.Length() + 1];
+    _node.u.list->values = _arena->alloc<mpv_node>(cmd_args.Length() + 1);
 
     init_node_string(_node.u.list->values[0], cmd_name);
 
@@ -146,15 +1254,369 @@ AutoMpvNode::AutoMpvNode(const string &cmd_name, const FunctionCallbackInfo<Valu
   }
 }
 
+AutoMpvNode::AutoMpvNode(const mpv_node &src, NodeArena *arena) {
+  use_arena(arena);
+  // copies without an arena are held for a long time, e.g. as pending observer values, so they take only what they need
+  size_t size = flat_node_size(src);
+  char *cursor = static_cast<char*>(_arena == &_own_arena ? _arena->alloc_exact(size) : _arena->alloc(size));
+  flat_node_copy(_node, src, cursor);
+}
+
 AutoMpvNode::~AutoMpvNode() {
-  free_node(_node);
+  // the whole tree lives in the arena
+  _arena->reset();
+  _arena->in_use = false;
+}
+
+/**
+ * Recursive descent json parser building a node tree in an arena.
+ * Items of a list being parsed are collected on a stack shared by all levels, and are moved to the arena when the list
+ * is complete, so the parser does not allocate anything besides the arena memory once the stacks have grown.
+ */
+class JsonNodeParser {
+public:
+  JsonNodeParser(const char *json, size_t length, NodeArena &arena)
+      : _begin(json), _cur(json), _end(json + length), _arena(arena) { }
+
+  bool parse(mpv_node &node) {
+    if (!parse_value(node, 0)) {
+      return false;
+    }
+    skip_space();
+    return _cur == _end || fail("unexpected data after a value");
+  }
+
+  std::string error;
+
+private:
+  static const int MAX_DEPTH = 512;
+
+  const char *_begin, *_cur, *_end;
+  NodeArena &_arena;
+  vector<mpv_node> _values;
+  vector<char*> _keys;
+
+  bool fail(const char *reason) {
+    error = string(reason) + " at offset " + to_string(_cur - _begin);
+    return false;
+  }
+
+  void skip_space() {
+    while (_cur != _end && (*_cur == ' ' || *_cur == '\t' || *_cur == '\n' || *_cur == '\r')) {
+      ++_cur;
+    }
+  }
+
+  bool consume(const char *literal) {
+    size_t length = strlen(literal);
+    if (static_cast<size_t>(_end - _cur) < length || memcmp(_cur, literal, length) != 0) {
+      return fail("invalid literal");
+    }
+    _cur += length;
+    return true;
+  }
+
+  bool parse_value(mpv_node &node, int depth) {
+    skip_space();
+    if (_cur == _end) {
+      return fail("unexpected end of data");
+    }
+
+    switch (*_cur) {
+      case '{':
+        return parse_list(node, depth, true);
+
+      case '[':
+        return parse_list(node, depth, false);
+
+      case '"':
+        node.format = MPV_FORMAT_STRING;
+        return parse_string(node.u.string);
+
+      case 't':
+        node.format = MPV_FORMAT_FLAG;
+        node.u.flag = 1;
+        return consume("true");
+
+      case 'f':
+        node.format = MPV_FORMAT_FLAG;
+        node.u.flag = 0;
+        return consume("false");
+
+      case 'n':
+        node.format = MPV_FORMAT_NONE;
+        return consume("null");
+
+      default:
+        return parse_number(node);
+    }
+  }
+
+  bool parse_list(mpv_node &node, int depth, bool map) {
+    if (depth >= MAX_DEPTH) {
+      return fail("too deep nesting");
+    }
+
+    char close = map ? '}' : ']';
+    size_t first = _values.size();
+    ++_cur;
+
+    skip_space();
+    if (_cur != _end && *_cur == close) {
+      ++_cur;
+    } else {
+      for (;;) {
+        if (map) {
+          skip_space();
+          char *key;
+          if (_cur == _end || *_cur != '"' || !parse_string(key)) {
+            return error.empty() ? fail("a key expected") : false;
+          }
+          js_name_for_mpv(key);
+          _keys.push_back(key);
+
+          skip_space();
+          if (_cur == _end || *_cur != ':') {
+            return fail("':' expected");
+          }
+          ++_cur;
+        }
+
+        mpv_node item;
+        if (!parse_value(item, depth + 1)) {
+          return false;
+        }
+        _values.push_back(item);
+
+        skip_space();
+        if (_cur != _end && *_cur == ',') {
+          ++_cur;
+        } else if (_cur != _end && *_cur == close) {
+          ++_cur;
+          break;
+        } else {
+          return fail(map ? "',' or '}' expected" : "',' or ']' expected");
+        }
+      }
+    }
+
+    size_t count = _values.size() - first;
+    node.format = map ? MPV_FORMAT_NODE_MAP : MPV_FORMAT_NODE_ARRAY;
+    node.u.list = _arena.alloc<mpv_node_list>();
+    node.u.list->num = static_cast<int>(count);
+    node.u.list->values = _arena.alloc<mpv_node>(count);
+    std::copy(_values.begin() + first, _values.end(), node.u.list->values);
+    _values.resize(first);
+
+    if (map) {
+      node.u.list->keys = _arena.alloc<char*>(count);
+      std::copy(_keys.end() - count, _keys.end(), node.u.list->keys);
+      _keys.resize(_keys.size() - count);
+    } else {
+      node.u.list->keys = nullptr;
+    }
+    return true;
+  }
+
+  bool parse_hex4(unsigned &code) {
+    if (_end - _cur < 4) {
+      return fail("invalid escape sequence");
+    }
+    code = 0;
+    for (int q = 0; q < 4; ++q, ++_cur) {
+      char c = *_cur;
+      unsigned digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        digit = c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        digit = c - 'A' + 10;
+      } else {
+        return fail("invalid escape sequence");
+      }
+      code = (code << 4) | digit;
+    }
+    return true;
+  }
+
+  static void put_utf8(unsigned code, char *&out) {
+    if (code < 0x80) {
+      *out++ = static_cast<char>(code);
+    } else if (code < 0x800) {
+      *out++ = static_cast<char>(0xc0 | (code >> 6));
+      *out++ = static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+      *out++ = static_cast<char>(0xe0 | (code >> 12));
+      *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      *out++ = static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+      *out++ = static_cast<char>(0xf0 | (code >> 18));
+      *out++ = static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+      *out++ = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      *out++ = static_cast<char>(0x80 | (code & 0x3f));
+    }
+  }
+
+  bool parse_string(char *&result) {
+    ++_cur;
+    const char *str_end = static_cast<const char*>(memchr(_cur, '"', static_cast<size_t>(_end - _cur)));
+    if (!str_end) {
+      return fail("unterminated string");
+    }
+
+    // decoded string is never longer than its json representation, but escaped quotes make the representation longer
+    // than found by memchr, so look for the real end first
+    while (str_end) {
+      size_t backslashes = 0;
+      for (const char *c = str_end - 1; c >= _cur && *c == '\\'; --c) {
+        ++backslashes;
+      }
+      if (backslashes % 2 == 0) {
+        break;
+      }
+      str_end = static_cast<const char*>(memchr(str_end + 1, '"', static_cast<size_t>(_end - str_end - 1)));
+    }
+    if (!str_end) {
+      return fail("unterminated string");
+    }
+
+    result = _arena.alloc<char>(static_cast<size_t>(str_end - _cur) + 1);
+    char *out = result;
+    while (_cur != str_end) {
+      char c = *_cur++;
+      if (c != '\\') {
+        if (static_cast<unsigned char>(c) < 0x20) {
+          --_cur;
+          return fail("control character in a string");
+        }
+        *out++ = c;
+        continue;
+      }
+
+      switch (*_cur++) {
+        case '"': *out++ = '"'; break;
+        case '\\': *out++ = '\\'; break;
+        case '/': *out++ = '/'; break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u': {
+          const char *escape_start = _cur - 2;
+          unsigned code = 0;
+          if (!parse_hex4(code)) {
+            return false;
+          }
+          if (code == 0) {
+            // strings in mpv nodes are null-terminated, so the rest of the string would be lost
+            _cur = escape_start;
+            return fail("null character in a string");
+          }
+          if (code >= 0xd800 && code < 0xdc00 && str_end - _cur >= 6 && _cur[0] == '\\' && _cur[1] == 'u') {
+            const char *pair_start = _cur;
+            _cur += 2;
+            unsigned low = 0;
+            if (!parse_hex4(low)) {
+              return false;
+            }
+            if (low >= 0xdc00 && low < 0xe000) {
+              code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            } else {
+              _cur = pair_start;
+            }
+          }
+          if (code >= 0xd800 && code < 0xe000) {
+            // a lone surrogate cannot be encoded in utf-8
+            code = 0xfffd;
+          }
+          put_utf8(code, out);
+        } break;
+
+        default:
+          --_cur;
+          return fail("invalid escape sequence");
+      }
+    }
+
+    *out = 0;
+    ++_cur; // closing quote
+    return true;
+  }
+
+  bool parse_number(mpv_node &node) {
+    const char *start = _cur;
+    bool integer = true;
+
+    if (_cur != _end && *_cur == '-') {
+      ++_cur;
+    }
+    if (_cur == _end || *_cur < '0' || *_cur > '9') {
+      _cur = start;
+      return fail("unexpected character");
+    }
+    if (*_cur == '0' && _end - _cur > 1 && _cur[1] >= '0' && _cur[1] <= '9') {
+      _cur = start;
+      return fail("invalid number");
+    }
+    while (_cur != _end && ((*_cur >= '0' && *_cur <= '9') || *_cur == '.' || *_cur == 'e' || *_cur == 'E'
+                            || *_cur == '+' || *_cur == '-')) {
+      if (*_cur == '.' || *_cur == 'e' || *_cur == 'E') {
+        integer = false;
+      }
+      ++_cur;
+    }
+
+    // the data is not null-terminated
+    char buf[64];
+    size_t length = static_cast<size_t>(_cur - start);
+    string long_number;
+    const char *number = buf;
+    if (length < sizeof buf) {
+      memcpy(buf, start, length);
+      buf[length] = 0;
+    } else {
+      long_number.assign(start, length);
+      number = long_number.c_str();
+    }
+
+    char *number_end;
+    errno = 0;
+    if (integer) {
+      long long value = strtoll(number, &number_end, 10);
+      if (errno == 0 && number_end == number + length) {
+        node.format = MPV_FORMAT_INT64;
+        node.u.int64 = value;
+        return true;
+      }
+      errno = 0;
+    }
+
+    double value = strtod(number, &number_end);
+    if (number_end != number + length) {
+      _cur = start;
+      return fail("invalid number");
+    }
+    node.format = MPV_FORMAT_DOUBLE;
+    node.u.double_ = value;
+    return true;
+  }
+};
+
+AutoMpvNode::AutoMpvNode(const char *json, size_t length, string &error, NodeArena *arena) {
+  use_arena(arena);
+
+  JsonNodeParser parser(json, length, *_arena);
+  if (!parser.parse(_node)) {
+    error = parser.error;
+    _node.format = MPV_FORMAT_NONE;
+  }
 }
 
-void AutoMpvNode::init_node_string(mpv_node &node, const string &str) {
+void AutoMpvNode::init_node_string(mpv_node &node, const Utf8String &str) {
   node.format = MPV_FORMAT_STRING;
-  node.u.string = new char[str.size() + 1];
-  memcpy(node.u.string, str.c_str(), str.size());
-  node.u.string[str.size()] = 0;
+  node.u.string = _arena->copy_string(str.c_str(), str.length());
 }
 
 void AutoMpvNode::init_node(Isolate *i, mpv_node &node, const Local<Value> &value) {
@@ -164,54 +1626,55 @@ void AutoMpvNode::init_node(Isolate *i, mpv_node &node, const Local<Value> &valu
     node.format = MPV_FORMAT_FLAG;
     node.u.flag = value->BooleanValue() ? 1 : 0;
   } else if (value->IsString() || value->IsStringObject()) {
-    String::Utf8Value val(value);
-    if (*val) {
-      node.format = MPV_FORMAT_STRING;
-      node.u.string = new char[val.length() + 1];
-      memcpy(node.u.string, *val, static_cast<size_t>(val.length()));
-      node.u.string[val.length()] = 0;
-    } else {
-      node.format = MPV_FORMAT_NONE;
-    }
+    // written right into the arena, without an intermediate copy
+    Local<String> str = as_js_string(value);
+    node.format = MPV_FORMAT_STRING;
+    size_t capacity = utf8_capacity(str);
+    node.u.string = _arena->alloc<char>(capacity);
+    _arena->shrink_last(node.u.string, write_utf8(str, node.u.string, capacity) + 1);
   } else if (value->IsInt32()) {
     node.format = MPV_FORMAT_INT64;
     node.u.int64 = value->Int32Value();
   } else if (value->IsNumber() || value->IsNumberObject()) {
     node.format = MPV_FORMAT_DOUBLE;
     node.u.double_ = value->NumberValue();
-  } else if (value->IsArrayBuffer() || value->IsArrayBufferView()) {
-    // in node v6, As<S> is non-const function, so we should cast the reference
-    Local<ArrayBuffer> buf = value->IsArrayBufferView()
-                             ? CastLocal<ArrayBufferView>(value)->Buffer()
-                             : CastLocal<ArrayBuffer>(value);
-
-    if (buf.IsEmpty()) {
-      node.format = MPV_FORMAT_NONE;
-      return;
+  } else if (value->IsArrayBuffer() || value->IsArrayBufferView() || value->IsSharedArrayBuffer()) {
+    // byte arrays borrow memory of js buffers, the node is used only during a synchronous call into mpv
+    uint8_t *data;
+    size_t size;
+    if (value->IsArrayBufferView()) {
+      // in node v6, As<S> is non-const function, so we should cast the reference
+      Local<ArrayBufferView> view = CastLocal<ArrayBufferView>(value);
+      Local<ArrayBuffer> buf = view->Buffer();
+      if (buf.IsEmpty()) {
+        node.format = MPV_FORMAT_NONE;
+        return;
+      }
+      data = static_cast<uint8_t*>(buf->GetContents().Data()) + view->ByteOffset();
+      size = view->ByteLength();
+    } else if (value->IsSharedArrayBuffer()) {
+      Local<SharedArrayBuffer> buf = CastLocal<SharedArrayBuffer>(value);
+      data = static_cast<uint8_t*>(buf->GetContents().Data());
+      size = buf->ByteLength();
+    } else {
+      Local<ArrayBuffer> buf = CastLocal<ArrayBuffer>(value);
+      data = static_cast<uint8_t*>(buf->GetContents().Data());
+      size = buf->ByteLength();
     }
 
     node.format = MPV_FORMAT_BYTE_ARRAY;
-    node.u.ba = new mpv_byte_array;
-    node.u.ba->size = buf->ByteLength();
-    node.u.ba->data = new uint8_t[buf->ByteLength()];
-    memcpy(node.u.ba->data, buf->GetContents().Data(), buf->ByteLength());
-  } else if (value->IsSharedArrayBuffer()) {
-    Local<SharedArrayBuffer> buf = CastLocal<SharedArrayBuffer>(value);
-
-    node.format = MPV_FORMAT_BYTE_ARRAY;
-    node.u.ba = new mpv_byte_array;
-    node.u.ba->size = buf->ByteLength();
-    node.u.ba->data = new uint8_t[buf->ByteLength()];
-    memcpy(node.u.ba->data, buf->GetContents().Data(), buf->ByteLength());
+    node.u.ba = _arena->alloc<mpv_byte_array>();
+    node.u.ba->size = size;
+    node.u.ba->data = data;
   } else if (value->IsArray()) {
     Local<Array> arr = CastLocal<Array>(value);
     uint32_t arr_length = arr->Length();
 
     node.format = MPV_FORMAT_NODE_ARRAY;
-    node.u.list = new mpv_node_list;
+    node.u.list = _arena->alloc<mpv_node_list>();
     node.u.list->num = arr_length;
     node.u.list->keys = nullptr;
-    node.u.list->values = new mpv_node[arr_length];
+    node.u.list->values = _arena->alloc<mpv_node>(arr_length);
 
     for (uint32_t j = 0; j < arr_length; ++j) {
       init_node(i, node.u.list->values[j], arr->Get(j));
@@ -222,18 +1685,19 @@ void AutoMpvNode::init_node(Isolate *i, mpv_node &node, const Local<Value> &valu
     uint32_t prop_count = own_props->Length();
 
     node.format = MPV_FORMAT_NODE_MAP;
-    node.u.list = new mpv_node_list;
+    node.u.list = _arena->alloc<mpv_node_list>();
     node.u.list->num = prop_count;
-    node.u.list->keys = new char*[prop_count];
-    node.u.list->values = new mpv_node[prop_count];
+    node.u.list->keys = _arena->alloc<char*>(prop_count);
+    node.u.list->values = _arena->alloc<mpv_node>(prop_count);
 
     for (uint32_t j = 0; j < prop_count; ++j) {
-      Local<String> prop_name = own_props->Get(j).As<String>();
-      String::Utf8Value prop_name_value(prop_name);
-      node.u.list->keys[j] = new char[prop_name_value.length() + 1];
-      memcpy(node.u.list->keys[j], *prop_name_value, static_cast<size_t>(prop_name_value.length()));
-      node.u.list->keys[j][prop_name_value.length()] = 0;
-      js_name_for_mpv(node.u.list->keys[j]);
+      // names of integer-like keys can be numbers
+      Local<Value> key = own_props->Get(j);
+      Local<String> prop_name = key->IsString() ? CastLocal<String>(key)
+                                                : key->ToString(i->GetCurrentContext()).ToLocalChecked();
+      size_t capacity = utf8_capacity(prop_name);
+      node.u.list->keys[j] = _arena->alloc<char>(capacity);
+      _arena->shrink_last(node.u.list->keys[j], write_utf8(prop_name, node.u.list->keys[j], capacity, true) + 1);
 
       init_node(i, node.u.list->values[j], obj->Get(prop_name));
     }
@@ -242,34 +1706,3 @@ void AutoMpvNode::init_node(Isolate *i, mpv_node &node, const Local<Value> &valu
     node.format = MPV_FORMAT_NONE;
   }
 }
-
-void AutoMpvNode::free_node(mpv_node &node) {
-  switch (node.format) {
-    case MPV_FORMAT_STRING:
-      delete[] node.u.string;
-      break;
-
-    case MPV_FORMAT_NODE_ARRAY:
-    case MPV_FORMAT_NODE_MAP:
-      if (node.u.list->keys) {
-        for (int k = 0; k < node.u.list->num; ++k) {
-          delete[] node.u.list->keys[k];
-        }
-        delete node.u.list->keys;
-      }
-      for (int v = 0; v < node.u.list->num; ++v) {
-        free_node(node.u.list->values[v]);
-      }
-      delete[] node.u.list->values;
-      delete node.u.list;
-      break;
-
-    case MPV_FORMAT_BYTE_ARRAY:
-      delete[] static_cast<uint8_t*>(node.u.ba->data);
-      delete node.u.ba;
-      break;
-
-    default:
-      break;
-  }
-}
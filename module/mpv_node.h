@@ -3,14 +3,81 @@
 
 #include <v8.h>
 #include <memory>
+#include <vector>
 #include <mpv/client.h>
 #include "helpers.h"
 
+/**
+ * Bump allocator for node trees.
+ * Memory is released all at once by reset, so freeing a tree takes no time. Small trees fit into the inline buffer and
+ * need no heap allocations at all; larger ones take memory from chunks, which are kept for reuse after reset unless they
+ * grow too large.
+ */
+class NodeArena {
+public:
+  NodeArena() : _cur(_inline), _end(_inline + INLINE_SIZE) { }
+
+  void *alloc(size_t size);
+
+  /**
+   * Same as alloc, but a new chunk, if needed, is exactly as large as the allocation. For arenas holding a single
+   * block, where a minimum sized chunk would be mostly wasted.
+   */
+  void *alloc_exact(size_t size);
+  template<class T> T *alloc(size_t count = 1) { return static_cast<T*>(alloc(sizeof(T) * count)); }
+  char *copy_string(const char *str, size_t length);
+
+  /**
+   * Gives back the unused tail of the last allocation, which only needs size bytes now.
+   * Does nothing if ptr is not the last allocation.
+   */
+  void shrink_last(void *ptr, size_t size);
+  void reset();
+
+  /**
+   * Set while a node allocated from this arena is alive, so nested conversions do not reset each other's memory
+   */
+  bool in_use = false;
+
+private:
+  static const size_t INLINE_SIZE = 256;
+  static const size_t MIN_CHUNK_SIZE = 4096;
+  static const size_t MAX_RETAINED_SIZE = 1024 * 1024;
+
+  struct Chunk {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  alignas(mpv_node) char _inline[INLINE_SIZE];
+  char *_cur, *_end;
+  char *_last = nullptr; // start of the last allocation, for shrink_last
+  std::vector<Chunk> _chunks;
+  size_t _next_chunk = 0; // index of a chunk to be used when the current one is exhausted
+
+  void *alloc(size_t size, bool exact_chunk);
+  NodeArena(const NodeArena &); // disable copying
+};
+
 class AutoMpvNode {
 public:
-  explicit AutoMpvNode(v8::Isolate *i, const v8::Local<v8::Value> &value);
-  explicit AutoMpvNode(const v8::FunctionCallbackInfo<v8::Value> &args, int first_arg_index = 0);
-  AutoMpvNode(const std::string &cmd_name, const v8::FunctionCallbackInfo<v8::Value> &cmd_args);
+  /**
+   * All constructors accept an optional arena to allocate the tree from. The arena is reset when the node is destroyed.
+   * If no arena is given, or the given one is already used by another node, the node uses its own inline one.
+   * Byte arrays converted from js buffers are not copied, so a node should not outlive the call it is made for.
+   */
+  explicit AutoMpvNode(v8::Isolate *i, const v8::Local<v8::Value> &value, NodeArena *arena = nullptr);
+  explicit AutoMpvNode(const v8::FunctionCallbackInfo<v8::Value> &args, int first_arg_index = 0,
+                       NodeArena *arena = nullptr);
+  AutoMpvNode(const Utf8String &cmd_name, const v8::FunctionCallbackInfo<v8::Value> &cmd_args,
+              NodeArena *arena = nullptr);
+  explicit AutoMpvNode(const mpv_node &src, NodeArena *arena = nullptr);
+
+  /**
+   * Parses json text. Keys of objects are converted to mpv names in the same way as keys of js objects are.
+   * If the text is not a valid json, the node is not valid and error describes the problem.
+   */
+  AutoMpvNode(const char *json, size_t length, std::string &error, NodeArena *arena = nullptr);
   ~AutoMpvNode();
 
   mpv_node *ptr() { return &_node; }
@@ -19,11 +86,13 @@ public:
 
 private:
   mpv_node _node;
+  NodeArena _own_arena;
+  NodeArena *_arena;
   AutoMpvNode(const AutoMpvNode &); // disable copying
 
-  static void init_node_string(mpv_node &node, const std::string &str);
-  static void init_node(v8::Isolate *i, mpv_node &node, const v8::Local<v8::Value> &value);
-  static void free_node(mpv_node &node);
+  void use_arena(NodeArena *arena);
+  void init_node_string(mpv_node &node, const Utf8String &str);
+  void init_node(v8::Isolate *i, mpv_node &node, const v8::Local<v8::Value> &value);
 };
 
 struct AutoForeignMpvNode {
@@ -43,7 +112,67 @@ private:
   AutoForeignMpvNode(const AutoForeignMpvNode &); // disable copying
 };
 
+/**
+ * Converts a string received from mpv. Pure ascii strings are detected with a vectorized scan and created as one-byte
+ * strings, invalid utf-8 sequences are replaced with U+FFFD.
+ */
+v8::Local<v8::String> mpv_string_to_v8(v8::Isolate *i, const char *str, size_t length);
+v8::Local<v8::String> mpv_string_to_v8(v8::Isolate *i, const char *str);
+
 v8::Local<v8::Value> mpv_node_to_v8_value(v8::Isolate *i, const mpv_node *node);
+
+/**
+ * Converts a tree allocated by mpv. Large byte arrays are not copied: array buffers are created over memory of the tree,
+ * and ownership of the tree is taken from the given node. The tree is freed when all such buffers are collected.
+ */
+v8::Local<v8::Value> mpv_node_to_v8_value(v8::Isolate *i, AutoForeignMpvNode &foreign);
+
+/**
+ * Converts a tree allocated by mpv into objects converting their items only when they are accessed, which saves time
+ * when only a few items of a large tree are used. Maps and lists become read-only objects backed by the tree, and
+ * ownership of the tree is taken from the given node. The tree is freed when all these objects are collected.
+ */
+v8::Local<v8::Value> mpv_node_to_lazy_v8_value(v8::Isolate *i, AutoForeignMpvNode &foreign);
+
+bool mpv_node_equal(const mpv_node &a, const mpv_node &b);
+
+/**
+ * Describes how a value has changed since prev as a patch object (see PropertyPatch in libmpvjs.d.ts).
+ * Lists are compared item by item, other values are sent as a whole. Returns an empty handle if nothing has changed.
+ * If prev is null, the patch contains the full value.
+ */
+v8::Local<v8::Value> mpv_node_diff_to_v8_value(v8::Isolate *i, const mpv_node *prev, const mpv_node &cur);
+
+/**
+ * Releases key strings and object templates cached by mpv_node_to_v8_value on the current thread.
+ * Should be called before the isolate running on this thread is disposed.
+ */
+void release_conversion_cache();
+
+/**
+ * Makes a node referring to data of the given format (as received in property change events) without allocating
+ * anything. The returned node does not own data and should not be freed.
+ */
+mpv_node mpv_data_as_node(mpv_format format, const void *data);
+
+bool mpv_format_from_name(const std::string &name, mpv_format &format);
+
+/**
+ * Flat copies keep a whole node tree, including lists, keys, strings and byte arrays, in a single block of memory
+ * provided by the caller, so such a copy can be made with one allocation and released without walking the tree.
+ * flat_node_size returns the number of bytes flat_node_copy writes at cursor, and flat_node_copy advances the cursor
+ * past the written data.
+ */
+size_t flat_node_size(const mpv_node &node);
+void flat_node_copy(mpv_node &dst, const mpv_node &src, char *&cursor);
+size_t flat_string_size(const char *str);
+char *flat_string_copy(const char *str, char *&cursor);
 std::string dump_node(const mpv_node &node);
 
+/**
+ * Appends json representation of a node to out. Keys of maps are named as in objects made by mpv_node_to_v8_value,
+ * byte arrays and non-finite numbers are written as null.
+ */
+void write_node_json(const mpv_node &node, std::string &out);
+
 #endif //ELECTRON_MPV_MPV_NODE_H
@@ -11,25 +11,43 @@
 #include <functional>
 #include <sstream>
 #include <map>
+#include <vector>
+#include <algorithm>
 #include <uv.h>
 #include <locale>
 #include <memory>
 #include <cstring>
+#include <thread>
+#include <chrono>
+#include <new>
+#include <mutex>
+#include <cmath>
 #include "mpv_player.h"
 #include "helpers.h"
 #include "mpv_node.h"
+#include "event_queue.h"
+#include "log_sink.h"
 
 using namespace v8;
 using namespace std;
 using namespace node;
 
+struct ctx_dim {
+  int width = 0, height = 0;
+};
+
+struct ctx_rect {
+  int x = 0, y = 0, width = 0, height = 0;
+};
+
 struct PlayerOptions {
   map<mpv_event_id, shared_ptr<Persistent<Function>>> event_handlers;
+  shared_ptr<Persistent<Function>> batch_handler;
   string log_level;
-};
-
-struct ctx_dim {
-  int width = 0, height = 0;
+  bool has_viewport = false;
+  ctx_rect viewport;
+  double event_budget_ms = 4; // 0 means no limit
+  uint32_t event_budget_count = 0; // 0 means no limit
 };
 
 map<string, mpv_event_id> handler_events = {
@@ -45,6 +63,25 @@ map<string, mpv_event_id> handler_events = {
   { "onQueueOverflow", MPV_EVENT_QUEUE_OVERFLOW }
 };
 
+/**
+ * Keys of event records delivered to onEvents handler
+ */
+enum EVENT_KEY {
+  EK_EVENT,
+  EK_NAME,
+  EK_VALUE,
+  EK_TEXT,
+  EK_LEVEL,
+  EK_PREFIX,
+  EK_REASON,
+  EK_ERROR,
+  EK_COUNT
+};
+
+static const char *event_key_names[EK_COUNT] = {
+  "event", "name", "value", "text", "level", "prefix", "reason", "error"
+};
+
 template<class T>
 struct PersistentDisposer {
   void operator()(Persistent<T> *p)const {
@@ -76,14 +113,323 @@ enum BUF_ROLE {
 
 typedef map<GLuint, shared_ptr<Persistent<Value>>> ObjectStore;
 
+/**
+ * Reads a rectangle from an object with x, y, width and height properties.
+ */
+static bool rect_from_object(Isolate *i, const Local<Value> &value, ctx_rect &rect) {
+  Local<Context> ctx = i->GetCurrentContext();
+
+  if (value.IsEmpty() || !value->IsObject()) {
+    return false;
+  }
+
+  Local<Object> obj = value.As<Object>();
+  const char *keys[] = { "x", "y", "width", "height" };
+  int *values[] = { &rect.x, &rect.y, &rect.width, &rect.height };
+  for (size_t q = 0; q < sizeof(keys) / sizeof(keys[0]); ++q) {
+    Local<Value> v = obj->Get(ctx, make_string(i, keys[q])).ToLocalChecked();
+    if (!v->IsNumber()) {
+      return false;
+    }
+    *values[q] = static_cast<int>(v->IntegerValue(ctx).FromMaybe(0));
+  }
+
+  return rect.width > 0 && rect.height > 0;
+}
+
+/**
+ * State that belongs to a WebGL rendering context rather than to a player.
+ * Calling getContext on the same canvas returns the same rendering context, so all players created on a canvas share
+ * a single instance of this structure: the cache of WebGL methods, staging buffers and pixel store state.
+ * GL objects created by mpv are still kept in ObjectStores of each player.
+ */
+struct SharedGlContext {
+  shared_ptr<Persistent<Object>> context;
+  map<int, string> props;
+  map<string, shared_ptr<Persistent<Function>>> methods;
+  map<BUF_ROLE, shared_ptr<Persistent<ArrayBuffer>>> backing_bufs;
+  size_t unpack_alignment = 1, pack_alignment = 1;
+  bool pixel_unpack_buffer_bound = false, pixel_pack_buffer_bound = false;
+
+  static shared_ptr<SharedGlContext> forContext(Isolate *i, const Local<Object> &context,
+                                                vector<weak_ptr<SharedGlContext>> &registry);
+};
+
+shared_ptr<SharedGlContext> SharedGlContext::forContext(Isolate *i, const Local<Object> &context,
+                                                        vector<weak_ptr<SharedGlContext>> &registry) {
+  for (auto it = registry.begin(); it != registry.end();) {
+    auto existing = it->lock();
+    if (!existing) {
+      it = registry.erase(it);
+      continue;
+    }
+
+    if (*existing->context == context) {
+      return existing;
+    }
+    ++it;
+  }
+
+  auto created = make_shared<SharedGlContext>();
+  created->context = pers_ptr(new Persistent<Object>(i, context));
+  registry.push_back(created);
+  return created;
+}
+
+/**
+ * A js function observing a property.
+ * If min_interval is set, changes coming faster than once per interval are held natively and delivered later.
+ * Only the most recent value is kept unless latest_only is false, in which case all held values are delivered at once
+ * as an array.
+ * Diff observers receive patches against the previously delivered value, which is kept natively.
+ */
+struct PropertyObserver {
+  uint64_t id = 0;
+  uint64_t registration = 0;
+  bool removed = false;
+  shared_ptr<Persistent<Object>> handler;
+  mpv_format format = MPV_FORMAT_NODE;
+  uint64_t min_interval = 0;
+  bool latest_only = true;
+  uint64_t last_delivery = 0;
+  vector<unique_ptr<AutoMpvNode>> pending;
+  bool diff = false;
+  unique_ptr<AutoMpvNode> snapshot; // the last value delivered to a diff observer
+
+  uint64_t nextDelivery()const { return last_delivery + min_interval; }
+};
+
+/**
+ * A single mpv observation of a property in some format, shared by all js observers of this property in this format.
+ * Registrations are identified by reply_userdata they are observed with, and the identifier is a key in the
+ * registration table of a player. Identifiers are never reused, so late events of an already removed observation
+ * cannot reach a new one, but removed registrations are dropped from the table.
+ */
+struct PropertyRegistration {
+  string name;
+  mpv_format format;
+  vector<shared_ptr<PropertyObserver>> listeners;
+  bool dispatching = false;
+
+  void compact() {
+    listeners.erase(remove_if(listeners.begin(), listeners.end(), [](const shared_ptr<PropertyObserver> &o) {
+      return o->removed;
+    }), listeners.end());
+  }
+};
+
+/**
+ * A copy of an mpv event made on the event thread.
+ * Everything the event refers to is stored in the same allocation right after the record, so event.data points to
+ * memory owned by the record and stays valid after mpv reuses its own event. Property values are always stored as
+ * nodes, and only data of events we actually read is copied.
+ */
+struct QueuedEvent {
+  mpv_event event;
+  union {
+    mpv_event_property property;
+    mpv_event_log_message log_message;
+    mpv_event_end_file end_file;
+  };
+  mpv_node value;
+  double marker = NAN; // for watches, the threshold the value has crossed
+
+  static QueuedEvent *create(const mpv_event *e) {
+    size_t arena_size = 0;
+    mpv_node view;
+
+    if (e->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+      auto pd = static_cast<const mpv_event_property*>(e->data);
+      view = mpv_data_as_node(pd->format, pd->data);
+      arena_size = flat_string_size(pd->name) + flat_node_size(view);
+    } else if (e->event_id == MPV_EVENT_LOG_MESSAGE) {
+      auto msg = static_cast<const mpv_event_log_message*>(e->data);
+      arena_size = flat_string_size(msg->prefix) + flat_string_size(msg->level) + flat_string_size(msg->text);
+    }
+
+    auto qe = new (::operator new(sizeof(QueuedEvent) + arena_size)) QueuedEvent;
+    char *cursor = reinterpret_cast<char*>(qe + 1);
+    qe->event = *e;
+    qe->event.data = nullptr;
+
+    if (e->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+      auto pd = static_cast<const mpv_event_property*>(e->data);
+      qe->property.name = flat_string_copy(pd->name, cursor);
+      if (view.format == MPV_FORMAT_NONE) {
+        qe->property.format = MPV_FORMAT_NONE;
+        qe->property.data = nullptr;
+      } else {
+        flat_node_copy(qe->value, view, cursor);
+        qe->property.format = MPV_FORMAT_NODE;
+        qe->property.data = &qe->value;
+      }
+      qe->event.data = &qe->property;
+    } else if (e->event_id == MPV_EVENT_LOG_MESSAGE) {
+      auto msg = static_cast<const mpv_event_log_message*>(e->data);
+      qe->log_message.prefix = flat_string_copy(msg->prefix, cursor);
+      qe->log_message.level = flat_string_copy(msg->level, cursor);
+      qe->log_message.text = flat_string_copy(msg->text, cursor);
+      qe->log_message.log_level = msg->log_level;
+      qe->event.data = &qe->log_message;
+    } else if (e->event_id == MPV_EVENT_END_FILE) {
+      qe->end_file = *static_cast<const mpv_event_end_file*>(e->data);
+      qe->event.data = &qe->end_file;
+    }
+
+    return qe;
+  }
+
+  static void destroy(QueuedEvent *qe) {
+    qe->~QueuedEvent();
+    ::operator delete(qe);
+  }
+};
+
+typedef unique_ptr<QueuedEvent, void(*)(QueuedEvent*)> QueuedEventPtr;
+
+/**
+ * Properties mirrored into shared memory are observed with reply_userdata having this bit set, the rest of the value
+ * is an index into the mirrored property table. Changes of these properties are handled on the event thread and
+ * never reach the main thread.
+ */
+#define MIRROR_REPLY_FLAG (static_cast<uint64_t>(1) << 63)
+
+/**
+ * A value slot in a shared memory block updated by the event thread.
+ * The first value of each block is a generation counter: it is odd while a value in the block is being written, and
+ * is incremented again after that, so readers can detect torn reads.
+ */
+struct MirroredProperty {
+  volatile double *generation;
+  volatile double *value; // null for slots of removed mirrors
+};
+
+/**
+ * A shared memory block returned by mirrorProperties, with indexes of slots of its properties
+ */
+struct MirrorBuffer {
+  shared_ptr<Persistent<SharedArrayBuffer>> buffer;
+  vector<size_t> slots;
+};
+
+/**
+ * Properties watched for a condition are observed with reply_userdata having this bit set, the rest of the value is
+ * the watch id. Conditions are evaluated on the event thread, and only events for which a condition is met are
+ * queued for the main thread.
+ */
+#define WATCH_REPLY_FLAG (static_cast<uint64_t>(1) << 62)
+
+struct PropertyWatch {
+  enum Kind { CROSSES, BELOW, CHANGED };
+
+  Kind kind;
+  vector<double> markers; // sorted, for CROSSES
+  double threshold = 0; // for BELOW
+  double last = NAN;
+
+  /**
+   * Returns markers the property has passed by changing its value from last to value, in order they have been passed.
+   * For BELOW and CHANGED watches returns a single marker (the threshold or NaN) if the condition is met.
+   */
+  void evaluate(double value, vector<double> &fired) {
+    double prev = last;
+    last = value;
+
+    switch (kind) {
+      case CROSSES:
+        if (isnan(prev) || isnan(value) || prev == value) {
+          break;
+        }
+        if (value > prev) {
+          // markers in (prev, value]
+          for (auto it = upper_bound(markers.begin(), markers.end(), prev); it != markers.end() && *it <= value; ++it) {
+            fired.push_back(*it);
+          }
+        } else {
+          // markers in [value, prev), from the highest one
+          auto end = lower_bound(markers.begin(), markers.end(), prev);
+          for (auto it = end; it != markers.begin() && *(it - 1) >= value; --it) {
+            fired.push_back(*(it - 1));
+          }
+        }
+        break;
+
+      case BELOW:
+        if (value < threshold && !(prev < threshold)) {
+          fired.push_back(threshold);
+        }
+        break;
+
+      case CHANGED:
+        if (!isnan(value) && value != prev) {
+          fired.push_back(NAN);
+        }
+        break;
+    }
+  }
+};
+
+/**
+ * Numeric value of a scalar node, NaN for non-numeric values
+ */
+static double node_number(const mpv_node &node) {
+  switch (node.format) {
+    case MPV_FORMAT_DOUBLE: return node.u.double_;
+    case MPV_FORMAT_INT64: return static_cast<double>(node.u.int64);
+    case MPV_FORMAT_FLAG: return node.u.flag ? 1 : 0;
+    default: return NAN;
+  }
+}
+
+/**
+ * A texture with a framebuffer attached to it, used when mpv should render a frame somewhere off the screen first.
+ */
+struct OffscreenTarget {
+  GLuint fbo = 0;
+  shared_ptr<Persistent<Value>> texture;
+  ctx_dim dim;
+};
+
+/**
+ * An additional output a rendered frame is copied to.
+ * It is either a region of the default framebuffer of the player context or another canvas with a 2d context.
+ */
+struct MirrorTarget {
+  ctx_rect viewport;
+  shared_ptr<Persistent<Object>> canvas;
+  shared_ptr<Persistent<Object>> context;
+  shared_ptr<Persistent<Function>> draw_image;
+};
+
+class MPImpl;
+
+/**
+ * State of a module instance.
+ * The module can be loaded into several contexts (for example, into worker threads), so nothing depending on a context
+ * or an event loop can be static.
+ */
+struct AddonData {
+  Persistent<Function> constructor;
+  uv_loop_t *loop = nullptr;
+  vector<weak_ptr<SharedGlContext>> gl_contexts;
+  vector<MPImpl*> players;
+
+  void removePlayer(MPImpl *impl) {
+    auto it = find(players.begin(), players.end(), impl);
+    if (it != players.end()) {
+      players.erase(it);
+    }
+  }
+};
+
 class MPImpl {
 public:
   MPImpl(Isolate *isolate,
          const shared_ptr<Persistent<Object>> &canvas,
-         const shared_ptr<Persistent<Object>> &renderingContext,
+         const shared_ptr<SharedGlContext> &glContext,
          const PlayerOptions &opts
-  ) : _options(opts), _isolate(isolate), _canvas(canvas), _renderingContext(renderingContext) {
-    _singleton = this;
+  ) : _options(opts), _isolate(isolate), _canvas(canvas), _gl_ctx(glContext) {
+
   }
 
   ~MPImpl() {
@@ -94,1943 +440,3884 @@ public:
     if (_mpv || _mpv_gl) {
       DEBUG("MpvPlayer object is removed by GC, but dispose function has not been called\n");
     }
+
+    stopEventThread();
+    closeAsyncHandles();
   }
 
   void dispose() {
-    if (_mpv) {
-      mpv_terminate_destroy(_mpv);
-    }
     if (_mpv_gl) {
+      // opengl_cb context is owned by mpv core, so it should be uninitialized before the core is destroyed
+      CurrentScope scope(this);
       mpv_opengl_cb_set_update_callback(_mpv_gl, nullptr, nullptr);
       mpv_opengl_cb_uninit_gl(_mpv_gl);
     }
+    stopEventThread();
+    if (_mpv) {
+      mpv_terminate_destroy(_mpv);
+    }
+    resetRenderTarget();
+    releaseOffscreen(_offscreen);
+    _mirrors.clear();
+    closeAsyncHandles();
+    if (_addon) {
+      _addon->removePlayer(this);
+    }
 
-    _singleton = nullptr;
     _mpv = nullptr;
     _mpv_gl = nullptr;
   }
 
-  void handleEvent(const mpv_event *e) {
-    auto it = _options.event_handlers.find(e->event_id);
-    if (it != _options.event_handlers.end()) {
-      if (e->event_id == MPV_EVENT_LOG_MESSAGE) {
-        auto msg = static_cast<const mpv_event_log_message*>(e->data);
-        Local<Value> args[] = { make_string(_isolate, msg->text),
-                                MKI(msg->log_level),
-                                make_string(_isolate, msg->prefix) };
-        it->second->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
-                                                  _isolate->GetCurrentContext()->Global(), 3, args);
-      } else if (e->event_id == MPV_EVENT_END_FILE) {
-        auto end = static_cast<const mpv_event_end_file*>(e->data);
-        Local<Value> args[] = { MKI(end->reason), MKI(end->error) };
-        it->second->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
-                                                  _isolate->GetCurrentContext()->Global(), 2, args);
-      } else {
-        Local<Value> dummy;
-        it->second->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
-                                                  _isolate->GetCurrentContext()->Global(), 0, &dummy);
-      }
+  /**
+   * Called when the environment the player lives in is being torn down without dispose being called.
+   * We cannot call js anymore to release gl resources, so we can only make sure mpv is not going to wake up an event
+   * loop that no longer exists.
+   */
+  void abandon() {
+    if (_mpv_gl) {
+      mpv_opengl_cb_set_update_callback(_mpv_gl, nullptr, nullptr);
     }
-  }
+    stopEventThread();
+    closeAsyncHandles();
+  }
+
+  /**
+   * Starts a thread waiting for mpv events.
+   * The thread copies events into QueuedEvent records and passes them to the main thread, so neither waiting on mpv
+   * event queue nor copying event data happens on the main thread. The main thread is woken with the wakeup handle.
+   */
+  void startEventThread() {
+    _event_thread_stop = false;
+    _event_thread = thread([this]() {
+      while (!_event_thread_stop.load()) {
+        mpv_event *e = mpv_wait_event(_mpv, -1);
+        if (e->event_id == MPV_EVENT_NONE) {
+          continue;
+        }
 
-  void handlePropertyChange(const mpv_event_property *pd) {
-    string prop_name(pd->name);
-    auto range = _observers.equal_range(pd->name);
-    Local<Value> args[] = { pd->data
-                            ? mpv_node_to_v8_value(_isolate, static_cast<const mpv_node*>(pd->data))
-                            : Null(_isolate).As<Value>() };
-    for (auto it = range.first; it != range.second; ++it) {
-      it->second->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
-                                                _isolate->GetCurrentContext()->Global(), 1, args);
-    }
-  }
+        if (e->event_id == MPV_EVENT_PROPERTY_CHANGE && (e->reply_userdata & MIRROR_REPLY_FLAG)) {
+          updateMirroredProperty(e);
+          continue;
+        }
 
-  shared_ptr<Persistent<String>> ctx_width_prop, ctx_height_prop;
-  int64_t last_ctx_dim_update = 0;
+        if (e->event_id == MPV_EVENT_PROPERTY_CHANGE && (e->reply_userdata & WATCH_REPLY_FLAG)) {
+          if (!evaluateWatch(e)) {
+            return;
+          }
+          continue;
+        }
 
-#define SEC_IN_MKS 1000000
+        if (e->event_id == MPV_EVENT_LOG_MESSAGE) {
+          shared_ptr<LogSink> sink;
+          {
+            lock_guard<mutex> lock(_log_sink_lock);
+            sink = _log_sink;
+          }
+          if (sink) {
+            sink->add(static_cast<const mpv_event_log_message*>(e->data));
+            continue;
+          }
+        }
 
-  const ctx_dim &getContextDims() {
-    int64_t cur_time = mpv_get_time_us(_mpv);
-    if (!last_ctx_dim_update || (last_ctx_dim_update + SEC_IN_MKS / 2) < cur_time) {
-      if (!ctx_width_prop) {
-        ctx_width_prop = pers_ptr(new Persistent<String>(_isolate, make_string(_isolate, "drawingBufferWidth")));
-        ctx_height_prop = pers_ptr(new Persistent<String>(_isolate, make_string(_isolate, "drawingBufferHeight")));
+        if (!queueEvent(QueuedEvent::create(e))) {
+          return;
+        }
+
+        if (e->event_id == MPV_EVENT_SHUTDOWN) {
+          break;
+        }
+      }
+    });
+  }
+
+  /**
+   * Passes an event to the main thread. Called on the event thread.
+   * Returns false if the thread has been asked to stop while waiting for space in the queue.
+   */
+  bool queueEvent(QueuedEvent *qe) {
+    while (!_events.push(qe)) {
+      // main thread lags behind, give it time to catch up
+      if (_event_thread_stop.load()) {
+        QueuedEvent::destroy(qe);
+        return false;
+      }
+      uv_async_send(_wakeup_handle);
+      this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    uv_async_send(_wakeup_handle);
+    return true;
+  }
+
+  /**
+   * Called on the event thread.
+   */
+  bool evaluateWatch(const mpv_event *e) {
+    auto pd = static_cast<const mpv_event_property*>(e->data);
+    mpv_node view = mpv_data_as_node(pd->format, pd->data);
+    uint64_t id = e->reply_userdata & ~WATCH_REPLY_FLAG;
+
+    vector<double> fired;
+    {
+      lock_guard<mutex> lock(_watches_lock);
+      auto it = _watches.find(id);
+      if (it == _watches.end()) {
+        return true;
       }
+      it->second.evaluate(node_number(view), fired);
+    }
 
-      Local<Object> rc = localContext();
-      Local<Context> ctx = _isolate->GetCurrentContext();
+    for (double marker : fired) {
+      QueuedEvent *qe = QueuedEvent::create(e);
+      qe->marker = marker;
+      if (!queueEvent(qe)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Starts watching a property for a condition, handler is called on the main thread when the condition is met.
+   * Returns mpv error code.
+   */
+  int addWatch(const string &name, const PropertyWatch &watch, const Local<Function> &handler, uint64_t &id) {
+    id = ++_last_watch_id;
+    _watch_handlers[id] = pers_ptr(new Persistent<Function>(_isolate, handler));
+    {
+      lock_guard<mutex> lock(_watches_lock);
+      _watches[id] = watch;
+    }
 
-      Maybe<int64_t> mw = rc->Get(ctx, ctx_width_prop->Get(_isolate)).ToLocalChecked()->IntegerValue(ctx);
-      Maybe<int64_t> mh = rc->Get(ctx, ctx_height_prop->Get(_isolate)).ToLocalChecked()->IntegerValue(ctx);
+    int err_code = mpv_observe_property(_mpv, WATCH_REPLY_FLAG | id, name.c_str(), MPV_FORMAT_NODE);
+    if (err_code != MPV_ERROR_SUCCESS) {
+      removeWatch(id);
+    }
+    return err_code;
+  }
 
-      if (mw.IsJust() && mh.IsJust()) {
-        _dim.width = static_cast<int>(mw.FromMaybe(0));
-        _dim.height = static_cast<int>(mh.FromMaybe(0));
-      }
+  bool removeWatch(uint64_t id) {
+    if (!_watch_handlers.erase(id)) {
+      return false;
+    }
 
-      last_ctx_dim_update = cur_time;
+    mpv_unobserve_property(_mpv, WATCH_REPLY_FLAG | id);
+    lock_guard<mutex> lock(_watches_lock);
+    _watches.erase(id);
+    return true;
+  }
+
+  void handleWatch(const QueuedEvent *qe) {
+    auto it = _watch_handlers.find(qe->event.reply_userdata & ~WATCH_REPLY_FLAG);
+    if (it == _watch_handlers.end()) {
+      return; // the watch has been removed after the event was queued
     }
 
-    return _dim;
+    auto handler = it->second;
+    Local<Value> args[] = { propertyValue(&qe->property),
+                            isnan(qe->marker) ? Undefined(_isolate).As<Value>() : MKN(qe->marker).As<Value>() };
+    handler->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
+                                           _isolate->GetCurrentContext()->Global(), 2, args);
   }
 
-#undef SEC_IN_MKS
+  /**
+   * Called on the event thread.
+   */
+  void updateMirroredProperty(const mpv_event *e) {
+    auto pd = static_cast<const mpv_event_property*>(e->data);
+    mpv_node view = mpv_data_as_node(pd->format, pd->data);
+    double value = node_number(view);
 
-  shared_ptr<Persistent<Object>> _cmd_accesser;
-  shared_ptr<Persistent<ObjectTemplate>> _cmd_accesser_template;
-  shared_ptr<Persistent<ObjectTemplate>> _prop_accesser_template;
+    lock_guard<mutex> lock(_mirrored_props_lock);
+    size_t index = static_cast<size_t>(e->reply_userdata & ~MIRROR_REPLY_FLAG);
+    if (index >= _mirrored_props.size()) {
+      return;
+    }
 
-  /** GL functions implementation **/
+    MirroredProperty &prop = _mirrored_props[index];
+    if (!prop.value) {
+      return; // the mirror has been removed after the event was sent
+    }
 
-  const GLubyte *glGetString(GLenum name) {
-    GL_DEBUG("glGetString: %d\n", name);
+    *prop.generation = *prop.generation + 1;
+    atomic_thread_fence(memory_order_seq_cst);
+    *prop.value = value;
+    atomic_thread_fence(memory_order_seq_cst);
+    *prop.generation = *prop.generation + 1;
+  }
+
+  /**
+   * Creates a shared memory block kept up to date with values of given properties by the event thread.
+   * Returns an empty handle and sets err_code if mpv refuses to observe some property.
+   */
+  Local<Float64Array> mirrorProperties(const vector<string> &names, int &err_code) {
+    size_t count = names.size() + 1;
+    Local<SharedArrayBuffer> buffer = SharedArrayBuffer::New(_isolate, count * sizeof(double));
+    auto data = static_cast<double*>(buffer->GetContents().Data());
+    data[0] = 0;
+    for (size_t q = 1; q < count; ++q) {
+      data[q] = NAN;
+    }
+    MirrorBuffer mirror;
+    mirror.buffer = pers_ptr(new Persistent<SharedArrayBuffer>(_isolate, buffer));
+
+    err_code = MPV_ERROR_SUCCESS;
+    for (size_t q = 0; q < names.size(); ++q) {
+      uint64_t reply_id;
+      {
+        // the slot should exist before mpv sends the first change
+        lock_guard<mutex> lock(_mirrored_props_lock);
+        reply_id = MIRROR_REPLY_FLAG | _mirrored_props.size();
+        mirror.slots.push_back(_mirrored_props.size());
+        _mirrored_props.push_back({ data, data + q + 1 });
+      }
 
-    // check if we have already cached this property
-    auto props_iter = gl_props.find(name);
-    if (props_iter != gl_props.end()) {
-      return reinterpret_cast<const GLubyte*>(props_iter->second.c_str());
+      err_code = mpv_observe_property(_mpv, reply_id, names[q].c_str(), MPV_FORMAT_NODE);
+      if (err_code != MPV_ERROR_SUCCESS) {
+        // the buffer is never returned, so stop updating it
+        mirror.slots.pop_back();
+        releaseMirror(mirror);
+        return Local<Float64Array>();
+      }
     }
 
-    string result;
-    switch (name) {
-      case GL_VERSION:
-        // fake opengl version as mpv fails to understand the real one
-        result = "OpenGL ES 2.0 Chromium";
-        break;
+    _mirror_buffers.push_back(mirror);
+    return Float64Array::New(buffer, 0, count);
+  }
 
-      case GL_SHADING_LANGUAGE_VERSION:
-        result = "OpenGL ES GLSL ES 1.0 Chromium";
-        break;
+  /**
+   * Stops updating a shared memory block returned by mirrorProperties.
+   * Returns false if the given buffer is not an active mirror.
+   */
+  bool unmirrorProperties(const Local<Value> &buffer) {
+    for (auto it = _mirror_buffers.begin(); it != _mirror_buffers.end(); ++it) {
+      if (it->buffer->Get(_isolate)->StrictEquals(buffer)) {
+        releaseMirror(*it);
+        _mirror_buffers.erase(it);
+        return true;
+      }
+    }
+    return false;
+  }
 
-      case GL_EXTENSIONS:
-        result = "GL_ARB_framebuffer_object";
-        break;
+  void releaseMirror(const MirrorBuffer &mirror) {
+    for (size_t slot : mirror.slots) {
+      mpv_unobserve_property(_mpv, MIRROR_REPLY_FLAG | slot);
+    }
 
-      default:
-        result = string_to_cc(callMethod("getParameter", MKN(name)));
+    // changes already sent by mpv can still be handled, so slots are cleared under the lock. Slots are not reused,
+    // as reply ids of removed observations can still be in the event queue of mpv
+    lock_guard<mutex> lock(_mirrored_props_lock);
+    for (size_t slot : mirror.slots) {
+      _mirrored_props[slot] = { nullptr, nullptr };
     }
+  }
 
-    if (!result.empty()) {
-      gl_props[name] = result;
-      return reinterpret_cast<const GLubyte*>(gl_props[name].c_str());
-    } else {
-      return nullptr;
+  /**
+   * Stops the event thread and drops events it has queued. Should be called before mpv handle is destroyed.
+   */
+  void stopEventThread() {
+    if (_event_thread.joinable()) {
+      _event_thread_stop = true;
+      mpv_wakeup(_mpv);
+      _event_thread.join();
+    }
+
+    QueuedEvent *qe;
+    while (_events.pop(qe)) {
+      QueuedEvent::destroy(qe);
     }
   }
 
-  void glActiveTexture(GLenum texture) {
-    GL_DEBUG("glActiveTexture\n");
+  /**
+   * mpv calls gl functions only from inside of opengl_cb api functions, and these are always called on the main thread.
+   * So gl wrappers can find out which player they should forward a call to from a pointer we set for the duration of
+   * such a call.
+   */
+  class CurrentScope {
+  public:
+    explicit CurrentScope(MPImpl *impl) : _prev(_current) { _current = impl; }
+    ~CurrentScope() { _current = _prev; }
 
-    callMethod("activeTexture", MKI(texture));
+  private:
+    MPImpl *_prev;
+
+    CurrentScope(const CurrentScope &); // disable copying
+  };
+
+  static MPImpl *current() {
+    return _current;
   }
 
-  GLuint glCreateProgram() {
-    GL_DEBUG("glCreateProgram\n");
+  void initAsyncHandles(uv_async_cb update_cb, uv_async_cb wakeup_cb) {
+    _update_handle = new uv_async_t;
+    _update_handle->data = this;
+    uv_async_init(_loop, _update_handle, update_cb);
 
-    return storeObject(_programs, callMethod("createProgram"));
+    _wakeup_handle = new uv_async_t;
+    _wakeup_handle->data = this;
+    uv_async_init(_loop, _wakeup_handle, wakeup_cb);
+
+    _flush_timer = new uv_timer_t;
+    _flush_timer->data = this;
+    uv_timer_init(_loop, _flush_timer);
   }
 
-  void glDeleteProgram(GLuint program_id) {
-    GL_DEBUG("glDeleteProgram\n");
+  void closeAsyncHandles() {
+    uv_async_t *handles[] = { _update_handle, _wakeup_handle };
+    for (auto handle : handles) {
+      if (handle) {
+        handle->data = nullptr;
+        uv_close(reinterpret_cast<uv_handle_t*>(handle), [](uv_handle_t *h) {
+          delete reinterpret_cast<uv_async_t*>(h);
+        });
+      }
+    }
+    _update_handle = _wakeup_handle = nullptr;
+
+    uv_timer_t *timers[] = { _flush_timer, _log_timer };
+    for (auto timer : timers) {
+      if (timer) {
+        timer->data = nullptr;
+        uv_close(reinterpret_cast<uv_handle_t*>(timer), [](uv_handle_t *h) {
+          delete reinterpret_cast<uv_timer_t*>(h);
+        });
+      }
+    }
+    _flush_timer = _log_timer = nullptr;
+  }
 
-    auto prog_iter = _programs.find(program_id);
-    if (prog_iter == _programs.end()) {
-      // ignore silently
+  void handleEvent(const mpv_event *e) {
+    auto handler_it = _options.event_handlers.find(e->event_id);
+    auto listeners_it = _event_listeners.find(e->event_id);
+    bool has_handler = handler_it != _options.event_handlers.end();
+    bool has_listeners = listeners_it != _event_listeners.end();
+    if (!has_handler && !has_listeners) {
       return;
     }
 
-    callMethod("deleteProgram", prog_iter->second->Get(_isolate));
-  }
+    Local<Value> args[3];
+    int arg_count = 0;
+    if (e->event_id == MPV_EVENT_LOG_MESSAGE) {
+      auto msg = static_cast<const mpv_event_log_message*>(e->data);
+      args[0] = mpv_string_to_v8(_isolate, msg->text);
+      args[1] = MKI(msg->log_level);
+      args[2] = make_string(_isolate, msg->prefix);
+      arg_count = 3;
+    } else if (e->event_id == MPV_EVENT_END_FILE) {
+      auto end = static_cast<const mpv_event_end_file*>(e->data);
+      args[0] = MKI(end->reason);
+      args[1] = MKI(end->error);
+      arg_count = 2;
+    }
 
-  void glGetProgramInfoLog(GLuint program_id, GLsizei max_length, GLsizei *length, GLchar *info_log) {
-    GL_DEBUG("glGetProgramInfoLog\n");
+    if (has_handler) {
+      handler_it->second->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
+                                                        _isolate->GetCurrentContext()->Global(), arg_count, args);
+    }
 
-    getObjectInfoLog("getProgramInfoLog", _programs, program_id, max_length, length, info_log);
+    if (has_listeners) {
+      // listener lists are never modified in place, so a listener can call on or off safely
+      auto listeners = listeners_it->second;
+      for (auto &listener : *listeners) {
+        listener->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
+                                                _isolate->GetCurrentContext()->Global(), arg_count, args);
+      }
+    }
   }
 
-  void glGetProgramiv(GLuint program_id, GLenum pname, GLint *params) {
-    GL_DEBUG("glGetProgramiv\n");
+  typedef vector<shared_ptr<Persistent<Function>>> ListenerList;
 
-    getObjectiv("getProgramParameter", _programs, program_id, pname, params);
+  void addEventListener(mpv_event_id event, const Local<Function> &listener) {
+    auto &listeners = _event_listeners[event];
+    auto updated = listeners ? make_shared<ListenerList>(*listeners) : make_shared<ListenerList>();
+    updated->push_back(pers_ptr(new Persistent<Function>(_isolate, listener)));
+    listeners = updated;
+    updateEventRequest(event);
   }
 
-  void glUseProgram(GLuint program_id) {
-    GL_DEBUG("glUseProgram\n");
+  bool removeEventListener(mpv_event_id event, const Local<Function> &listener) {
+    auto it = _event_listeners.find(event);
+    if (it == _event_listeners.end()) {
+      return false;
+    }
 
-    auto prog_iter = _programs.find(program_id);
-    if (prog_iter == _programs.end()) {
-      // set GL_INVALID_VALUE
-      return;
+    auto updated = make_shared<ListenerList>(*it->second);
+    auto found = find_if(updated->begin(), updated->end(), [this, &listener](const shared_ptr<Persistent<Function>> &p) {
+      return p->Get(_isolate)->StrictEquals(listener);
+    });
+    if (found == updated->end()) {
+      return false;
     }
 
-    callMethod("useProgram", prog_iter->second->Get(_isolate));
+    updated->erase(found);
+    if (updated->empty()) {
+      _event_listeners.erase(it);
+    } else {
+      it->second = updated;
+    }
+    updateEventRequest(event);
+    return true;
+  }
+
+  /**
+   * Deprecated events, MPV_EVENT_TICK among them, which is sent for every frame. They are numbered as in client.h,
+   * since newer headers hide them without MPV_ENABLE_DEPRECATED.
+   */
+  static bool isDeprecatedEvent(mpv_event_id event) {
+    switch (static_cast<int>(event)) {
+      case 9:  // MPV_EVENT_TRACKS_CHANGED
+      case 10: // MPV_EVENT_TRACK_SWITCHED
+      case 12: // MPV_EVENT_PAUSE
+      case 13: // MPV_EVENT_UNPAUSE
+      case 14: // MPV_EVENT_TICK
+      case 15: // MPV_EVENT_SCRIPT_INPUT_DISPATCH
+      case 19: // MPV_EVENT_METADATA_UPDATE
+      case 23: // MPV_EVENT_CHAPTER_CHANGE
+        return true;
+
+      default:
+        return false;
+    }
   }
 
-  void glLinkProgram(GLuint program_id) {
-    GL_DEBUG("glLinkProgram\n");
+  bool eventWanted(mpv_event_id event)const {
+    // the batch handler gets deprecated events only if they are requested by a handler or a listener
+    return event == MPV_EVENT_PROPERTY_CHANGE || (_options.batch_handler && !isDeprecatedEvent(event))
+           || _options.event_handlers.count(event) || _event_listeners.count(event)
+           || (event == MPV_EVENT_LOG_MESSAGE && _log_sink);
+  }
 
-    auto prog_iter = _programs.find(program_id);
-    if (prog_iter == _programs.end()) {
-      // set GL_INVALID_VALUE
-      return;
+  /**
+   * Routes log messages into a native buffer instead of js handlers, or back to handlers if sink is empty.
+   * If handler is set, buffered messages are delivered to it every deliver_interval milliseconds.
+   */
+  void setLogSink(const shared_ptr<LogSink> &sink, const Local<Function> &handler, uint64_t deliver_interval) {
+    {
+      lock_guard<mutex> lock(_log_sink_lock);
+      _log_sink = sink;
     }
 
-    callMethod("linkProgram", prog_iter->second->Get(_isolate));
-  }
+    if (sink) {
+      mpv_request_log_messages(_mpv, LogSink::levelName(sink->requestLevel()));
+    } else {
+      mpv_request_log_messages(_mpv, _options.log_level.empty() ? "warn" : _options.log_level.c_str());
+    }
+    updateEventRequest(MPV_EVENT_LOG_MESSAGE);
 
-  GLuint glCreateShader(GLenum shader_type) {
-    GL_DEBUG("glCreateShader\n");
+    if (_log_timer) {
+      uv_timer_stop(_log_timer);
+    }
+    _log_handler.reset();
+
+    if (sink && !handler.IsEmpty() && deliver_interval) {
+      _log_handler = pers_ptr(new Persistent<Function>(_isolate, handler));
+      if (!_log_timer) {
+        _log_timer = new uv_timer_t;
+        _log_timer->data = this;
+        uv_timer_init(_loop, _log_timer);
+      }
 
-    return storeObject(_shaders, callMethod("createShader", Number::New(_isolate, shader_type)));
+      uv_timer_start(_log_timer, [](uv_timer_t *handle) {
+        auto impl = static_cast<MPImpl*>(handle->data);
+        if (impl) {
+          HandleScope scope(impl->_isolate);
+          impl->deliverLogs();
+        }
+      }, deliver_interval, deliver_interval);
+    }
   }
 
-  void glDeleteShader(GLuint shader_id) {
-    GL_DEBUG("glDeleteShader\n");
-
-    auto sh_iter = _shaders.find(shader_id);
-    if (sh_iter == _shaders.end()) {
-      // ignore silently
-      return;
+  Local<Array> drainLogs() {
+    vector<LogRecord> records;
+    if (_log_sink) {
+      _log_sink->drain(records);
     }
 
-    callMethod("deleteShader", sh_iter->second->Get(_isolate));
+    Local<Context> ctx = _isolate->GetCurrentContext();
+    Local<Array> result = Array::New(_isolate, static_cast<int>(records.size()));
+    for (size_t q = 0; q < records.size(); ++q) {
+      Local<Object> record = Object::New(_isolate);
+      record->Set(ctx, eventKey(EK_TEXT), mpv_string_to_v8(_isolate, records[q].text.data(), records[q].text.size()));
+      record->Set(ctx, eventKey(EK_LEVEL), MKI(records[q].level));
+      record->Set(ctx, eventKey(EK_PREFIX), make_string(_isolate, records[q].prefix));
+      result->Set(ctx, static_cast<uint32_t>(q), record);
+    }
+    return result;
   }
 
-  void glAttachShader(GLuint program_id, GLuint shader_id) {
-    GL_DEBUG("glAttachShader\n");
-
-    auto prog_iter = _programs.find(program_id);
-    if (prog_iter == _programs.end()) {
-      // set GL_INVALID_VALUE
-      return;
+  void deliverLogs() {
+    Local<Array> records = drainLogs();
+    if (_log_handler && records->Length()) {
+      Local<Value> args[] = { records };
+      _log_handler->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
+                                                  _isolate->GetCurrentContext()->Global(), 1, args);
     }
+  }
 
-    auto sh_iter = _shaders.find(shader_id);
-    if (sh_iter == _shaders.end()) {
-      // set GL_INVALID_VALUE
+  /**
+   * Makes mpv generate an event only if something is going to receive it, so events nobody listens to do not wake the
+   * event thread at all. mpv is asked only when the state should change.
+   */
+  void updateEventRequest(mpv_event_id event, bool force = false) {
+    if (!_mpv || event <= MPV_EVENT_SHUTDOWN || event >= 64) {
       return;
     }
 
-    Local<Value> args[2] = { prog_iter->second->Get(_isolate), sh_iter->second->Get(_isolate) };
-    callMethod("attachShader", ARG_COUNT, args);
+    uint64_t bit = static_cast<uint64_t>(1) << event;
+    bool wanted = eventWanted(event);
+    if (force || wanted != ((_requested_events & bit) != 0)) {
+      if (mpv_request_event(_mpv, event, wanted) >= 0) {
+        _requested_events = wanted ? (_requested_events | bit) : (_requested_events & ~bit);
+      }
+    }
   }
 
-  void glCompileShader(GLuint shader_id) {
-    GL_DEBUG("glCompileShader\n");
+  Local<Value> propertyValue(const mpv_event_property *pd) {
+    mpv_node view = mpv_data_as_node(pd->format, pd->data);
+    return mpv_node_to_v8_value(_isolate, &view);
+  }
 
-    auto sh_iter = _shaders.find(shader_id);
-    if (sh_iter == _shaders.end()) {
-      // set GL_INVALID_VALUE
+  /**
+   * Calls observers of the changed property.
+   * The registration is found by reply_userdata of the event, no name lookup is done.
+   * The value is converted to js only when some observer needs it right now, the converted value is returned via value
+   * argument so the caller can reuse it.
+   */
+  void handlePropertyChange(const mpv_event *e, Local<Value> &value) {
+    auto reg = registration(e->reply_userdata);
+    if (!reg) {
       return;
     }
 
-    callMethod("compileShader", sh_iter->second->Get(_isolate));
-  }
+    auto pd = static_cast<const mpv_event_property*>(e->data);
+    uint64_t now = uv_now(_loop);
 
-  void glShaderSource(GLuint shader_id, GLsizei count, const GLchar **string, const GLint *length) {
-    GL_DEBUG("glShaderSource\n");
+    // observers can be added or removed by handlers we call, so do not hold references into the listener list
+    reg->dispatching = true;
+    for (size_t q = 0; q < reg->listeners.size(); ++q) {
+      auto observer = reg->listeners[q];
+      if (observer->removed) {
+        continue;
+      }
 
-    auto sh_iter = _shaders.find(shader_id);
-    if (sh_iter == _shaders.end() || count < 0) {
-      // set GL_INVALID_VALUE
-      return;
-    }
+      // values held for an observer go first, so a change never overtakes them
+      if (observer->pending.empty() && observer->nextDelivery() <= now) {
+        observer->last_delivery = now;
 
-    if (count == 0) {
-      return;
-    }
+        if (observer->diff) {
+          deliverDiff(*observer, mpv_data_as_node(pd->format, pd->data));
+          continue;
+        }
 
-    if (count > 1) {
-      _throw_js("glShaderSource: Multiple GLSL shader files are not supported");
-      return;
-    }
+        if (value.IsEmpty()) {
+          value = propertyValue(pd);
+        }
 
-    Local<String> shader_source;
-    if (length) {
-      shader_source = String::NewFromUtf8(_isolate, string[0], NewStringType::kNormal, length[0]).ToLocalChecked();
-    } else {
-      shader_source = make_string(_isolate, string[0]);
+        Local<Value> args[] = { observer->latest_only ? value : arrayOf(value).As<Value>() };
+        observer->handler->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
+                                                         _isolate->GetCurrentContext()->Global(), 1, args);
+      } else {
+        if (observer->latest_only) {
+          observer->pending.clear();
+        }
+
+        observer->pending.emplace_back(new AutoMpvNode(mpv_data_as_node(pd->format, pd->data)));
+        scheduleFlush(observer->nextDelivery());
+      }
     }
+    reg->dispatching = false;
 
-    Local<Value> args[2] = { sh_iter->second->Get(_isolate), shader_source };
-    callMethod("shaderSource", ARG_COUNT, args);
+    releaseRemovedObservers(reg);
   }
 
-  void glBindAttribLocation(GLuint program_id, GLuint index, const GLchar *name) {
-    GL_DEBUG("glBindAttribLocation\n");
+  /**
+   * Sends a diff observer the patch from the last delivered value to the given one, if there is any difference.
+   */
+  void deliverDiff(PropertyObserver &observer, const mpv_node &node) {
+    Local<Value> patch = mpv_node_diff_to_v8_value(_isolate, observer.snapshot ? &observer.snapshot->node() : nullptr,
+                                                   node);
+    observer.snapshot.reset(new AutoMpvNode(node));
 
-    auto prog_iter = _programs.find(program_id);
-    if (prog_iter == _programs.end()) {
-      // set GL_INVALID_VALUE
-      return;
+    if (!patch.IsEmpty()) {
+      Local<Value> args[] = { patch };
+      observer.handler->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
+                                                      _isolate->GetCurrentContext()->Global(), 1, args);
     }
+  }
 
-    Local<Value> args[3] = { prog_iter->second->Get(_isolate), MKI(index), make_string(_isolate, name) };
-    callMethod("bindAttribLocation", ARG_COUNT, args);
+  /**
+   * The value last delivered to a diff observer, or an empty handle if there is no such observer.
+   */
+  Local<Value> observerSnapshot(uint64_t id) {
+    auto it = _observers.find(id);
+    if (it == _observers.end() || !it->second->diff) {
+      return Local<Value>();
+    }
+
+    auto &snapshot = it->second->snapshot;
+    return snapshot ? mpv_node_to_v8_value(_isolate, &snapshot->node()) : Null(_isolate).As<Value>();
   }
 
-  void glBindBuffer(GLenum target, GLuint buffer) {
-    GL_DEBUG("glBindBuffer\n");
+  shared_ptr<PropertyRegistration> registration(uint64_t id)const {
+    auto it = _registrations.find(id);
+    return it == _registrations.end() ? nullptr : it->second;
+  }
 
-    if (target == GL_PIXEL_UNPACK_BUFFER) {
-      GL_DEBUG("binding/unbinding a buffer to GL_PIXEL_UNPACK_BUFFER");
-      pixel_unpack_buffer_bound = buffer != 0;
-    } else if (target == GL_PIXEL_PACK_BUFFER) {
-      GL_DEBUG("binding/unbinding a buffer to GL_PIXEL_PACK_BUFFER");
-      pixel_pack_buffer_bound = buffer != 0;
+  /**
+   * Adds an observer, sharing an existing mpv observation of the same property in the same format if there is one.
+   * Returns mpv error code.
+   */
+  int addObserver(const string &name, const shared_ptr<PropertyObserver> &observer) {
+    shared_ptr<PropertyRegistration> reg;
+    for (auto &existing : _registrations) {
+      if (existing.second->format == observer->format && existing.second->name == name) {
+        reg = existing.second;
+        observer->registration = existing.first;
+        break;
+      }
     }
 
-    if (buffer == 0) {
-      Local<Value> args[2] = { MKI(target), Null(_isolate) };
-      callMethod("bindBuffer", ARG_COUNT, args);
-      return;
-    }
+    if (!reg) {
+      // reply_userdata 0 is used by requests not related to observers, so identifiers start from 1
+      uint64_t reg_id = _last_registration_id + 1;
+      int err_code = mpv_observe_property(_mpv, reg_id, name.c_str(), observer->format);
+      if (err_code != MPV_ERROR_SUCCESS) {
+        return err_code;
+      }
 
-    auto buffer_iter = _buffers.find(buffer);
-    if (buffer_iter == _buffers.end()) {
-      // set GL_INVALID_VALUE
-      return;
+      reg = make_shared<PropertyRegistration>();
+      reg->name = name;
+      reg->format = observer->format;
+      _registrations[reg_id] = reg;
+      _last_registration_id = reg_id;
+      observer->registration = reg_id;
     }
 
-    Local<Value> args[2] = { MKI(target), buffer_iter->second->Get(_isolate) };
-    callMethod("bindBuffer", ARG_COUNT, args);
-  }
-
-  void glBindTexture(GLenum target, GLuint texture) {
-    GL_DEBUG("glBindTexture\n");
+    observer->id = ++_last_observer_id;
+    reg->listeners.push_back(observer);
+    _observers[observer->id] = observer;
 
-    if (texture == 0) {
-      Local<Value> args[2] = { MKI(target), Null(_isolate) };
-      callMethod("bindTexture", ARG_COUNT, args);
-      return;
+    if (reg->listeners.size() > 1) {
+      // mpv sends the current value only when a property is observed, so an observer joining an existing registration
+      // gets it from here. The value is delivered later, like the one mpv sends, not from inside observeProperty
+      queueCurrentValue(*reg, *observer);
+    }
+    return MPV_ERROR_SUCCESS;
+  }
+
+  void queueCurrentValue(const PropertyRegistration &reg, PropertyObserver &observer) {
+    union {
+      char *string;
+      int flag;
+      int64_t int64;
+      double double_;
+      mpv_node node;
+    } data;
+
+    mpv_node value;
+    int err_code = mpv_get_property(_mpv, reg.name.c_str(), reg.format, &data);
+    if (err_code == MPV_ERROR_SUCCESS) {
+      value = mpv_data_as_node(reg.format, &data);
+    } else {
+      // the same mpv reports for unavailable properties
+      value.format = MPV_FORMAT_NONE;
     }
 
-    auto texture_iter = _textures.find(texture);
-    if (texture_iter == _textures.end()) {
-      // set GL_INVALID_VALUE
-      return;
+    observer.pending.emplace_back(new AutoMpvNode(value));
+
+    if (err_code == MPV_ERROR_SUCCESS) {
+      if (reg.format == MPV_FORMAT_STRING) {
+        mpv_free(data.string);
+      } else if (reg.format == MPV_FORMAT_NODE) {
+        mpv_free_node_contents(&data.node);
+      }
     }
 
-    Local<Value> args[2] = { MKI(target), texture_iter->second->Get(_isolate) };
-    callMethod("bindTexture", ARG_COUNT, args);
+    scheduleFlush(observer.nextDelivery());
   }
 
-  void glBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAplha, GLenum dstAplha) {
-    GL_DEBUG("glBlendFuncSeparate\n");
+  bool removeObserver(uint64_t id) {
+    auto it = _observers.find(id);
+    if (it == _observers.end()) {
+      return false;
+    }
 
-    Local<Value> args[4] = { MKI(srcRGB), MKI(dstRGB), MKI(srcAplha), MKI(dstAplha) };
-    callMethod("blendFuncSeparate", ARG_COUNT, args);
-  }
+    auto observer = it->second;
+    _observers.erase(it);
+    observer->removed = true;
+    observer->pending.clear();
 
-  void glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) {
-    GL_DEBUG("glBufferData\n");
+    auto reg = registration(observer->registration);
+    if (reg) {
+      releaseRemovedObservers(reg);
+    }
+    return true;
+  }
 
-    if (size < 0) {
-      // set GL_INVALID_VALUE
+  /**
+   * Drops observers marked as removed from a registration, and stops observing the property in mpv when there are
+   * no observers left. Does nothing while observers of the registration are being called.
+   */
+  void releaseRemovedObservers(const shared_ptr<PropertyRegistration> &reg) {
+    if (reg->dispatching) {
       return;
     }
 
-    if (!data) {
-      Local<Value> args[3] = { MKI(target),
-                               Integer::NewFromUnsigned(_isolate, static_cast<uint32_t>(size)),
-                               MKI(usage) };
-      callMethod("bufferData", ARG_COUNT, args);
-    } else {
-      auto buf = backingBuffer(static_cast<size_t>(size), BB_BUFFER);
-      memcpy(buf->GetContents().Data(), data, static_cast<size_t>(size));
-
-      Local<Value> args[3] = { MKI(target), buf, MKI(usage) };
-      callMethod("bufferData", ARG_COUNT, args);
+    reg->compact();
+    if (reg->listeners.empty()) {
+      for (auto it = _registrations.begin(); it != _registrations.end(); ++it) {
+        if (it->second == reg) {
+          mpv_unobserve_property(_mpv, it->first);
+          _registrations.erase(it);
+          break;
+        }
+      }
     }
   }
 
-  void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) {
-    GL_DEBUG("glBufferSubData\n");
+  Local<Array> arrayOf(const Local<Value> &value) {
+    Local<Array> arr = Array::New(_isolate, 1);
+    arr->Set(_isolate->GetCurrentContext(), 0, value);
+    return arr;
+  }
 
-    if (size < 0) {
-      // set GL_INVALID_VALUE
+  void scheduleFlush(uint64_t at) {
+    if (!_flush_timer) {
       return;
     }
 
-    if (size == 0) {
+    uint64_t now = uv_now(_loop);
+    if (uv_is_active(reinterpret_cast<uv_handle_t*>(_flush_timer)) && _flush_at <= at) {
       return;
     }
 
-    auto buf = backingBuffer(static_cast<size_t>(size), BB_BUFFER);
-    memcpy(buf->GetContents().Data(), data, static_cast<size_t>(size));
-
-    Local<Value> args[3] = { MKI(target),
-                             Integer::NewFromUnsigned(_isolate, static_cast<uint32_t>(offset)),
-                             buf };
-    callMethod("bufferSubData", ARG_COUNT, args);
+    _flush_at = at;
+    uv_timer_start(_flush_timer, [](uv_timer_t *handle) {
+      auto impl = static_cast<MPImpl*>(handle->data);
+      if (impl) {
+        HandleScope scope(impl->_isolate);
+        impl->flushObservers();
+      }
+    }, at > now ? at - now : 0, 0);
   }
 
-  void glClear(GLbitfield mask) {
-    GL_DEBUG("glClear\n");
+  /**
+   * Delivers values held for rate-limited observers whose interval has elapsed.
+   */
+  void flushObservers() {
+    uint64_t now = uv_now(_loop);
+    uint64_t next_flush = 0;
 
-    callMethod("clear", MKI(mask));
-  }
+    // handlers we call can remove observers, so collect due observers first
+    vector<shared_ptr<PropertyObserver>> due;
+    for (auto &item : _observers) {
+      PropertyObserver &observer = *item.second;
+      if (observer.pending.empty()) {
+        continue;
+      }
 
-  void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
-    GL_DEBUG("glClearColor\n");
+      if (observer.nextDelivery() > now) {
+        if (!next_flush || observer.nextDelivery() < next_flush) {
+          next_flush = observer.nextDelivery();
+        }
+        continue;
+      }
 
-    Local<Value> args[] = { MKN(red), MKN(green), MKN(blue), MKN(alpha) };
-    callMethod("clearColor", ARG_COUNT, args);
-  }
+      due.push_back(item.second);
+    }
 
-  void glDeleteBuffers(GLsizei n, const GLuint *buffers) {
-    GL_DEBUG("glDeleteBuffers\n");
+    for (auto &due_observer : due) {
+      PropertyObserver &observer = *due_observer;
+      if (observer.removed || observer.pending.empty()) {
+        continue;
+      }
 
-    deleteObjects("deleteBuffer", _buffers, n, buffers);
-  }
+      if (observer.diff) {
+        unique_ptr<AutoMpvNode> latest = move(observer.pending.back());
+        observer.pending.clear();
+        observer.last_delivery = now;
+        deliverDiff(observer, latest->node());
+        continue;
+      }
 
-  void glDeleteTextures(GLsizei n, const GLuint *textures) {
-    GL_DEBUG("glDeleteTextures\n");
+      Local<Value> arg;
+      if (observer.latest_only) {
+        arg = mpv_node_to_v8_value(_isolate, &observer.pending.back()->node());
+      } else {
+        Local<Array> values = Array::New(_isolate, static_cast<int>(observer.pending.size()));
+        for (size_t q = 0; q < observer.pending.size(); ++q) {
+          values->Set(_isolate->GetCurrentContext(), static_cast<uint32_t>(q),
+                      mpv_node_to_v8_value(_isolate, &observer.pending[q]->node()));
+        }
+        arg = values;
+      }
 
-    deleteObjects("deleteTexture", _textures, n, textures);
-  }
+      observer.pending.clear();
+      observer.last_delivery = now;
 
-  void glEnable(GLenum cap) {
-    GL_DEBUG("glEnable\n");
+      Local<Value> args[] = { arg };
+      observer.handler->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
+                                                      _isolate->GetCurrentContext()->Global(), 1, args);
+    }
 
-    callMethod("enable", MKI(cap));
+    if (next_flush) {
+      scheduleFlush(next_flush);
+    }
   }
 
-  void glDisable(GLenum cap) {
-    GL_DEBUG("glDisable\n");
+  /**
+   * Processes all events the event thread has queued for us.
+   * If there is a handler for batched events, all events processed by a single call are delivered to it as an array
+   * of records, in addition to calling handlers for individual events.
+   */
+  void pumpEvents() {
+    Local<Array> batch;
+    uint32_t batch_size = 0;
+    if (_options.batch_handler) {
+      batch = Array::New(_isolate);
+    }
 
-    callMethod("disable", MKI(cap));
-  }
+    // a frame waiting to be drawn is more important than any event
+    renderIfPending();
 
-  void glDisableVertexAttribArray(GLuint index) {
-    GL_DEBUG("glDisableVertexAttribArray\n");
+    uint64_t deadline = _options.event_budget_ms > 0
+                        ? uv_hrtime() + static_cast<uint64_t>(_options.event_budget_ms * 1000000)
+                        : 0;
+    uint32_t processed = 0;
+    bool out_of_budget = false;
 
-    callMethod("disableVertexAttribArray", MKI(index));
-  }
+    QueuedEvent *queued;
+    while (!out_of_budget && _events.pop(queued)) {
+      QueuedEventPtr holder(queued, QueuedEvent::destroy);
+      const mpv_event *event = &queued->event;
 
-  void glEnableVertexAttribArray(GLuint index) {
-    GL_DEBUG("glEnableVertexAttribArray\n");
+      renderIfPending();
 
-    callMethod("enableVertexAttribArray", MKI(index));
-  }
+      ++processed;
+      out_of_budget = (_options.event_budget_count && processed >= _options.event_budget_count)
+                      || (deadline && uv_hrtime() >= deadline);
 
-  void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
-    GL_DEBUG("glDrawArrays\n");
+      if (event->event_id == MPV_EVENT_SHUTDOWN) {
+        continue;
+      }
 
-    Local<Value> args[3] = { MKI(mode), MKI(first), MKI(count) };
-    callMethod("drawArrays", ARG_COUNT, args);
-  }
+      if (event->event_id == MPV_EVENT_PROPERTY_CHANGE && (event->reply_userdata & WATCH_REPLY_FLAG)) {
+        handleWatch(queued);
+        continue;
+      }
 
-  void glFinish() {
-    GL_DEBUG("glFinish\n");
+      Local<Value> value;
+      if (event->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+        auto pd = static_cast<const mpv_event_property*>(event->data);
+        handlePropertyChange(event, value);
+        if (!batch.IsEmpty() && value.IsEmpty()) {
+          value = propertyValue(pd);
+        }
+      } else {
+        handleEvent(event);
+      }
 
-    callMethod("finish");
-  }
+      if (!batch.IsEmpty()) {
+        batch->Set(_isolate->GetCurrentContext(), batch_size++, eventRecord(event, value));
+      }
+    }
 
-  void glFlush() {
-    GL_DEBUG("glFlush\n");
+    if (batch_size) {
+      Local<Value> args[] = { batch };
+      _options.batch_handler->Get(_isolate)->CallAsFunction(_isolate->GetCurrentContext(),
+                                                            _isolate->GetCurrentContext()->Global(), 1, args);
+    }
 
-    callMethod("flush");
+    // let the loop run other callbacks, the rest of events is going to be processed on the next iteration
+    if (out_of_budget && _wakeup_handle) {
+      uv_async_send(_wakeup_handle);
+    }
   }
 
-  void glGenBuffers(GLsizei n, GLuint *buffers) {
-    GL_DEBUG("glGenBuffers\n");
+  /**
+   * Draws a frame if mpv has asked for it and the frame has not been drawn yet.
+   */
+  void renderIfPending() {
+    if (_render_pending.exchange(false) && gl()) {
+      GL_DEBUG("mpv_opengl_cb_draw: drawing a frame...\n");
 
-    if (!buffers || n == 0) {
-      return;
+      CurrentScope current(this);
+      render();
     }
+  }
 
-    if (n < 0) {
-      // set GL_INVALID_VALUE
-      return;
+  Local<Object> eventRecord(const mpv_event *e, const Local<Value> &value) {
+    Local<Context> ctx = _isolate->GetCurrentContext();
+    Local<Object> record = Object::New(_isolate);
+
+    record->Set(ctx, eventKey(EK_EVENT), MKI(e->event_id));
+
+    if (e->event_id == MPV_EVENT_PROPERTY_CHANGE) {
+      auto pd = static_cast<const mpv_event_property*>(e->data);
+      record->Set(ctx, eventKey(EK_NAME), make_string(_isolate, pd->name));
+      record->Set(ctx, eventKey(EK_VALUE), value);
+    } else if (e->event_id == MPV_EVENT_LOG_MESSAGE) {
+      auto msg = static_cast<const mpv_event_log_message*>(e->data);
+      record->Set(ctx, eventKey(EK_TEXT), mpv_string_to_v8(_isolate, msg->text));
+      record->Set(ctx, eventKey(EK_LEVEL), MKI(msg->log_level));
+      record->Set(ctx, eventKey(EK_PREFIX), make_string(_isolate, msg->prefix));
+    } else if (e->event_id == MPV_EVENT_END_FILE) {
+      auto end = static_cast<const mpv_event_end_file*>(e->data);
+      record->Set(ctx, eventKey(EK_REASON), MKI(end->reason));
+      record->Set(ctx, eventKey(EK_ERROR), MKI(end->error));
     }
 
-    for (int j = 0; j < n; ++j) {
-      auto r = callMethod("createBuffer");
-      buffers[j] = r.IsEmpty() ? 0 : storeObject(_buffers, r);
-    }
+    return record;
   }
 
-  void glGenTextures(GLsizei n, GLuint *textures) {
-    GL_DEBUG("glGenTextures\n");
+  Local<String> eventKey(EVENT_KEY key) {
+    if (!_event_keys[key]) {
+      _event_keys[key] = pers_ptr(new Persistent<String>(_isolate, make_string(_isolate, event_key_names[key])));
+    }
+    return _event_keys[key]->Get(_isolate);
+  }
 
-    if (!textures || n == 0) {
-      return;
-    }
-
-    if (n < 0) {
-      // set GL_INVALID_VALUE
-      return;
-    }
+  shared_ptr<Persistent<String>> _event_keys[EK_COUNT];
+  shared_ptr<Persistent<String>> ctx_width_prop, ctx_height_prop;
+  int64_t last_ctx_dim_update = 0;
 
-    for (int j = 0; j < n; ++j) {
-      auto r = callMethod("createTexture");
-      textures[j] = r.IsEmpty() ? 0 : storeObject(_textures, r);
-    }
-  }
+#define SEC_IN_MKS 1000000
 
-  GLint glGetAttribLocation(GLuint program_id, const GLchar *name) {
-    GL_DEBUG("glGetAttribLocation\n");
+  const ctx_dim &getContextDims() {
+    int64_t cur_time = mpv_get_time_us(_mpv);
+    if (!last_ctx_dim_update || (last_ctx_dim_update + SEC_IN_MKS / 2) < cur_time) {
+      if (!ctx_width_prop) {
+        ctx_width_prop = pers_ptr(new Persistent<String>(_isolate, make_string(_isolate, "drawingBufferWidth")));
+        ctx_height_prop = pers_ptr(new Persistent<String>(_isolate, make_string(_isolate, "drawingBufferHeight")));
+      }
 
-    auto prog_iter = _programs.find(program_id);
-    if (prog_iter == _programs.end()) {
-      // set GL_INVALID_OPERATION
-      return -1;
-    }
+      Local<Object> rc = localContext();
+      Local<Context> ctx = _isolate->GetCurrentContext();
 
-    Local<Value> args[2] = { prog_iter->second->Get(_isolate), make_string(_isolate, name) };
-    auto r = callMethod("getAttribLocation", ARG_COUNT, args);
-    return r.IsEmpty()
-           ? -1
-           : static_cast<GLint>(r.As<Integer>()
-                   ->IntegerValue(_isolate->GetCurrentContext()).FromMaybe(-1));
-  }
+      Maybe<int64_t> mw = rc->Get(ctx, ctx_width_prop->Get(_isolate)).ToLocalChecked()->IntegerValue(ctx);
+      Maybe<int64_t> mh = rc->Get(ctx, ctx_height_prop->Get(_isolate)).ToLocalChecked()->IntegerValue(ctx);
 
-  GLenum glGetError() {
-    GL_DEBUG("glGetError\n");
+      if (mw.IsJust() && mh.IsJust()) {
+        _dim.width = static_cast<int>(mw.FromMaybe(0));
+        _dim.height = static_cast<int>(mh.FromMaybe(0));
+      }
 
-    auto result = callMethod("getError").As<Integer>();
-    auto err_code = static_cast<GLenum>(result->IntegerValue(_isolate->GetCurrentContext()).FromMaybe(0));
-    if (err_code != GL_NO_ERROR) {
-      GL_DEBUG("glError result: %ld\n", result->IntegerValue());
+      last_ctx_dim_update = cur_time;
     }
-    return err_code;
+
+    return _dim;
   }
 
-  void glGetIntegerv(GLenum pname, GLint *params) {
-    GL_DEBUG("glGetIntegerv: %d\n", pname);
+#undef SEC_IN_MKS
 
-    if (!params) {
-      return;
+  /**
+   * Makes mpv render into a WebGLFramebuffer or a WebGLTexture provided by js code instead of the default framebuffer.
+   * Passing null or undefined as a target restores rendering to the default framebuffer.
+   */
+  bool setRenderTarget(const Local<Value> &target, int width, int height) {
+    resetRenderTarget();
+
+    if (target.IsEmpty() || target->IsNull() || target->IsUndefined()) {
+      return true;
     }
 
-    auto r = callMethod("getParameter", MKI(pname)).As<Integer>();
-    if (r.IsEmpty()) {
-      return;
+    if (!target->IsObject()) {
+      _throw_js("MpvPlayer::setRenderTarget: WebGLFramebuffer or WebGLTexture expected");
+      return false;
     }
 
-    switch (pname) {
-      case GL_PIXEL_PACK_BUFFER_BINDING:
-      case GL_PIXEL_UNPACK_BUFFER_BINDING:
-      case GL_TRANSFORM_FEEDBACK_BUFFER_BINDING:
-      case GL_UNIFORM_BUFFER_BINDING:
-        // convert to buffer index
-        *params = static_cast<GLint>(getIndexFromObject(_buffers, r));
-        break;
+    string target_type = string_to_cc(target.As<Object>()->GetConstructorName());
+    if (target_type == "WebGLFramebuffer") {
+      // the framebuffer can be already known if it has been created by mpv itself
+      _target_fbo = getIndexFromObject(_framebuffers, target);
+      if (!_target_fbo) {
+        _target_fbo = storeObject(_framebuffers, target);
+        _target_stored = true;
+      }
+    } else if (target_type == "WebGLTexture") {
+      // we have to create a framebuffer with the texture attached to it
+      Local<Value> fb = callMethod("createFramebuffer");
+      if (fb.IsEmpty() || fb->IsNull()) {
+        _throw_js("MpvPlayer::setRenderTarget: failed to create a framebuffer for the texture");
+        return false;
+      }
 
-      case GL_FRAMEBUFFER_BINDING:
-        // convert to framebuffer index
-        *params = static_cast<GLint>(getIndexFromObject(_framebuffers, r));
-        break;
+      Local<Value> prev_fb = callMethod("getParameter", MKI(GL_FRAMEBUFFER_BINDING));
 
-      case GL_CURRENT_PROGRAM:
-        // convert to program index
-        *params = static_cast<GLint>(getIndexFromObject(_programs, r));
-        break;
+      {
+        Local<Value> args[2] = { MKI(GL_FRAMEBUFFER), fb };
+        callMethod("bindFramebuffer", ARG_COUNT, args);
+      }
 
-      case GL_TEXTURE_BINDING_2D:
-      case GL_TEXTURE_BINDING_CUBE_MAP:
-        // convert to texture index
-        *params = static_cast<GLint>(getIndexFromObject(_textures, r));
-        break;
+      {
+        Local<Value> args[5] = { MKI(GL_FRAMEBUFFER), MKI(GL_COLOR_ATTACHMENT0), MKI(GL_TEXTURE_2D), target, MKI(0) };
+        callMethod("framebufferTexture2D", ARG_COUNT, args);
+      }
 
-      default:
-        if (r->IsBoolean()) {
-          *params = static_cast<GLint>(r->BooleanValue(_isolate->GetCurrentContext()).FromMaybe(false));
-        } else if (r->IsNumber()) {
-          *params = static_cast<GLint>(r->IntegerValue(_isolate->GetCurrentContext()).FromMaybe(0));
-        } else {
-          _throw_js("glGetIntegerv: unexpected return type");
-        }
+      auto status = callMethod("checkFramebufferStatus", MKI(GL_FRAMEBUFFER))
+          ->IntegerValue(_isolate->GetCurrentContext()).FromMaybe(0);
+
+      {
+        Local<Value> args[2] = { MKI(GL_FRAMEBUFFER), prev_fb };
+        callMethod("bindFramebuffer", ARG_COUNT, args);
+      }
+
+      if (status != GL_FRAMEBUFFER_COMPLETE) {
+        callMethod("deleteFramebuffer", fb);
+        _throw_js(("MpvPlayer::setRenderTarget: framebuffer is incomplete, status = " + to_string(status)).c_str());
+        return false;
+      }
+
+      _target_fbo = storeObject(_framebuffers, fb);
+      _target_stored = true;
+      _target_owns_fbo = true;
+    } else {
+      _throw_js(("MpvPlayer::setRenderTarget: WebGLFramebuffer or WebGLTexture expected, got " + target_type).c_str());
+      return false;
     }
+
+    _target_dim.width = width;
+    _target_dim.height = height;
+    return true;
   }
 
-  void glGetShaderInfoLog(GLuint shader_id, GLsizei max_length, GLsizei *length, GLchar *info_log) {
-    GL_DEBUG("glGetShaderInfoLog\n");
+  void resetRenderTarget() {
+    if (_target_fbo) {
+      auto fb_iter = _framebuffers.find(_target_fbo);
+      if (fb_iter != _framebuffers.end()) {
+        if (_target_owns_fbo) {
+          callMethod("deleteFramebuffer", fb_iter->second->Get(_isolate));
+        }
+        if (_target_stored) {
+          _framebuffers.erase(fb_iter);
+        }
+      }
+    }
 
-    getObjectInfoLog("getShaderInfoLog", _shaders, shader_id, max_length, length, info_log);
+    _target_fbo = 0;
+    _target_stored = _target_owns_fbo = false;
+    _target_dim = ctx_dim();
   }
 
-  void glGetShaderiv(GLuint shader_id, GLenum pname, GLint *params) {
-    GL_DEBUG("glGetShaderiv\n");
+  GLuint renderTarget()const { return _target_fbo; }
 
-    getObjectiv("getShaderParameter", _shaders, shader_id, pname, params);
+  const ctx_dim &renderTargetDims() {
+    return _target_fbo ? _target_dim : getContextDims();
   }
 
-  GLint glGetUniformLocation(GLuint program_id, const GLchar *name) {
-    GL_DEBUG("glGetUniformLocation\n");
-
-    auto prog_iter = _programs.find(program_id);
-    if (prog_iter == _programs.end()) {
-      // set GL_INVALID_VALUE
-      return -1;
+  /**
+   * Draws a frame into the current render target and copies it to all mirrors.
+   * If there are viewport mirrors and mpv renders into the default framebuffer, we have to render into an offscreen
+   * texture first, as WebGL does not allow blitting a framebuffer into itself.
+   */
+  void render() {
+    bool has_viewports = false;
+    for (auto &mirror : _mirrors) {
+      if (!mirror.second.canvas) {
+        has_viewports = true;
+        break;
+      }
     }
 
-    Local<Value> args[2] = { prog_iter->second->Get(_isolate), make_string(_isolate, name) };
-    auto r = callMethod("getUniformLocation", ARG_COUNT, args);
-    return r.IsEmpty() ? -1 : storeObject(_uniforms, r);
-  }
+    GLuint src_fbo = _target_fbo;
+    ctx_dim src_dim = renderTargetDims();
 
-  void glPixelStorei(GLenum pname, GLint param) {
-    GL_DEBUG("glPixelStorei\n");
+    if (!_target_fbo && (has_viewports || _options.has_viewport)) {
+      ctx_rect primary;
+      if (_options.has_viewport) {
+        primary = _options.viewport;
+        src_dim.width = primary.width;
+        src_dim.height = primary.height;
+      } else {
+        primary.width = src_dim.width;
+        primary.height = src_dim.height;
+      }
 
-    if (pname == GL_UNPACK_ALIGNMENT) {
-      GL_DEBUG("updaing unpack alignment, setting it to %d\n", param);
-      unpack_alignment = static_cast<size_t>(param);
-    } else if (pname == GL_PACK_ALIGNMENT) {
-      GL_DEBUG("updating pack alignment, setting it to %d\n", param);
-      pack_alignment = static_cast<size_t>(param);
-    } else if (pname == GL_UNPACK_ROW_LENGTH || pname == GL_PACK_ROW_LENGTH) {
-      _throw_js(("glPixelStorei called with unsupported pname = " + to_string(param)).c_str());
-      return;
+      if (!ensureOffscreen(_offscreen, src_dim.width, src_dim.height)) {
+        return;
+      }
+
+      src_fbo = _offscreen.fbo;
+      mpv_opengl_cb_draw(_mpv_gl, src_fbo, src_dim.width, -src_dim.height);
+      blitToDefault(src_fbo, src_dim, primary);
+    } else {
+      releaseOffscreen(_offscreen);
+      mpv_opengl_cb_draw(_mpv_gl, src_fbo, src_dim.width, -src_dim.height);
     }
 
-    Local<Value> args[2] = { MKI(pname), MKI(param) };
-    callMethod("pixelStorei", ARG_COUNT, args);
+    for (auto &mirror : _mirrors) {
+      if (mirror.second.canvas) {
+        // drawImage can only copy from the player canvas, and the frame is not there when a render target is set
+        if (!_target_fbo) {
+          drawToCanvas(mirror.second);
+        }
+      } else {
+        blitToDefault(src_fbo, src_dim, mirror.second.viewport);
+      }
+    }
   }
 
-  void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *data) {
-    GL_DEBUG("glReadPixels\n");
+  bool ensureOffscreen(OffscreenTarget &t, int width, int height) {
+    if (t.fbo && t.dim.width == width && t.dim.height == height) {
+      return true;
+    }
 
-    if (!data) {
-      return;
+    releaseOffscreen(t);
+
+    if (width <= 0 || height <= 0) {
+      return false;
     }
 
-    if (pixel_pack_buffer_bound) {
-      // read pixels to bound buffer, treat pointer as an offset (hope we are not gonna use huuuuge buffers)
-      auto offset = reinterpret_cast<intptr_t>(data);
-      Local<Value> args[7] = { MKI(x), MKI(y), MKI(width), MKI(height), MKI(format),
-                            MKI(type), MKIU(static_cast<uint32_t>(offset)) };
-      callMethod("readPixels", ARG_COUNT, args);
-      return;
+    Local<Value> tex = callMethod("createTexture");
+    Local<Value> fb = callMethod("createFramebuffer");
+    if (tex.IsEmpty() || tex->IsNull() || fb.IsEmpty() || fb->IsNull()) {
+      _throw_js("failed to create an offscreen render target");
+      return false;
     }
 
-    size_t pixel_count = static_cast<size_t>(width) * static_cast<size_t>(height);
-    size_t bytes_per_pixel = bytesPerPixel(type, format);
+    Local<Value> prev_tex = callMethod("getParameter", MKI(GL_TEXTURE_BINDING_2D));
+    Local<Value> prev_fb = callMethod("getParameter", MKI(GL_FRAMEBUFFER_BINDING));
 
-    Local<ArrayBuffer> buf = backingBuffer(pixel_count * bytes_per_pixel, BB_GENERIC);
-    Local<Value> buf_view = bufForType(type, buf, pixel_count, bytes_per_pixel);
-    if (buf_view.IsEmpty()) {
-      _throw_js(("glReadPixels: unsupported data format = " + to_string(type)).c_str());
-      return;
+    {
+      Local<Value> args[2] = { MKI(GL_TEXTURE_2D), tex };
+      callMethod("bindTexture", ARG_COUNT, args);
     }
 
-    TryCatch try_catch(_isolate);
-    Local<Value> args[7] = { MKI(x), MKI(y), MKI(width), MKI(height), MKI(format), MKI(type), buf_view };
-    callMethod("readPixels", ARG_COUNT, args);
-    if (try_catch.HasCaught()) {
-      try_catch.ReThrow();
-      return;
+    {
+      Local<Value> args[9] = { MKI(GL_TEXTURE_2D), MKI(0), MKI(GL_RGBA8), MKI(width), MKI(height), MKI(0),
+                               MKI(GL_RGBA), MKI(GL_UNSIGNED_BYTE), Null(_isolate) };
+      callMethod("texImage2D", ARG_COUNT, args);
     }
-    if (glGetError() != GL_NO_ERROR) {
-      _throw_js("glReadPixels: error while reading pixels");
-      return;
+
+    {
+      Local<Value> args[3] = { MKI(GL_TEXTURE_2D), MKI(GL_TEXTURE_MIN_FILTER), MKI(GL_LINEAR) };
+      callMethod("texParameteri", ARG_COUNT, args);
     }
 
-    size_t row_bytes_aligned = alignToPackBoundary(width * bytes_per_pixel);
-    if (row_bytes_aligned == width * bytes_per_pixel) {
-      memcpy(data, buf->GetContents().Data(), pixel_count * bytes_per_pixel);
-    } else {
-      auto buf_data = static_cast<const GLubyte*>(buf->GetContents().Data());
-      auto dst_data = static_cast<GLubyte*>(data);
+    {
+      Local<Value> args[2] = { MKI(GL_FRAMEBUFFER), fb };
+      callMethod("bindFramebuffer", ARG_COUNT, args);
+    }
 
-      for (GLsizei q = 0; q < height; ++q) {
-        memcpy(dst_data, buf_data, width * bytes_per_pixel);
-        buf_data += width * bytes_per_pixel;
-        dst_data += row_bytes_aligned;
-      }
+    {
+      Local<Value> args[5] = { MKI(GL_FRAMEBUFFER), MKI(GL_COLOR_ATTACHMENT0), MKI(GL_TEXTURE_2D), tex, MKI(0) };
+      callMethod("framebufferTexture2D", ARG_COUNT, args);
     }
-  }
 
-  void glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
-    GL_DEBUG("glScissor\n");
+    {
+      Local<Value> args[2] = { MKI(GL_TEXTURE_2D), prev_tex };
+      callMethod("bindTexture", ARG_COUNT, args);
+    }
 
-    Local<Value> args[4] = { MKI(x), MKI(y), MKI(width), MKI(height) };
-    callMethod("scissor", ARG_COUNT, args);
-  }
+    {
+      Local<Value> args[2] = { MKI(GL_FRAMEBUFFER), prev_fb };
+      callMethod("bindFramebuffer", ARG_COUNT, args);
+    }
 
-  void glTexImage2D(GLenum target, GLint level, GLint internal_format, GLsizei width,
-                    GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *data) {
-    GL_DEBUG("glTexImage2D\n");
+    t.fbo = storeObject(_framebuffers, fb);
+    t.texture = pers_ptr(new Persistent<Value>(_isolate, tex));
+    t.dim.width = width;
+    t.dim.height = height;
+    return true;
+  }
 
-    if (target != GL_TEXTURE_2D) {
-      _throw_js(("glTexImage2D: unsupported target = " + to_string(target)).c_str());
-      return;
+  void releaseOffscreen(OffscreenTarget &t) {
+    if (t.fbo) {
+      deleteObjects("deleteFramebuffer", _framebuffers, 1, &t.fbo);
     }
-
-    if (pixel_unpack_buffer_bound) {
-      // load data from bound buffer
-      auto offset = reinterpret_cast<intptr_t>(data);
-      Local<Value> args[9] = { MKI(target), MKI(level), MKI(internal_format), MKI(width),
-                               MKI(height), MKI(border), MKI(format), MKI(type),
-                               MKIU(static_cast<uint32_t>(offset)) };
-      callMethod("texImage2D", ARG_COUNT, args);
-      return;
+    if (t.texture) {
+      callMethod("deleteTexture", t.texture->Get(_isolate));
     }
-
-    if (!data) {
-      // data may be a null pointer. In this case, texture memory is allocated to accommodate
-      // a texture of width width and height height.
-      Local<Value> args[9] = { MKI(target), MKI(level), MKI(internal_format), MKI(width),
-                               MKI(height), MKI(border), MKI(format), MKI(type), Null(_isolate) };
-      callMethod("texImage2D", ARG_COUNT, args);
-    } else {
-      auto bufs = getTexBuffers(type, format, width, height, data);
-      if (bufs.second.IsEmpty()) {
-        _throw_js(("glTexImage2D: unsupported type: " + to_string(type)).c_str());
+    t = OffscreenTarget();
+  }
+
+  /**
+   * Copies contents of the given framebuffer into a region of the default framebuffer.
+   * Viewport coordinates are given in canvas pixels with the origin in the top left corner.
+   */
+  void blitToDefault(GLuint src_fbo, const ctx_dim &src_dim, const ctx_rect &dst) {
+    Local<Value> src = Null(_isolate);
+    if (src_fbo) {
+      auto fb_iter = _framebuffers.find(src_fbo);
+      if (fb_iter == _framebuffers.end()) {
         return;
       }
-
-      Local<Value> args[10] = { MKI(target), MKI(level), MKI(internal_format), MKI(width),
-                                MKI(height), MKI(border), MKI(format), MKI(type), bufs.second, MKI(0) };
-      callMethod("texImage2D", ARG_COUNT, args);
+      src = fb_iter->second->Get(_isolate);
     }
-  }
 
-  void glTexParameteri(GLenum target, GLenum pname, GLint param) {
-    GL_DEBUG("glTexParameteri\n");
+    int dst_y = getContextDims().height - dst.y - dst.height;
 
-    Local<Value> args[3] = { MKI(target), MKI(pname), MKI(param) };
-    callMethod("texParameteri", ARG_COUNT, args);
-  }
+    // the context can be shared with the app or other players, so the state changed here is restored afterwards
+    bool scissor_enabled = callMethod("isEnabled", MKI(GL_SCISSOR_TEST))->BooleanValue();
+    Local<Value> prev_read_fb = callMethod("getParameter", MKI(GL_READ_FRAMEBUFFER_BINDING));
+    Local<Value> prev_draw_fb = callMethod("getParameter", MKI(GL_DRAW_FRAMEBUFFER_BINDING));
 
-  void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width,
-                       GLsizei height, GLenum format, GLenum type, const GLvoid *pixels) {
-    GL_DEBUG("glTexSubImage2D\n");
+    if (scissor_enabled) {
+      callMethod("disable", MKI(GL_SCISSOR_TEST));
+    }
 
-    if (pixel_unpack_buffer_bound) {
-      // load data from bound buffer
-      auto offset = reinterpret_cast<intptr_t>(pixels);
-      Local<Value> args[9] = { MKI(target), MKI(level), MKI(xoffset), MKI(yoffset),
-                               MKI(width), MKI(height), MKI(format), MKI(type),
-                               MKIU(static_cast<uint32_t>(offset)) };
-      callMethod("texSubImage2D", ARG_COUNT, args);
-      return;
+    {
+      Local<Value> args[2] = { MKI(GL_READ_FRAMEBUFFER), src };
+      callMethod("bindFramebuffer", ARG_COUNT, args);
     }
 
-    auto bufs = getTexBuffers(type, format, width, height, pixels);
-    if (bufs.second.IsEmpty()) {
-      _throw_js(("glTexSubImage2D: unsupported type: " + to_string(type)).c_str());
-      return;
+    {
+      Local<Value> args[2] = { MKI(GL_DRAW_FRAMEBUFFER), Null(_isolate) };
+      callMethod("bindFramebuffer", ARG_COUNT, args);
     }
 
-    Local<Value> args[9] = { MKI(target), MKI(level), MKI(xoffset), MKI(yoffset),
-                             MKI(width), MKI(height), MKI(format), MKI(type), bufs.second };
-    callMethod("texSubImage2D", ARG_COUNT, args);
-  }
+    {
+      Local<Value> args[10] = { MKI(0), MKI(0), MKI(src_dim.width), MKI(src_dim.height),
+                                MKI(dst.x), MKI(dst_y), MKI(dst.x + dst.width), MKI(dst_y + dst.height),
+                                MKI(GL_COLOR_BUFFER_BIT), MKI(GL_LINEAR) };
+      callMethod("blitFramebuffer", ARG_COUNT, args);
+    }
 
-  void glUniform1f(GLint location, GLfloat v0) {
-    GL_DEBUG("glUniform1f\n");
+    {
+      Local<Value> args[2] = { MKI(GL_READ_FRAMEBUFFER), prev_read_fb };
+      callMethod("bindFramebuffer", ARG_COUNT, args);
+    }
 
-    Local<Value> args[2] = { Local<Value>(), MKN(v0) };
-    callLocationMethod("uniform1f", location, ARG_COUNT, args);
+    {
+      Local<Value> args[2] = { MKI(GL_DRAW_FRAMEBUFFER), prev_draw_fb };
+      callMethod("bindFramebuffer", ARG_COUNT, args);
+    }
+
+    if (scissor_enabled) {
+      callMethod("enable", MKI(GL_SCISSOR_TEST));
+    }
   }
 
-  void glUniform2f(GLint location, GLfloat v0, GLfloat v1) {
-    GL_DEBUG("glUniform2f\n");
+  /**
+   * Copies current contents of the player canvas into a mirror canvas.
+   * It should be done in the same task the frame has been rendered in, as the drawing buffer is cleared after
+   * being presented.
+   */
+  void drawToCanvas(const MirrorTarget &mirror) {
+    Local<Context> ctx = _isolate->GetCurrentContext();
+    Local<Object> canvas = mirror.canvas->Get(_isolate);
 
-    Local<Value> args[3] = { Local<Value>(), MKN(v0), MKN(v1) };
-    callLocationMethod("uniform2f", location, ARG_COUNT, args);
+    Local<Value> width = canvas->Get(ctx, make_string(_isolate, "width")).ToLocalChecked();
+    Local<Value> height = canvas->Get(ctx, make_string(_isolate, "height")).ToLocalChecked();
+
+    Local<Value> args[5] = { _canvas->Get(_isolate), MKI(0), MKI(0), width, height };
+    mirror.draw_image->Get(_isolate)->Call(ctx, mirror.context->Get(_isolate), ARG_COUNT, args);
   }
 
-  void glUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {
-    GL_DEBUG("glUniform3f\n");
+  /**
+   * Adds a new mirror. The target should be either a canvas supporting 2d context or an object with x, y, width and
+   * height properties describing a region of the player canvas. Canvas mirrors are not updated while a render target is
+   * set.
+   * Returns a mirror id or -1 if failed.
+   */
+  int addMirror(const Local<Object> &target) {
+    Local<Context> ctx = _isolate->GetCurrentContext();
+    MirrorTarget mirror;
+
+    Local<Value> get_context = target->Get(ctx, make_string(_isolate, "getContext")).ToLocalChecked();
+    if (get_context->IsFunction()) {
+      Local<Value> args[1] = { make_string(_isolate, "2d") };
+      MaybeLocal<Value> maybe_context = get_context.As<Function>()->Call(ctx, target, ARG_COUNT, args);
+      if (maybe_context.IsEmpty() || !maybe_context.ToLocalChecked()->IsObject()) {
+        _throw_js("MpvPlayer::addMirror: failed to get 2d context of the mirror canvas");
+        return -1;
+      }
 
-    Local<Value> args[4] = { Local<Value>(), MKN(v0), MKN(v1), MKN(v2) };
-    callLocationMethod("uniform3f", location, ARG_COUNT, args);
+      mirror.canvas = pers_ptr(new Persistent<Object>(_isolate, target));
+      mirror.context = pers_ptr(new Persistent<Object>(_isolate, maybe_context.ToLocalChecked().As<Object>()));
+
+      auto draw_image = get_method(_isolate, mirror.context, "drawImage");
+      if (draw_image.IsEmpty() || !draw_image->IsFunction()) {
+        _throw_js("MpvPlayer::addMirror: mirror canvas context has no drawImage method");
+        return -1;
+      }
+      mirror.draw_image = pers_ptr(new Persistent<Function>(_isolate, draw_image));
+    } else if (!rect_from_object(_isolate, target, mirror.viewport)) {
+      _throw_js("MpvPlayer::addMirror: invalid viewport, an object with x, y, width and height expected");
+      return -1;
+    }
+
+    int mirror_id = ++_last_mirror_id;
+    _mirrors[mirror_id] = mirror;
+    return mirror_id;
   }
 
-  void glUniform1i(GLint location, GLint v0) {
-    GL_DEBUG("glUniform1i\n");
+  bool removeMirror(int mirror_id) {
+    return _mirrors.erase(mirror_id) > 0;
+  }
 
-    Local<Value> args[2] = { Local<Value>(), MKN(v0) };
-    callLocationMethod("uniform1i", location, ARG_COUNT, args);
+  /**
+   * Restricts the player output to a region of the canvas, so several players can share a single rendering context.
+   * A frame is rendered into a texture of the viewport size and then copied into the region.
+   */
+  void setViewport(const ctx_rect &viewport) {
+    _options.has_viewport = true;
+    _options.viewport = viewport;
   }
 
-  void glUniformMatrix2fv(GLint location, GLsizei matrix_count, GLboolean transpose, const GLfloat *value) {
-    GL_DEBUG("glUniformMatrix2fv\n");
+  void resetViewport() {
+    _options.has_viewport = false;
+    _options.viewport = ctx_rect();
+  }
 
-    if (matrix_count != 1) {
-      _throw_js(("glUniformMatrix2fv: unsupported parameter matrix_count = " + to_string(matrix_count)).c_str());
-      return;
+  shared_ptr<Persistent<Object>> _cmd_accesser;
+  shared_ptr<Persistent<ObjectTemplate>> _cmd_accesser_template;
+  shared_ptr<Persistent<ObjectTemplate>> _prop_accesser_template;
+
+  /** GL functions implementation **/
+
+  const GLubyte *glGetString(GLenum name) {
+    GL_DEBUG("glGetString: %d\n", name);
+
+    // check if we have already cached this property
+    auto props_iter = _gl_ctx->props.find(name);
+    if (props_iter != _gl_ctx->props.end()) {
+      return reinterpret_cast<const GLubyte*>(props_iter->second.c_str());
     }
 
-    uniformMatrix("uniformMatrix2fv", 2, location, transpose, value);
-  }
+    string result;
+    switch (name) {
+      case GL_VERSION:
+        // fake opengl version as mpv fails to understand the real one
+        result = "OpenGL ES 2.0 Chromium";
+        break;
 
-  void glUniformMatrix3fv(GLint location, GLsizei matrix_count, GLboolean transpose, const GLfloat *value) {
-    GL_DEBUG("glUniformMatrix3fv\n");
+      case GL_SHADING_LANGUAGE_VERSION:
+        result = "OpenGL ES GLSL ES 1.0 Chromium";
+        break;
 
-    if (matrix_count != 1) {
-      _throw_js(("glUniformMatrix3fv: unsupported parameter matrix_count = " + to_string(matrix_count)).c_str());
-      return;
+      case GL_EXTENSIONS:
+        result = "GL_ARB_framebuffer_object";
+        break;
+
+      default:
+        result = string_to_cc(callMethod("getParameter", MKN(name)));
     }
 
-    uniformMatrix("uniformMatrix3fv", 3, location, transpose, value);
+    if (!result.empty()) {
+      _gl_ctx->props[name] = result;
+      return reinterpret_cast<const GLubyte*>(_gl_ctx->props[name].c_str());
+    } else {
+      return nullptr;
+    }
   }
 
-  void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized,
-                             GLsizei stride, const GLvoid *pointer) {
-    GL_DEBUG("glVertexAttribPointer\n");
-
-    auto low_pointer = static_cast<uint32_t>(reinterpret_cast<uint64_t>(pointer));
+  void glActiveTexture(GLenum texture) {
+    GL_DEBUG("glActiveTexture\n");
 
-    Local<Value> args[6] = { MKI(index), MKI(size), MKI(type),
-                             Boolean::New(_isolate, normalized), MKI(stride),
-                             Integer::NewFromUnsigned(_isolate, low_pointer) };
-    callMethod("vertexAttribPointer", ARG_COUNT, args);
+    callMethod("activeTexture", MKI(texture));
   }
 
-  void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
-    GL_DEBUG("glViewport\n");
+  GLuint glCreateProgram() {
+    GL_DEBUG("glCreateProgram\n");
 
-    Local<Value> args[4] = { MKI(x), MKI(y), MKI(width), MKI(height) };
-    callMethod("viewport", ARG_COUNT, args);
+    return storeObject(_programs, callMethod("createProgram"));
   }
 
-  void glBindFramebuffer(GLenum target, GLuint framebuffer) {
-    GL_DEBUG("glBindFramebuffer\n");
+  void glDeleteProgram(GLuint program_id) {
+    GL_DEBUG("glDeleteProgram\n");
 
-    if (framebuffer == 0) {
-      Local<Value> args[2] = { MKI(target), Null(_isolate) };
-      callMethod("bindFramebuffer", ARG_COUNT, args);
+    auto prog_iter = _programs.find(program_id);
+    if (prog_iter == _programs.end()) {
+      // ignore silently
       return;
     }
 
-    auto fb_iter = _framebuffers.find(framebuffer);
-    if (fb_iter == _framebuffers.end()) {
-      // set GL_INVALID_VALUE
-      return;
-    }
+    callMethod("deleteProgram", prog_iter->second->Get(_isolate));
+  }
 
-    Local<Value> args[2] = { MKI(target), fb_iter->second->Get(_isolate) };
-    callMethod("bindFramebuffer", ARG_COUNT, args);
+  void glGetProgramInfoLog(GLuint program_id, GLsizei max_length, GLsizei *length, GLchar *info_log) {
+    GL_DEBUG("glGetProgramInfoLog\n");
+
+    getObjectInfoLog("getProgramInfoLog", _programs, program_id, max_length, length, info_log);
   }
 
-  void glGenFramebuffers(GLsizei n, GLuint *ids) {
-    GL_DEBUG("glGenFramebuffers\n");
+  void glGetProgramiv(GLuint program_id, GLenum pname, GLint *params) {
+    GL_DEBUG("glGetProgramiv\n");
 
-    if (!ids || n == 0) {
-      return;
-    }
+    getObjectiv("getProgramParameter", _programs, program_id, pname, params);
+  }
 
-    if (n < 0) {
+  void glUseProgram(GLuint program_id) {
+    GL_DEBUG("glUseProgram\n");
+
+    auto prog_iter = _programs.find(program_id);
+    if (prog_iter == _programs.end()) {
       // set GL_INVALID_VALUE
       return;
     }
 
-    for (int j = 0; j < n; ++j) {
-      auto r = callMethod("createFramebuffer");
-      ids[j] = r.IsEmpty() ? 0 : storeObject(_framebuffers, r);
-    }
+    callMethod("useProgram", prog_iter->second->Get(_isolate));
   }
 
-  void glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers) {
-    GL_DEBUG("glDeleteFramebuffers\n");
+  void glLinkProgram(GLuint program_id) {
+    GL_DEBUG("glLinkProgram\n");
 
-    deleteObjects("deleteFramebuffer", _framebuffers, n, framebuffers);
+    auto prog_iter = _programs.find(program_id);
+    if (prog_iter == _programs.end()) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    callMethod("linkProgram", prog_iter->second->Get(_isolate));
   }
 
-  GLenum glCheckFramebufferStatus(GLenum target) {
-    GL_DEBUG("glCheckFramebufferStatus\n");
+  GLuint glCreateShader(GLenum shader_type) {
+    GL_DEBUG("glCreateShader\n");
 
-    auto r = callMethod("checkFramebufferStatus", MKI(target))->IntegerValue(_isolate->GetCurrentContext());
-    return static_cast<GLenum>(r.FromMaybe(0));
+    return storeObject(_shaders, callMethod("createShader", Number::New(_isolate, shader_type)));
   }
 
-  void glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) {
-    GL_DEBUG("glFramebufferTexture2D\n");
+  void glDeleteShader(GLuint shader_id) {
+    GL_DEBUG("glDeleteShader\n");
 
-    auto tex_iter = _textures.find(texture);
-    if (tex_iter == _textures.end()) {
-      // set GL_INVALID_VALUE
+    auto sh_iter = _shaders.find(shader_id);
+    if (sh_iter == _shaders.end()) {
+      // ignore silently
       return;
     }
 
-    Local<Value> args[5] = { MKI(target), MKI(attachment), MKI(textarget),
-                             tex_iter->second->Get(_isolate), MKI(level) };
-    callMethod("framebufferTexture2D", ARG_COUNT, args);
+    callMethod("deleteShader", sh_iter->second->Get(_isolate));
   }
 
-  void glGetFramebufferAttachmentParameteriv(GLenum target, GLenum attachment, GLenum pname, GLint *params) {
-    GL_DEBUG("glGetFramebufferAttachmentParameteriv\n");
+  void glAttachShader(GLuint program_id, GLuint shader_id) {
+    GL_DEBUG("glAttachShader\n");
 
-    if (!params) {
+    auto prog_iter = _programs.find(program_id);
+    if (prog_iter == _programs.end()) {
+      // set GL_INVALID_VALUE
       return;
     }
 
-    Local<Value> args[3] = { MKI(target), MKI(pname), MKI(pname) };
-    auto r = callMethod("getFramebufferAttachmentParameter", ARG_COUNT, args).As<Integer>();
-    if (!r.IsEmpty()) {
-      auto result = r->IntegerValue(_isolate->GetCurrentContext());
-      if (result.IsJust()) {
-        *params = static_cast<GLint>(result.FromMaybe(0));
-      }
+    auto sh_iter = _shaders.find(shader_id);
+    if (sh_iter == _shaders.end()) {
+      // set GL_INVALID_VALUE
+      return;
     }
+
+    Local<Value> args[2] = { prog_iter->second->Get(_isolate), sh_iter->second->Get(_isolate) };
+    callMethod("attachShader", ARG_COUNT, args);
   }
 
-  /** Helper functions **/
+  void glCompileShader(GLuint shader_id) {
+    GL_DEBUG("glCompileShader\n");
 
-  inline Local<Object> localContext()const { return _renderingContext->Get(_isolate); }
+    auto sh_iter = _shaders.find(shader_id);
+    if (sh_iter == _shaders.end()) {
+      // set GL_INVALID_VALUE
+      return;
+    }
 
-  inline Local<Function> localMethod(const string &method_name) {
-    auto m = method(method_name);
-    return m ? m->Get(_isolate) : Local<Function>();
+    callMethod("compileShader", sh_iter->second->Get(_isolate));
   }
 
-  shared_ptr<Persistent<Function>> method(const string &method_name) {
-    if (!_renderingContext) {
-      return nullptr;
+  void glShaderSource(GLuint shader_id, GLsizei count, const GLchar **string, const GLint *length) {
+    GL_DEBUG("glShaderSource\n");
+
+    auto sh_iter = _shaders.find(shader_id);
+    if (sh_iter == _shaders.end() || count < 0) {
+      // set GL_INVALID_VALUE
+      return;
     }
 
-    // check if we have cached the requested method
-    auto ex_iter = _webgl_methods.find(method_name);
-    if (ex_iter != _webgl_methods.end()) {
-      return ex_iter->second;
+    if (count == 0) {
+      return;
     }
 
-    // if not, get the method from rendering context and cache it
-    auto method = get_method(_isolate, _renderingContext, method_name.c_str());
-    if (method.IsEmpty() || method->IsNull() || method->IsUndefined()) {
-      _throw_js(("failed to get rendering context method " + method_name).c_str());
-      return shared_ptr<Persistent<Function>>();
+    if (count > 1) {
+      _throw_js("glShaderSource: Multiple GLSL shader files are not supported");
+      return;
     }
-    auto pers = pers_ptr(new Persistent<Function>(_isolate, method));
-    _webgl_methods[method_name] = pers;
-    return pers;
-  }
 
-  Local<Value> callMethod(const string &method_name, int argc, const Local<Value> *args) {
-    return localMethod(method_name)->Call(_isolate->GetCurrentContext(),
-                                          localContext(), argc, const_cast<Local<Value>*>(args)).ToLocalChecked();
-  }
+    Local<String> shader_source;
+    if (length) {
+      shader_source = String::NewFromUtf8(_isolate, string[0], NewStringType::kNormal, length[0]).ToLocalChecked();
+    } else {
+      shader_source = make_string(_isolate, string[0]);
+    }
 
-  Local<Value> callMethod(const string &method_name, const Local<Value> &arg) {
-    return localMethod(method_name)->Call(_isolate->GetCurrentContext(),
-                                          localContext(), 1, const_cast<Local<Value>*>(&arg)).ToLocalChecked();
+    Local<Value> args[2] = { sh_iter->second->Get(_isolate), shader_source };
+    callMethod("shaderSource", ARG_COUNT, args);
   }
 
-  Local<Value> callMethod(const string &method_name) {
-    Local<Value> dummy;
-    return localMethod(method_name)
-      ->Call(_isolate->GetCurrentContext(), localContext(), 0, &dummy).ToLocalChecked();
-  }
+  void glBindAttribLocation(GLuint program_id, GLuint index, const GLchar *name) {
+    GL_DEBUG("glBindAttribLocation\n");
 
-  template<class T>
-  T storeObject(map<T, shared_ptr<Persistent<Value>>> &store, const Local<Value> &value) {
-    T object_id = newId();
-    store[object_id] = pers_ptr(new Persistent<Value>(_isolate, value));
-    return object_id;
-  }
-
-  template<class T>
-  T getIndexFromObject(map<T, shared_ptr<Persistent<Value>>> &store, const Local<Value> &value)const {
-    for (auto obj_iter = store.begin(); obj_iter != store.end(); ++obj_iter) {
-      if (value == *(obj_iter->second)) {
-        return obj_iter->first;
-      }
+    auto prog_iter = _programs.find(program_id);
+    if (prog_iter == _programs.end()) {
+      // set GL_INVALID_VALUE
+      return;
     }
-    return 0;
-  }
-
-  size_t alignToUnpackBoundary(size_t value) {
-    return alignToBoundary(value, unpack_alignment);
-  }
 
-  size_t alignToPackBoundary(size_t value) {
-    return alignToBoundary(value, pack_alignment);
-  }
-
-  static size_t alignToBoundary(size_t value, size_t boundary) {
-    return (value + boundary - 1) & ~(boundary - 1);
+    Local<Value> args[3] = { prog_iter->second->Get(_isolate), MKI(index), make_string(_isolate, name) };
+    callMethod("bindAttribLocation", ARG_COUNT, args);
   }
 
-  static size_t bytesPerPixel(GLenum type, GLenum format) {
-    size_t type_c = 0, format_c = 0;
+  void glBindBuffer(GLenum target, GLuint buffer) {
+    GL_DEBUG("glBindBuffer\n");
 
-    switch (type) {
-      case GL_UNSIGNED_INT_2_10_10_10_REV:        return 4;
-      case GL_UNSIGNED_SHORT_5_6_5:               return 2;
-      case GL_UNSIGNED_SHORT_8_8_APPLE:           return 2;
-      case GL_UNSIGNED_SHORT_8_8_REV_APPLE:       return 2;
-      default:                                    break;
+    if (target == GL_PIXEL_UNPACK_BUFFER) {
+      GL_DEBUG("binding/unbinding a buffer to GL_PIXEL_UNPACK_BUFFER");
+      _gl_ctx->pixel_unpack_buffer_bound = buffer != 0;
+    } else if (target == GL_PIXEL_PACK_BUFFER) {
+      GL_DEBUG("binding/unbinding a buffer to GL_PIXEL_PACK_BUFFER");
+      _gl_ctx->pixel_pack_buffer_bound = buffer != 0;
     }
 
-    switch (type) {
-      case GL_UNSIGNED_BYTE:                      type_c = 1; break;
-      case GL_UNSIGNED_SHORT:                     type_c = 2; break;
-      case GL_FLOAT:                              type_c = 4; break;
-      default:                                    return 0;
+    if (buffer == 0) {
+      Local<Value> args[2] = { MKI(target), Null(_isolate) };
+      callMethod("bindBuffer", ARG_COUNT, args);
+      return;
     }
 
-    switch (format) {
-      case GL_RED:
-      case GL_RED_INTEGER:
-      case GL_LUMINANCE:
-        format_c = 1;
-        break;
+    auto buffer_iter = _buffers.find(buffer);
+    if (buffer_iter == _buffers.end()) {
+      // set GL_INVALID_VALUE
+      return;
+    }
 
-      case GL_RG:
-      case GL_RG_INTEGER:
-      case GL_LUMINANCE_ALPHA:
-        format_c = 2;
-        break;
+    Local<Value> args[2] = { MKI(target), buffer_iter->second->Get(_isolate) };
+    callMethod("bindBuffer", ARG_COUNT, args);
+  }
 
-      case GL_RGB:
-      case GL_RGB_INTEGER:
-        format_c = 3;
-        break;
+  void glBindTexture(GLenum target, GLuint texture) {
+    GL_DEBUG("glBindTexture\n");
 
-      case GL_RGBA:
-      case GL_RGBA_INTEGER:
-        format_c = 4;
-        break;
+    if (texture == 0) {
+      Local<Value> args[2] = { MKI(target), Null(_isolate) };
+      callMethod("bindTexture", ARG_COUNT, args);
+      return;
+    }
 
-      default:
-        return 0;
+    auto texture_iter = _textures.find(texture);
+    if (texture_iter == _textures.end()) {
+      // set GL_INVALID_VALUE
+      return;
     }
 
-    return type_c * format_c;
+    Local<Value> args[2] = { MKI(target), texture_iter->second->Get(_isolate) };
+    callMethod("bindTexture", ARG_COUNT, args);
   }
 
-  Local<Value> bufForType(GLenum type, const Local<ArrayBuffer> &buf, size_t pixel_count, size_t bytes_per_pixel) {
-    switch (type) {
-      case GL_UNSIGNED_BYTE:
-        return Uint8Array::New(buf, 0, pixel_count * (bytes_per_pixel / sizeof(GLubyte)));
-        break;
-
-      case GL_UNSIGNED_SHORT:
-      case GL_UNSIGNED_SHORT_5_6_5:
-      case GL_UNSIGNED_SHORT_4_4_4_4:
-      case GL_UNSIGNED_SHORT_5_5_5_1:
-      case GL_HALF_FLOAT:
-        return Uint16Array::New(buf, 0, pixel_count * (bytes_per_pixel / sizeof(GLushort)));
-        break;
-
-      case GL_UNSIGNED_INT:
-      case GL_UNSIGNED_INT_24_8:
-        return Uint32Array::New(buf, 0, pixel_count * (bytes_per_pixel / sizeof(GLuint)));
-        break;
-
-      case GL_FLOAT:
-        return Float32Array::New(buf, 0, pixel_count * (bytes_per_pixel / sizeof(GLfloat)));
-        break;
+  void glBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAplha, GLenum dstAplha) {
+    GL_DEBUG("glBlendFuncSeparate\n");
 
-      default:
-        return Local<Value>();
-    }
+    Local<Value> args[4] = { MKI(srcRGB), MKI(dstRGB), MKI(srcAplha), MKI(dstAplha) };
+    callMethod("blendFuncSeparate", ARG_COUNT, args);
   }
 
-  pair<Local<ArrayBuffer>, Local<Value>> getTexBuffers(GLenum type, GLenum format, GLsizei width,
-                                                             GLsizei height, const GLvoid *data) {
-    size_t pixel_count = static_cast<size_t>(width) * static_cast<size_t>(height);
-    size_t bytes_per_pixel = bytesPerPixel(type, format);
+  void glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage) {
+    GL_DEBUG("glBufferData\n");
 
-    // Unfortunately, chromium does not accept externalized buffers for webgl methods (externalized buffers in this case should be created by chromium itself), so we have to copy entire data to the new buffer and give ownership to v8.
-    // mpv uploads frames as textures, so this function is a resource hog.
-    // Due to this, we should reuse a single buffer to avoid creating a ton of ArrayBuffers for each frame
-    Local<ArrayBuffer> buf = backingBuffer(pixel_count * bytes_per_pixel, BB_TEX);
+    if (size < 0) {
+      // set GL_INVALID_VALUE
+      return;
+    }
 
-    size_t row_bytes_aligned = alignToUnpackBoundary(width * bytes_per_pixel);
-    if (row_bytes_aligned == width * bytes_per_pixel) {
-      // smooth rows, without gaps between them, we can copy it with one call
-      memcpy(buf->GetContents().Data(), data, pixel_count * bytes_per_pixel);
+    if (!data) {
+      Local<Value> args[3] = { MKI(target),
+                               Integer::NewFromUnsigned(_isolate, static_cast<uint32_t>(size)),
+                               MKI(usage) };
+      callMethod("bufferData", ARG_COUNT, args);
     } else {
-      // things got worse, there are alignment gaps between rows, and webgl does not support it.
-      // we have to copy rows one-by-one and skip alignment gaps
-      auto buf_data = static_cast<GLubyte*>(buf->GetContents().Data());
-      auto src_data = static_cast<const GLubyte*>(data);
+      auto buf = backingBuffer(static_cast<size_t>(size), BB_BUFFER);
+      memcpy(buf->GetContents().Data(), data, static_cast<size_t>(size));
 
-      for (GLsizei q = 0; q < height; ++q) {
-        memcpy(buf_data, src_data, width * bytes_per_pixel);
-        buf_data += width * bytes_per_pixel;
-        src_data += row_bytes_aligned;
-      }
+      Local<Value> args[3] = { MKI(target), buf, MKI(usage) };
+      callMethod("bufferData", ARG_COUNT, args);
     }
-
-    return { buf, bufForType(type, buf, pixel_count, bytes_per_pixel) };
   }
 
-  void getObjectiv(const char *webgl_method, const ObjectStore &store, GLuint object_id,
-                   GLenum pname, GLint *params) {
-    if (!params) {
-      return;
-    }
+  void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid *data) {
+    GL_DEBUG("glBufferSubData\n");
 
-    auto obj_iter = store.find(object_id);
-    if (obj_iter == store.end()) {
+    if (size < 0) {
       // set GL_INVALID_VALUE
       return;
     }
 
-    if (pname == GL_INFO_LOG_LENGTH) {
-      *params = 1024 * 10;
-      GL_DEBUG("simulating GL_INFO_LOG_LENGTH parameter...\n");
-      return;
-    } else if (pname == GL_SHADER_SOURCE_LENGTH || pname == GL_ACTIVE_UNIFORM_MAX_LENGTH
-               || pname == GL_ACTIVE_ATTRIBUTE_MAX_LENGTH) {
-      _throw_js(("getting shader or program paratemer: unsupported pname value = " + to_string(pname)).c_str());
+    if (size == 0) {
       return;
     }
 
-    Local<Value> args[2] = { obj_iter->second->Get(_isolate), MKI(pname) };
-    auto result = callMethod(webgl_method, ARG_COUNT, args);
-    if (result->IsNumber() || result->IsNumberObject()) {
-      auto maybe_int = result->IntegerValue(_isolate->GetCurrentContext());
-      if (maybe_int.IsJust()) {
-        *params = static_cast<GLint>(maybe_int.FromMaybe(0));
-      }
-    } else if (result->IsBoolean() || result->IsBooleanObject()) {
-      auto maybe_bool = result->BooleanValue(_isolate->GetCurrentContext());
-      if (maybe_bool.IsJust()) {
-        *params = static_cast<GLint>(maybe_bool.FromMaybe(false));
-      }
-    } else {
-      _throw_js(("getting shader or program paramater: returned value is not an integer and not an boolean, pname = "
-                 + to_string(pname)).c_str());
-    }
+    auto buf = backingBuffer(static_cast<size_t>(size), BB_BUFFER);
+    memcpy(buf->GetContents().Data(), data, static_cast<size_t>(size));
+
+    Local<Value> args[3] = { MKI(target),
+                             Integer::NewFromUnsigned(_isolate, static_cast<uint32_t>(offset)),
+                             buf };
+    callMethod("bufferSubData", ARG_COUNT, args);
   }
 
-  void getObjectInfoLog(const char *webgl_method, const ObjectStore &store, GLuint object_id,
-                        GLsizei max_length, GLsizei *length, GLchar *info_log) {
-    Local<Context> ctx = _isolate->GetCurrentContext();
+  void glClear(GLbitfield mask) {
+    GL_DEBUG("glClear\n");
 
-    if (!info_log || max_length == 0) {
-      return;
-    }
+    callMethod("clear", MKI(mask));
+  }
 
-    if (max_length < 0) {
-      // set GL_INVALID_VALUE
-      return;
-    }
+  void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
+    GL_DEBUG("glClearColor\n");
 
-    auto obj_iter = store.find(object_id);
-    if (obj_iter == store.end()) {
-      // set GL_INVALID_VALUE
-      return;
-    }
+    Local<Value> args[] = { MKN(red), MKN(green), MKN(blue), MKN(alpha) };
+    callMethod("clearColor", ARG_COUNT, args);
+  }
 
-    auto result = callMethod(webgl_method, obj_iter->second->Get(_isolate))->ToString(ctx);
-    if (result.IsEmpty()) {
-      return;
-    }
+  void glDeleteBuffers(GLsizei n, const GLuint *buffers) {
+    GL_DEBUG("glDeleteBuffers\n");
 
-    int written = result.ToLocalChecked()->WriteUtf8(info_log, max_length - 1,
-                                                     nullptr, String::NO_NULL_TERMINATION);
-    info_log[written + 1] = 0;
-    if (length) {
-      *length = written + 1;
-    }
+    deleteObjects("deleteBuffer", _buffers, n, buffers);
   }
 
-  void deleteObjects(const string &webgl_method, ObjectStore &store, GLsizei n, const GLuint *objects) {
-    if (!objects || n == 0) {
-      return;
-    }
+  void glDeleteTextures(GLsizei n, const GLuint *textures) {
+    GL_DEBUG("glDeleteTextures\n");
 
-    if (n < 0) {
-      // set GL_INVALID_VALUE
-      return;
-    }
+    deleteObjects("deleteTexture", _textures, n, textures);
+  }
 
-    for (int j = 0; j < n; ++j) {
-      auto object_iter = store.find(objects[j]);
-      if (object_iter == store.end()) {
-        continue;
-      }
+  void glEnable(GLenum cap) {
+    GL_DEBUG("glEnable\n");
+
+    callMethod("enable", MKI(cap));
+  }
+
+  void glDisable(GLenum cap) {
+    GL_DEBUG("glDisable\n");
+
+    callMethod("disable", MKI(cap));
+  }
+
+  void glDisableVertexAttribArray(GLuint index) {
+    GL_DEBUG("glDisableVertexAttribArray\n");
+
+    callMethod("disableVertexAttribArray", MKI(index));
+  }
+
+  void glEnableVertexAttribArray(GLuint index) {
+    GL_DEBUG("glEnableVertexAttribArray\n");
+
+    callMethod("enableVertexAttribArray", MKI(index));
+  }
+
+  void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    GL_DEBUG("glDrawArrays\n");
+
+    Local<Value> args[3] = { MKI(mode), MKI(first), MKI(count) };
+    callMethod("drawArrays", ARG_COUNT, args);
+  }
+
+  void glFinish() {
+    GL_DEBUG("glFinish\n");
+
+    callMethod("finish");
+  }
+
+  void glFlush() {
+    GL_DEBUG("glFlush\n");
+
+    callMethod("flush");
+  }
+
+  void glGenBuffers(GLsizei n, GLuint *buffers) {
+    GL_DEBUG("glGenBuffers\n");
+
+    if (!buffers || n == 0) {
+      return;
+    }
+
+    if (n < 0) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    for (int j = 0; j < n; ++j) {
+      auto r = callMethod("createBuffer");
+      buffers[j] = r.IsEmpty() ? 0 : storeObject(_buffers, r);
+    }
+  }
+
+  void glGenTextures(GLsizei n, GLuint *textures) {
+    GL_DEBUG("glGenTextures\n");
+
+    if (!textures || n == 0) {
+      return;
+    }
+
+    if (n < 0) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    for (int j = 0; j < n; ++j) {
+      auto r = callMethod("createTexture");
+      textures[j] = r.IsEmpty() ? 0 : storeObject(_textures, r);
+    }
+  }
+
+  GLint glGetAttribLocation(GLuint program_id, const GLchar *name) {
+    GL_DEBUG("glGetAttribLocation\n");
+
+    auto prog_iter = _programs.find(program_id);
+    if (prog_iter == _programs.end()) {
+      // set GL_INVALID_OPERATION
+      return -1;
+    }
+
+    Local<Value> args[2] = { prog_iter->second->Get(_isolate), make_string(_isolate, name) };
+    auto r = callMethod("getAttribLocation", ARG_COUNT, args);
+    return r.IsEmpty()
+           ? -1
+           : static_cast<GLint>(r.As<Integer>()
+                   ->IntegerValue(_isolate->GetCurrentContext()).FromMaybe(-1));
+  }
+
+  GLenum glGetError() {
+    GL_DEBUG("glGetError\n");
+
+    auto result = callMethod("getError").As<Integer>();
+    auto err_code = static_cast<GLenum>(result->IntegerValue(_isolate->GetCurrentContext()).FromMaybe(0));
+    if (err_code != GL_NO_ERROR) {
+      GL_DEBUG("glError result: %ld\n", result->IntegerValue());
+    }
+    return err_code;
+  }
+
+  void glGetIntegerv(GLenum pname, GLint *params) {
+    GL_DEBUG("glGetIntegerv: %d\n", pname);
+
+    if (!params) {
+      return;
+    }
+
+    auto r = callMethod("getParameter", MKI(pname)).As<Integer>();
+    if (r.IsEmpty()) {
+      return;
+    }
+
+    switch (pname) {
+      case GL_PIXEL_PACK_BUFFER_BINDING:
+      case GL_PIXEL_UNPACK_BUFFER_BINDING:
+      case GL_TRANSFORM_FEEDBACK_BUFFER_BINDING:
+      case GL_UNIFORM_BUFFER_BINDING:
+        // convert to buffer index
+        *params = static_cast<GLint>(getIndexFromObject(_buffers, r));
+        break;
+
+      case GL_FRAMEBUFFER_BINDING:
+        // convert to framebuffer index
+        *params = static_cast<GLint>(getIndexFromObject(_framebuffers, r));
+        break;
+
+      case GL_CURRENT_PROGRAM:
+        // convert to program index
+        *params = static_cast<GLint>(getIndexFromObject(_programs, r));
+        break;
+
+      case GL_TEXTURE_BINDING_2D:
+      case GL_TEXTURE_BINDING_CUBE_MAP:
+        // convert to texture index
+        *params = static_cast<GLint>(getIndexFromObject(_textures, r));
+        break;
+
+      default:
+        if (r->IsBoolean()) {
+          *params = static_cast<GLint>(r->BooleanValue(_isolate->GetCurrentContext()).FromMaybe(false));
+        } else if (r->IsNumber()) {
+          *params = static_cast<GLint>(r->IntegerValue(_isolate->GetCurrentContext()).FromMaybe(0));
+        } else {
+          _throw_js("glGetIntegerv: unexpected return type");
+        }
+    }
+  }
+
+  void glGetShaderInfoLog(GLuint shader_id, GLsizei max_length, GLsizei *length, GLchar *info_log) {
+    GL_DEBUG("glGetShaderInfoLog\n");
+
+    getObjectInfoLog("getShaderInfoLog", _shaders, shader_id, max_length, length, info_log);
+  }
+
+  void glGetShaderiv(GLuint shader_id, GLenum pname, GLint *params) {
+    GL_DEBUG("glGetShaderiv\n");
+
+    getObjectiv("getShaderParameter", _shaders, shader_id, pname, params);
+  }
+
+  GLint glGetUniformLocation(GLuint program_id, const GLchar *name) {
+    GL_DEBUG("glGetUniformLocation\n");
+
+    auto prog_iter = _programs.find(program_id);
+    if (prog_iter == _programs.end()) {
+      // set GL_INVALID_VALUE
+      return -1;
+    }
+
+    Local<Value> args[2] = { prog_iter->second->Get(_isolate), make_string(_isolate, name) };
+    auto r = callMethod("getUniformLocation", ARG_COUNT, args);
+    return r.IsEmpty() ? -1 : storeObject(_uniforms, r);
+  }
+
+  void glPixelStorei(GLenum pname, GLint param) {
+    GL_DEBUG("glPixelStorei\n");
+
+    if (pname == GL_UNPACK_ALIGNMENT) {
+      GL_DEBUG("updaing unpack alignment, setting it to %d\n", param);
+      _gl_ctx->unpack_alignment = static_cast<size_t>(param);
+    } else if (pname == GL_PACK_ALIGNMENT) {
+      GL_DEBUG("updating pack alignment, setting it to %d\n", param);
+      _gl_ctx->pack_alignment = static_cast<size_t>(param);
+    } else if (pname == GL_UNPACK_ROW_LENGTH || pname == GL_PACK_ROW_LENGTH) {
+      _throw_js(("glPixelStorei called with unsupported pname = " + to_string(param)).c_str());
+      return;
+    }
+
+    Local<Value> args[2] = { MKI(pname), MKI(param) };
+    callMethod("pixelStorei", ARG_COUNT, args);
+  }
+
+  void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, GLvoid *data) {
+    GL_DEBUG("glReadPixels\n");
+
+    if (!data) {
+      return;
+    }
+
+    if (_gl_ctx->pixel_pack_buffer_bound) {
+      // read pixels to bound buffer, treat pointer as an offset (hope we are not gonna use huuuuge buffers)
+      auto offset = reinterpret_cast<intptr_t>(data);
+      Local<Value> args[7] = { MKI(x), MKI(y), MKI(width), MKI(height), MKI(format),
+                            MKI(type), MKIU(static_cast<uint32_t>(offset)) };
+      callMethod("readPixels", ARG_COUNT, args);
+      return;
+    }
+
+    size_t pixel_count = static_cast<size_t>(width) * static_cast<size_t>(height);
+    size_t bytes_per_pixel = bytesPerPixel(type, format);
+
+    Local<ArrayBuffer> buf = backingBuffer(pixel_count * bytes_per_pixel, BB_GENERIC);
+    Local<Value> buf_view = bufForType(type, buf, pixel_count, bytes_per_pixel);
+    if (buf_view.IsEmpty()) {
+      _throw_js(("glReadPixels: unsupported data format = " + to_string(type)).c_str());
+      return;
+    }
+
+    TryCatch try_catch(_isolate);
+    Local<Value> args[7] = { MKI(x), MKI(y), MKI(width), MKI(height), MKI(format), MKI(type), buf_view };
+    callMethod("readPixels", ARG_COUNT, args);
+    if (try_catch.HasCaught()) {
+      try_catch.ReThrow();
+      return;
+    }
+    if (glGetError() != GL_NO_ERROR) {
+      _throw_js("glReadPixels: error while reading pixels");
+      return;
+    }
+
+    size_t row_bytes_aligned = alignToPackBoundary(width * bytes_per_pixel);
+    if (row_bytes_aligned == width * bytes_per_pixel) {
+      memcpy(data, buf->GetContents().Data(), pixel_count * bytes_per_pixel);
+    } else {
+      auto buf_data = static_cast<const GLubyte*>(buf->GetContents().Data());
+      auto dst_data = static_cast<GLubyte*>(data);
+
+      for (GLsizei q = 0; q < height; ++q) {
+        memcpy(dst_data, buf_data, width * bytes_per_pixel);
+        buf_data += width * bytes_per_pixel;
+        dst_data += row_bytes_aligned;
+      }
+    }
+  }
+
+  void glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+    GL_DEBUG("glScissor\n");
+
+    Local<Value> args[4] = { MKI(x), MKI(y), MKI(width), MKI(height) };
+    callMethod("scissor", ARG_COUNT, args);
+  }
+
+  void glTexImage2D(GLenum target, GLint level, GLint internal_format, GLsizei width,
+                    GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *data) {
+    GL_DEBUG("glTexImage2D\n");
+
+    if (target != GL_TEXTURE_2D) {
+      _throw_js(("glTexImage2D: unsupported target = " + to_string(target)).c_str());
+      return;
+    }
+
+    if (_gl_ctx->pixel_unpack_buffer_bound) {
+      // load data from bound buffer
+      auto offset = reinterpret_cast<intptr_t>(data);
+      Local<Value> args[9] = { MKI(target), MKI(level), MKI(internal_format), MKI(width),
+                               MKI(height), MKI(border), MKI(format), MKI(type),
+                               MKIU(static_cast<uint32_t>(offset)) };
+      callMethod("texImage2D", ARG_COUNT, args);
+      return;
+    }
+
+    if (!data) {
+      // data may be a null pointer. In this case, texture memory is allocated to accommodate
+      // a texture of width width and height height.
+      Local<Value> args[9] = { MKI(target), MKI(level), MKI(internal_format), MKI(width),
+                               MKI(height), MKI(border), MKI(format), MKI(type), Null(_isolate) };
+      callMethod("texImage2D", ARG_COUNT, args);
+    } else {
+      auto bufs = getTexBuffers(type, format, width, height, data);
+      if (bufs.second.IsEmpty()) {
+        _throw_js(("glTexImage2D: unsupported type: " + to_string(type)).c_str());
+        return;
+      }
+
+      Local<Value> args[10] = { MKI(target), MKI(level), MKI(internal_format), MKI(width),
+                                MKI(height), MKI(border), MKI(format), MKI(type), bufs.second, MKI(0) };
+      callMethod("texImage2D", ARG_COUNT, args);
+    }
+  }
+
+  void glTexParameteri(GLenum target, GLenum pname, GLint param) {
+    GL_DEBUG("glTexParameteri\n");
+
+    Local<Value> args[3] = { MKI(target), MKI(pname), MKI(param) };
+    callMethod("texParameteri", ARG_COUNT, args);
+  }
+
+  void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width,
+                       GLsizei height, GLenum format, GLenum type, const GLvoid *pixels) {
+    GL_DEBUG("glTexSubImage2D\n");
+
+    if (_gl_ctx->pixel_unpack_buffer_bound) {
+      // load data from bound buffer
+      auto offset = reinterpret_cast<intptr_t>(pixels);
+      Local<Value> args[9] = { MKI(target), MKI(level), MKI(xoffset), MKI(yoffset),
+                               MKI(width), MKI(height), MKI(format), MKI(type),
+                               MKIU(static_cast<uint32_t>(offset)) };
+      callMethod("texSubImage2D", ARG_COUNT, args);
+      return;
+    }
+
+    auto bufs = getTexBuffers(type, format, width, height, pixels);
+    if (bufs.second.IsEmpty()) {
+      _throw_js(("glTexSubImage2D: unsupported type: " + to_string(type)).c_str());
+      return;
+    }
+
+    Local<Value> args[9] = { MKI(target), MKI(level), MKI(xoffset), MKI(yoffset),
+                             MKI(width), MKI(height), MKI(format), MKI(type), bufs.second };
+    callMethod("texSubImage2D", ARG_COUNT, args);
+  }
+
+  void glUniform1f(GLint location, GLfloat v0) {
+    GL_DEBUG("glUniform1f\n");
+
+    Local<Value> args[2] = { Local<Value>(), MKN(v0) };
+    callLocationMethod("uniform1f", location, ARG_COUNT, args);
+  }
+
+  void glUniform2f(GLint location, GLfloat v0, GLfloat v1) {
+    GL_DEBUG("glUniform2f\n");
+
+    Local<Value> args[3] = { Local<Value>(), MKN(v0), MKN(v1) };
+    callLocationMethod("uniform2f", location, ARG_COUNT, args);
+  }
+
+  void glUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {
+    GL_DEBUG("glUniform3f\n");
+
+    Local<Value> args[4] = { Local<Value>(), MKN(v0), MKN(v1), MKN(v2) };
+    callLocationMethod("uniform3f", location, ARG_COUNT, args);
+  }
+
+  void glUniform1i(GLint location, GLint v0) {
+    GL_DEBUG("glUniform1i\n");
+
+    Local<Value> args[2] = { Local<Value>(), MKN(v0) };
+    callLocationMethod("uniform1i", location, ARG_COUNT, args);
+  }
+
+  void glUniformMatrix2fv(GLint location, GLsizei matrix_count, GLboolean transpose, const GLfloat *value) {
+    GL_DEBUG("glUniformMatrix2fv\n");
+
+    if (matrix_count != 1) {
+      _throw_js(("glUniformMatrix2fv: unsupported parameter matrix_count = " + to_string(matrix_count)).c_str());
+      return;
+    }
+
+    uniformMatrix("uniformMatrix2fv", 2, location, transpose, value);
+  }
+
+  void glUniformMatrix3fv(GLint location, GLsizei matrix_count, GLboolean transpose, const GLfloat *value) {
+    GL_DEBUG("glUniformMatrix3fv\n");
+
+    if (matrix_count != 1) {
+      _throw_js(("glUniformMatrix3fv: unsupported parameter matrix_count = " + to_string(matrix_count)).c_str());
+      return;
+    }
+
+    uniformMatrix("uniformMatrix3fv", 3, location, transpose, value);
+  }
+
+  void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                             GLsizei stride, const GLvoid *pointer) {
+    GL_DEBUG("glVertexAttribPointer\n");
+
+    auto low_pointer = static_cast<uint32_t>(reinterpret_cast<uint64_t>(pointer));
+
+    Local<Value> args[6] = { MKI(index), MKI(size), MKI(type),
+                             Boolean::New(_isolate, normalized), MKI(stride),
+                             Integer::NewFromUnsigned(_isolate, low_pointer) };
+    callMethod("vertexAttribPointer", ARG_COUNT, args);
+  }
+
+  void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    GL_DEBUG("glViewport\n");
+
+    Local<Value> args[4] = { MKI(x), MKI(y), MKI(width), MKI(height) };
+    callMethod("viewport", ARG_COUNT, args);
+  }
+
+  void glBindFramebuffer(GLenum target, GLuint framebuffer) {
+    GL_DEBUG("glBindFramebuffer\n");
+
+    if (framebuffer == 0) {
+      Local<Value> args[2] = { MKI(target), Null(_isolate) };
+      callMethod("bindFramebuffer", ARG_COUNT, args);
+      return;
+    }
+
+    auto fb_iter = _framebuffers.find(framebuffer);
+    if (fb_iter == _framebuffers.end()) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    Local<Value> args[2] = { MKI(target), fb_iter->second->Get(_isolate) };
+    callMethod("bindFramebuffer", ARG_COUNT, args);
+  }
+
+  void glGenFramebuffers(GLsizei n, GLuint *ids) {
+    GL_DEBUG("glGenFramebuffers\n");
+
+    if (!ids || n == 0) {
+      return;
+    }
+
+    if (n < 0) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    for (int j = 0; j < n; ++j) {
+      auto r = callMethod("createFramebuffer");
+      ids[j] = r.IsEmpty() ? 0 : storeObject(_framebuffers, r);
+    }
+  }
+
+  void glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers) {
+    GL_DEBUG("glDeleteFramebuffers\n");
+
+    deleteObjects("deleteFramebuffer", _framebuffers, n, framebuffers);
+  }
+
+  GLenum glCheckFramebufferStatus(GLenum target) {
+    GL_DEBUG("glCheckFramebufferStatus\n");
+
+    auto r = callMethod("checkFramebufferStatus", MKI(target))->IntegerValue(_isolate->GetCurrentContext());
+    return static_cast<GLenum>(r.FromMaybe(0));
+  }
+
+  void glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) {
+    GL_DEBUG("glFramebufferTexture2D\n");
+
+    auto tex_iter = _textures.find(texture);
+    if (tex_iter == _textures.end()) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    Local<Value> args[5] = { MKI(target), MKI(attachment), MKI(textarget),
+                             tex_iter->second->Get(_isolate), MKI(level) };
+    callMethod("framebufferTexture2D", ARG_COUNT, args);
+  }
+
+  void glGetFramebufferAttachmentParameteriv(GLenum target, GLenum attachment, GLenum pname, GLint *params) {
+    GL_DEBUG("glGetFramebufferAttachmentParameteriv\n");
+
+    if (!params) {
+      return;
+    }
+
+    Local<Value> args[3] = { MKI(target), MKI(pname), MKI(pname) };
+    auto r = callMethod("getFramebufferAttachmentParameter", ARG_COUNT, args).As<Integer>();
+    if (!r.IsEmpty()) {
+      auto result = r->IntegerValue(_isolate->GetCurrentContext());
+      if (result.IsJust()) {
+        *params = static_cast<GLint>(result.FromMaybe(0));
+      }
+    }
+  }
+
+  /** Helper functions **/
+
+  inline Local<Object> localContext()const { return _gl_ctx->context->Get(_isolate); }
+
+  inline Local<Function> localMethod(const string &method_name) {
+    auto m = method(method_name);
+    return m ? m->Get(_isolate) : Local<Function>();
+  }
+
+  shared_ptr<Persistent<Function>> method(const string &method_name) {
+    if (!_gl_ctx || !_gl_ctx->context) {
+      return nullptr;
+    }
+
+    // check if we have cached the requested method
+    auto ex_iter = _gl_ctx->methods.find(method_name);
+    if (ex_iter != _gl_ctx->methods.end()) {
+      return ex_iter->second;
+    }
+
+    // if not, get the method from rendering context and cache it
+    auto method = get_method(_isolate, _gl_ctx->context, method_name.c_str());
+    if (method.IsEmpty() || method->IsNull() || method->IsUndefined()) {
+      _throw_js(("failed to get rendering context method " + method_name).c_str());
+      return shared_ptr<Persistent<Function>>();
+    }
+    auto pers = pers_ptr(new Persistent<Function>(_isolate, method));
+    _gl_ctx->methods[method_name] = pers;
+    return pers;
+  }
+
+  Local<Value> callMethod(const string &method_name, int argc, const Local<Value> *args) {
+    return localMethod(method_name)->Call(_isolate->GetCurrentContext(),
+                                          localContext(), argc, const_cast<Local<Value>*>(args)).ToLocalChecked();
+  }
+
+  Local<Value> callMethod(const string &method_name, const Local<Value> &arg) {
+    return localMethod(method_name)->Call(_isolate->GetCurrentContext(),
+                                          localContext(), 1, const_cast<Local<Value>*>(&arg)).ToLocalChecked();
+  }
+
+  Local<Value> callMethod(const string &method_name) {
+    Local<Value> dummy;
+    return localMethod(method_name)
+      ->Call(_isolate->GetCurrentContext(), localContext(), 0, &dummy).ToLocalChecked();
+  }
+
+  template<class T>
+  T storeObject(map<T, shared_ptr<Persistent<Value>>> &store, const Local<Value> &value) {
+    T object_id = newId();
+    store[object_id] = pers_ptr(new Persistent<Value>(_isolate, value));
+    return object_id;
+  }
+
+  template<class T>
+  T getIndexFromObject(map<T, shared_ptr<Persistent<Value>>> &store, const Local<Value> &value)const {
+    for (auto obj_iter = store.begin(); obj_iter != store.end(); ++obj_iter) {
+      if (value == *(obj_iter->second)) {
+        return obj_iter->first;
+      }
+    }
+    return 0;
+  }
+
+  size_t alignToUnpackBoundary(size_t value) {
+    return alignToBoundary(value, _gl_ctx->unpack_alignment);
+  }
+
+  size_t alignToPackBoundary(size_t value) {
+    return alignToBoundary(value, _gl_ctx->pack_alignment);
+  }
+
+  static size_t alignToBoundary(size_t value, size_t boundary) {
+    return (value + boundary - 1) & ~(boundary - 1);
+  }
+
+  static size_t bytesPerPixel(GLenum type, GLenum format) {
+    size_t type_c = 0, format_c = 0;
+
+    switch (type) {
+      case GL_UNSIGNED_INT_2_10_10_10_REV:        return 4;
+      case GL_UNSIGNED_SHORT_5_6_5:               return 2;
+      case GL_UNSIGNED_SHORT_8_8_APPLE:           return 2;
+      case GL_UNSIGNED_SHORT_8_8_REV_APPLE:       return 2;
+      default:                                    break;
+    }
+
+    switch (type) {
+      case GL_UNSIGNED_BYTE:                      type_c = 1; break;
+      case GL_UNSIGNED_SHORT:                     type_c = 2; break;
+      case GL_FLOAT:                              type_c = 4; break;
+      default:                                    return 0;
+    }
+
+    switch (format) {
+      case GL_RED:
+      case GL_RED_INTEGER:
+      case GL_LUMINANCE:
+        format_c = 1;
+        break;
+
+      case GL_RG:
+      case GL_RG_INTEGER:
+      case GL_LUMINANCE_ALPHA:
+        format_c = 2;
+        break;
+
+      case GL_RGB:
+      case GL_RGB_INTEGER:
+        format_c = 3;
+        break;
+
+      case GL_RGBA:
+      case GL_RGBA_INTEGER:
+        format_c = 4;
+        break;
+
+      default:
+        return 0;
+    }
+
+    return type_c * format_c;
+  }
+
+  Local<Value> bufForType(GLenum type, const Local<ArrayBuffer> &buf, size_t pixel_count, size_t bytes_per_pixel) {
+    switch (type) {
+      case GL_UNSIGNED_BYTE:
+        return Uint8Array::New(buf, 0, pixel_count * (bytes_per_pixel / sizeof(GLubyte)));
+        break;
+
+      case GL_UNSIGNED_SHORT:
+      case GL_UNSIGNED_SHORT_5_6_5:
+      case GL_UNSIGNED_SHORT_4_4_4_4:
+      case GL_UNSIGNED_SHORT_5_5_5_1:
+      case GL_HALF_FLOAT:
+        return Uint16Array::New(buf, 0, pixel_count * (bytes_per_pixel / sizeof(GLushort)));
+        break;
+
+      case GL_UNSIGNED_INT:
+      case GL_UNSIGNED_INT_24_8:
+        return Uint32Array::New(buf, 0, pixel_count * (bytes_per_pixel / sizeof(GLuint)));
+        break;
+
+      case GL_FLOAT:
+        return Float32Array::New(buf, 0, pixel_count * (bytes_per_pixel / sizeof(GLfloat)));
+        break;
+
+      default:
+        return Local<Value>();
+    }
+  }
+
+  pair<Local<ArrayBuffer>, Local<Value>> getTexBuffers(GLenum type, GLenum format, GLsizei width,
+                                                             GLsizei height, const GLvoid *data) {
+    size_t pixel_count = static_cast<size_t>(width) * static_cast<size_t>(height);
+    size_t bytes_per_pixel = bytesPerPixel(type, format);
+
+    // Unfortunately, chromium does not accept externalized buffers for webgl methods (externalized buffers in this case should be created by chromium itself), so we have to copy entire data to the new buffer and give ownership to v8.
+    // mpv uploads frames as textures, so this function is a resource hog.
+    // Due to this, we should reuse a single buffer to avoid creating a ton of ArrayBuffers for each frame
+    Local<ArrayBuffer> buf = backingBuffer(pixel_count * bytes_per_pixel, BB_TEX);
+
+    size_t row_bytes_aligned = alignToUnpackBoundary(width * bytes_per_pixel);
+    if (row_bytes_aligned == width * bytes_per_pixel) {
+      // smooth rows, without gaps between them, we can copy it with one call
+      memcpy(buf->GetContents().Data(), data, pixel_count * bytes_per_pixel);
+    } else {
+      // things got worse, there are alignment gaps between rows, and webgl does not support it.
+      // we have to copy rows one-by-one and skip alignment gaps
+      auto buf_data = static_cast<GLubyte*>(buf->GetContents().Data());
+      auto src_data = static_cast<const GLubyte*>(data);
+
+      for (GLsizei q = 0; q < height; ++q) {
+        memcpy(buf_data, src_data, width * bytes_per_pixel);
+        buf_data += width * bytes_per_pixel;
+        src_data += row_bytes_aligned;
+      }
+    }
+
+    return { buf, bufForType(type, buf, pixel_count, bytes_per_pixel) };
+  }
+
+  void getObjectiv(const char *webgl_method, const ObjectStore &store, GLuint object_id,
+                   GLenum pname, GLint *params) {
+    if (!params) {
+      return;
+    }
+
+    auto obj_iter = store.find(object_id);
+    if (obj_iter == store.end()) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    if (pname == GL_INFO_LOG_LENGTH) {
+      *params = 1024 * 10;
+      GL_DEBUG("simulating GL_INFO_LOG_LENGTH parameter...\n");
+      return;
+    } else if (pname == GL_SHADER_SOURCE_LENGTH || pname == GL_ACTIVE_UNIFORM_MAX_LENGTH
+               || pname == GL_ACTIVE_ATTRIBUTE_MAX_LENGTH) {
+      _throw_js(("getting shader or program paratemer: unsupported pname value = " + to_string(pname)).c_str());
+      return;
+    }
+
+    Local<Value> args[2] = { obj_iter->second->Get(_isolate), MKI(pname) };
+    auto result = callMethod(webgl_method, ARG_COUNT, args);
+    if (result->IsNumber() || result->IsNumberObject()) {
+      auto maybe_int = result->IntegerValue(_isolate->GetCurrentContext());
+      if (maybe_int.IsJust()) {
+        *params = static_cast<GLint>(maybe_int.FromMaybe(0));
+      }
+    } else if (result->IsBoolean() || result->IsBooleanObject()) {
+      auto maybe_bool = result->BooleanValue(_isolate->GetCurrentContext());
+      if (maybe_bool.IsJust()) {
+        *params = static_cast<GLint>(maybe_bool.FromMaybe(false));
+      }
+    } else {
+      _throw_js(("getting shader or program paramater: returned value is not an integer and not an boolean, pname = "
+                 + to_string(pname)).c_str());
+    }
+  }
+
+  void getObjectInfoLog(const char *webgl_method, const ObjectStore &store, GLuint object_id,
+                        GLsizei max_length, GLsizei *length, GLchar *info_log) {
+    Local<Context> ctx = _isolate->GetCurrentContext();
+
+    if (!info_log || max_length == 0) {
+      return;
+    }
+
+    if (max_length < 0) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    auto obj_iter = store.find(object_id);
+    if (obj_iter == store.end()) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    auto result = callMethod(webgl_method, obj_iter->second->Get(_isolate))->ToString(ctx);
+    if (result.IsEmpty()) {
+      return;
+    }
+
+    int written = result.ToLocalChecked()->WriteUtf8(info_log, max_length - 1,
+                                                     nullptr, String::NO_NULL_TERMINATION);
+    info_log[written + 1] = 0;
+    if (length) {
+      *length = written + 1;
+    }
+  }
+
+  void deleteObjects(const string &webgl_method, ObjectStore &store, GLsizei n, const GLuint *objects) {
+    if (!objects || n == 0) {
+      return;
+    }
+
+    if (n < 0) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    for (int j = 0; j < n; ++j) {
+      auto object_iter = store.find(objects[j]);
+      if (object_iter == store.end()) {
+        continue;
+      }
+
+      callMethod(webgl_method, object_iter->second->Get(_isolate));
+      if (glGetError() == GL_NO_ERROR) {
+        store.erase(object_iter);
+      }
+    }
+  }
+
+  void callLocationMethod(const string &webgl_method, GLint location_id, int argc, Local<Value> *args) {
+    auto uni_iter = _uniforms.find(location_id);
+    if (uni_iter == _uniforms.end()) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    args[0] = uni_iter->second->Get(_isolate);
+    callMethod(webgl_method, argc, args);
+  }
+
+  void uniformMatrix(const string &method, int matrix_size, GLint location, GLboolean transpose,
+                     const GLfloat *value) {
+    auto loc_iter = _uniforms.find(location);
+    if (loc_iter == _uniforms.end()) {
+      // set GL_INVALID_VALUE
+      return;
+    }
+
+    int matrix_elem_count = matrix_size * matrix_size;
+
+    auto buf = backingBuffer(matrix_elem_count * sizeof(GLfloat), BB_UNIFORM);
+    memcpy(buf->GetContents().Data(), value, matrix_elem_count * sizeof(GLfloat));
+    auto buf_view = Float32Array::New(buf, 0, static_cast<size_t>(matrix_elem_count));
+
+    Local<Value> args[3] = { loc_iter->second->Get(_isolate), Boolean::New(_isolate, transpose), buf_view };
+    callMethod(method, ARG_COUNT, args);
+  }
+
+  void _throw_js(const char *msg) {
+    throw_js(_isolate, msg);
+  }
+
+  mpv_opengl_cb_context *gl()const { return _mpv_gl; }
+  mpv_handle *mpv()const { return _mpv; }
+
+  Local<ArrayBuffer> backingBuffer(size_t size, BUF_ROLE buf_role) {
+    auto it = _gl_ctx->backing_bufs.find(buf_role);
+    if (it != _gl_ctx->backing_bufs.end() && it->second && !it->second->IsEmpty()) {
+      Local<ArrayBuffer> buf = it->second->Get(_isolate);
+      if (buf->ByteLength() >= size) {
+        return buf;
+      }
+    }
+
+    Local<ArrayBuffer> buf = ArrayBuffer::New(_isolate, size);
+    auto pers = pers_ptr(new Persistent<ArrayBuffer>(_isolate, buf));
+
+    if (it != _gl_ctx->backing_bufs.end()) {
+      it->second.reset();
+      it->second = pers;
+    } else {
+      _gl_ctx->backing_bufs[buf_role] = pers;
+    }
+
+    return buf;
+  }
+
+  /** Data members **/
+
+  static thread_local MPImpl *_current;
+  PlayerOptions _options;
+  map<uint64_t, shared_ptr<PropertyRegistration>> _registrations;
+  uint64_t _last_registration_id = 0;
+  map<uint64_t, shared_ptr<PropertyObserver>> _observers;
+  uint64_t _last_observer_id = 0;
+  NodeArena _node_arena; // reused by all js values converted for this player
+  map<mpv_event_id, shared_ptr<ListenerList>> _event_listeners;
+  uint64_t _requested_events = 0;
+  mutex _log_sink_lock;
+  shared_ptr<LogSink> _log_sink;
+  shared_ptr<Persistent<Function>> _log_handler;
+  mutex _watches_lock;
+  map<uint64_t, PropertyWatch> _watches;
+  map<uint64_t, shared_ptr<Persistent<Function>>> _watch_handlers;
+  uint64_t _last_watch_id = 0;
+  mutex _mirrored_props_lock;
+  vector<MirroredProperty> _mirrored_props;
+  vector<MirrorBuffer> _mirror_buffers;
+  Isolate *_isolate;
+  shared_ptr<Persistent<Object>> _canvas;
+  shared_ptr<SharedGlContext> _gl_ctx;
+  mpv_handle *_mpv = nullptr;
+  mpv_opengl_cb_context *_mpv_gl = nullptr;
+  ObjectStore _programs;
+  ObjectStore _shaders;
+  ObjectStore _buffers;
+  ObjectStore _textures;
+  ObjectStore _framebuffers;
+  map<GLint, shared_ptr<Persistent<Value>>> _uniforms;
+  GLuint _last_id = 0;
+  ctx_dim _dim;
+  uv_loop_t *_loop = nullptr;
+  AddonData *_addon = nullptr;
+  uv_async_t *_update_handle = nullptr, *_wakeup_handle = nullptr;
+  atomic<bool> _render_pending { false };
+  thread _event_thread;
+  atomic<bool> _event_thread_stop { false };
+  SpscQueue<QueuedEvent*, 1024> _events;
+  uv_timer_t *_flush_timer = nullptr, *_log_timer = nullptr;
+  uint64_t _flush_at = 0;
+  GLuint _target_fbo = 0;
+  bool _target_stored = false, _target_owns_fbo = false;
+  ctx_dim _target_dim;
+  map<int, MirrorTarget> _mirrors;
+  int _last_mirror_id = 0;
+  OffscreenTarget _offscreen;
+
+  GLuint newId() { return ++_last_id; }
+};
+
+thread_local MPImpl *MPImpl::_current = nullptr;
+
+/*************************************************************************************
+ * Some helpers
+ *************************************************************************************/
+
+static void cleanup_addon_data(void *arg) {
+  auto addon = static_cast<AddonData*>(arg);
+
+  for (auto player : addon->players) {
+    DEBUG("Environment is being torn down, but dispose function has not been called for MpvPlayer object\n");
+    player->abandon();
+    player->_addon = nullptr;
+  }
+
+  addon->constructor.Reset();
+  delete addon;
+  release_conversion_cache();
+}
+
+static const char *MPV_PLAYER_CLASS = "MpvPlayer";
+
+/*************************************************************************************
+ * MpvPlayer
+ *************************************************************************************/
+
+/**
+ * This function is called by libuv to process new lbimpv frames.
+ * It is always called on the main thread.
+ */
+void do_update(uv_async_t *handle) {
+  auto impl = static_cast<MPImpl*>(handle->data);
+  if (impl) {
+    HandleScope scope(impl->_isolate);
+
+    impl->renderIfPending();
+  }
+}
+
+/**
+ * This function is called by mpv itself when it has something to draw.
+ * It can be called from any thread, so we should ask libuv to call the corresponding callback registered with uv_async_init.
+ * The event pump checks the pending flag too, so a frame can be drawn between events without waiting for do_update.
+ */
+void mpv_async_update_cb(void *ctx) {
+  auto impl = static_cast<MPImpl*>(ctx);
+  impl->_render_pending = true;
+  uv_async_send(impl->_update_handle);
+}
+
+/**
+ * This function is called by libuv when the event thread has queued new libmpv events.
+ * it is always called on the main thread.
+ */
+void do_wakeup(uv_async_t *handle) {
+  auto impl = static_cast<MPImpl*>(handle->data);
+  if (impl && impl->mpv()) {
+    HandleScope scope(impl->_isolate);
+
+    impl->pumpEvents();
+  }
+}
+
+/*************************************************************************************
+ * Crazy bunch of wrappers around gl methods on MpvPlayerImpl class
+ *************************************************************************************/
+
+#define QUOTE(arg) #arg
+#define DEF_FN(FUN_NAME) { QUOTE(gl##FUN_NAME), (void*)GlWrappers::gl##FUN_NAME }
+
+namespace GlWrappers {
+  void glActiveTexture(GLenum texture) { MPImpl::current()->glActiveTexture(texture); }
+
+  const GLubyte *glGetString(GLenum name) { return MPImpl::current()->glGetString(name); }
+
+  GLuint glCreateProgram() { return MPImpl::current()->glCreateProgram(); }
+
+  void glDeleteProgram(GLuint program) { MPImpl::current()->glDeleteProgram(program); }
+
+  void glGetProgramInfoLog(GLuint program, GLsizei max_length, GLsizei *length, GLchar *info_log) {
+    MPImpl::current()->glGetProgramInfoLog(program, max_length, length, info_log);
+  }
+
+  void glGetProgramiv(GLuint program, GLenum pname, GLint *params) {
+    MPImpl::current()->glGetProgramiv(program, pname, params);
+  }
+
+  void glLinkProgram(GLuint program) { MPImpl::current()->glLinkProgram(program); }
+
+  void glUseProgram(GLuint program) { MPImpl::current()->glUseProgram(program); }
+
+  GLuint glCreateShader(GLenum shader_type) { return MPImpl::current()->glCreateShader(shader_type); }
+
+  void glDeleteShader(GLuint shader_id) { MPImpl::current()->glDeleteShader(shader_id); }
+
+  void glAttachShader(GLuint program_id, GLuint shader_id) {
+    MPImpl::current()->glAttachShader(program_id, shader_id);
+  }
+
+  void glCompileShader(GLuint shader_id) { MPImpl::current()->glCompileShader(shader_id); }
+
+  void glBindAttribLocation(GLuint program_id, GLuint index, const GLchar *name) {
+    MPImpl::current()->glBindAttribLocation(program_id, index, name);
+  }
+
+  void glBindBuffer(GLenum target, GLuint buffer) { MPImpl::current()->glBindBuffer(target, buffer); }
+
+  void glBindTexture(GLenum target, GLuint texture) { MPImpl::current()->glBindTexture(target, texture); }
+
+  void glBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAplha, GLenum dstAplha) {
+    MPImpl::current()->glBlendFuncSeparate(srcRGB, dstRGB, srcAplha, dstAplha);
+  }
+
+  void glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data,
+                        GLenum usage) { MPImpl::current()->glBufferData(target, size, data, usage); }
+
+  void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
+                           const GLvoid *data) { MPImpl::current()->glBufferSubData(target, offset, size, data); }
+
+  void glClear(GLbitfield mask) { MPImpl::current()->glClear(mask); }
+
+  void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
+    MPImpl::current()->glClearColor(red, green, blue, alpha);
+  }
+
+  void glDeleteBuffers(GLsizei n, const GLuint *buffers) { MPImpl::current()->glDeleteBuffers(n, buffers); }
+
+  void glDeleteTextures(GLsizei n, const GLuint *textures) { MPImpl::current()->glDeleteTextures(n, textures); }
+
+  void glEnable(GLenum cap) { MPImpl::current()->glEnable(cap); }
+
+  void glDisable(GLenum cap) { MPImpl::current()->glDisable(cap); }
+
+  void glDisableVertexAttribArray(GLuint index) { MPImpl::current()->glDisableVertexAttribArray(index); }
+
+  void glEnableVertexAttribArray(GLuint index) { MPImpl::current()->glEnableVertexAttribArray(index); }
+
+  void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    MPImpl::current()->glDrawArrays(mode, first, count);
+  }
+
+  void glFinish() { MPImpl::current()->glFinish(); }
+
+  void glFlush() { MPImpl::current()->glFlush(); }
+
+  void glGenBuffers(GLsizei n, GLuint *buffers) { MPImpl::current()->glGenBuffers(n, buffers); }
+
+  void glGenTextures(GLsizei n, GLuint *textures) { MPImpl::current()->glGenTextures(n, textures); }
+
+  GLint glGetAttribLocation(GLuint program_id, const GLchar *name) {
+    return MPImpl::current()->glGetAttribLocation(program_id, name);
+  }
+
+  GLenum glGetError() { return MPImpl::current()->glGetError(); }
+
+  void glGetIntegerv(GLenum pname, GLint *params) { MPImpl::current()->glGetIntegerv(pname, params); }
+
+  void glGetShaderInfoLog(GLuint shader_id, GLsizei max_length, GLsizei *length, GLchar *info_log) {
+    MPImpl::current()->glGetShaderInfoLog(shader_id, max_length, length, info_log);
+  }
+
+  void glGetShaderiv(GLuint shader_id, GLenum pname, GLint *params) {
+    MPImpl::current()->glGetShaderiv(shader_id, pname, params);
+  }
+
+  GLint glGetUniformLocation(GLuint program, const GLchar *name) {
+    return MPImpl::current()->glGetUniformLocation(program, name);
+  }
+
+  void glPixelStorei(GLenum pname, GLint param) { MPImpl::current()->glPixelStorei(pname, param); }
+
+  void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type,
+                        GLvoid *data) { MPImpl::current()->glReadPixels(x, y, width, height, format, type, data); }
+
+  void glShaderSource(GLuint shader_id, GLsizei count, const GLchar **str, const GLint *length) {
+    MPImpl::current()->glShaderSource(shader_id, count, str, length);
+  }
+
+  void glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+    MPImpl::current()->glScissor(x, y, width, height);
+  }
+
+  void glTexImage2D(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLint border,
+                        GLenum format, GLenum type, const GLvoid *data) {
+    MPImpl::current()->glTexImage2D(target, level, internal_format, width, height, border, format, type, data);
+  }
+
+  void glTexParameteri(GLenum target, GLenum pname, GLint param) {
+    MPImpl::current()->glTexParameteri(target, pname, param);
+  }
+
+  void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+                           GLenum format, GLenum type, const GLvoid *pixels) {
+    MPImpl::current()->glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+  }
+
+  void glUniform1f(GLint location, GLfloat v0) { MPImpl::current()->glUniform1f(location, v0); }
+
+  void glUniform2f(GLint location, GLfloat v0, GLfloat v1) { MPImpl::current()->glUniform2f(location, v0, v1); }
+
+  void glUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {
+    MPImpl::current()->glUniform3f(location, v0, v1, v2);
+  }
+
+  void glUniform1i(GLint location, GLint v0) { MPImpl::current()->glUniform1i(location, v0); }
+
+  void glUniformMatrix2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+    MPImpl::current()->glUniformMatrix2fv(location, count, transpose, value);
+  }
+
+  void glUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
+    MPImpl::current()->glUniformMatrix3fv(location, count, transpose, value);
+  }
+
+  void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+                                 const GLvoid *pointer) {
+    MPImpl::current()->glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+  }
+
+  void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    MPImpl::current()->glViewport(x, y, width, height);
+  }
+
+  void glBindFramebuffer(GLenum target, GLuint framebuffer) {
+    MPImpl::current()->glBindFramebuffer(target, framebuffer);
+  }
+
+  void glGenFramebuffers(GLsizei n, GLuint *ids) { MPImpl::current()->glGenFramebuffers(n, ids); }
+
+  void glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers) {
+    MPImpl::current()->glDeleteFramebuffers(n, framebuffers);
+  }
+
+  GLenum glCheckFramebufferStatus(GLenum target) { return MPImpl::current()->glCheckFramebufferStatus(target); }
+
+  void glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) {
+    MPImpl::current()->glFramebufferTexture2D(target, attachment, textarget, texture, level);
+  }
+
+  void glGetFramebufferAttachmentParameteriv(GLenum target, GLenum attachment, GLenum pname, GLint *params) {
+    MPImpl::current()->glGetFramebufferAttachmentParameteriv(target, attachment, pname, params);
+  }
+}
+
+static map<string, void*> gl_func_map = {
+  DEF_FN(ActiveTexture),
+  DEF_FN(AttachShader),
+  DEF_FN(BindAttribLocation),
+  DEF_FN(BindBuffer),
+  DEF_FN(BindTexture),
+  DEF_FN(BlendFuncSeparate),
+  DEF_FN(BufferData),
+  DEF_FN(BufferSubData),
+  DEF_FN(Clear),
+  DEF_FN(ClearColor),
+  DEF_FN(CompileShader),
+  DEF_FN(CreateProgram),
+  DEF_FN(CreateShader),
+  DEF_FN(DeleteBuffers),
+  DEF_FN(DeleteProgram),
+  DEF_FN(DeleteShader),
+  DEF_FN(DeleteTextures),
+  DEF_FN(Disable),
+  DEF_FN(DisableVertexAttribArray),
+  DEF_FN(DrawArrays),
+  DEF_FN(Enable),
+  DEF_FN(EnableVertexAttribArray),
+  DEF_FN(Finish),
+  DEF_FN(Flush),
+  DEF_FN(GenBuffers),
+  DEF_FN(GenTextures),
+  DEF_FN(GetAttribLocation),
+  DEF_FN(GetError),
+  DEF_FN(GetIntegerv),
+  DEF_FN(GetProgramInfoLog),
+  DEF_FN(GetProgramiv),
+  DEF_FN(GetShaderInfoLog),
+  DEF_FN(GetShaderiv),
+  DEF_FN(GetString),
+  DEF_FN(GetUniformLocation),
+  DEF_FN(LinkProgram),
+  DEF_FN(PixelStorei),
+  DEF_FN(ReadPixels),
+  DEF_FN(Scissor),
+  DEF_FN(ShaderSource),
+  DEF_FN(TexImage2D),
+  DEF_FN(TexParameteri),
+  DEF_FN(TexSubImage2D),
+  DEF_FN(Uniform1f),
+  DEF_FN(Uniform2f),
+  DEF_FN(Uniform3f),
+  DEF_FN(Uniform1i),
+  DEF_FN(UniformMatrix2fv),
+  DEF_FN(UniformMatrix3fv),
+  DEF_FN(UseProgram),
+  DEF_FN(VertexAttribPointer),
+  DEF_FN(Viewport),
+  DEF_FN(BindFramebuffer),
+  DEF_FN(GenFramebuffers),
+  DEF_FN(DeleteFramebuffers),
+  DEF_FN(CheckFramebufferStatus),
+  DEF_FN(FramebufferTexture2D),
+  DEF_FN(GetFramebufferAttachmentParameteriv),
+};
+
+/**
+ * The function used by MPV to get addresses for opengl functions.
+ */
+static void *get_proc_address(void *, const char *name) {
+  auto iter = gl_func_map.find(string(name));
+  if (iter == gl_func_map.end()) {
+    fprintf(stderr, "No WebGL wrapper for a function named %s\n", name);
+    return nullptr;
+  }
+  return iter->second;
+}
+
+MpvPlayer::MpvPlayer(Isolate *isolate,
+                     const shared_ptr<Persistent<Object>> &canvas,
+                     const shared_ptr<SharedGlContext> &glContext,
+                     const PlayerOptions &opts) :
+    ObjectWrap(),
+    d(new MPImpl(isolate, canvas, glContext, opts)) {
+
+}
+
+mpv_handle *MpvPlayer::mpv()const { return d->_mpv; }
+
+/**
+ * Initialize the native module
+ */
+void MpvPlayer::Init(Local<Object> exports, Local<Context> ctx) {
+  Isolate *i = ctx->GetIsolate();
+
+  auto addon = new AddonData;
+#ifdef BUILD_CONTEXT_AWARE
+  addon->loop = node::GetCurrentEventLoop(i);
+  node::AddEnvironmentCleanupHook(i, cleanup_addon_data, addon);
+#else
+  addon->loop = uv_default_loop();
+#endif
+
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(i, New, External::New(i, addon));
+  tpl->SetClassName(make_string(i, MPV_PLAYER_CLASS));
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "create", Create);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "command", Command);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getProperty", GetProperty);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setProperty", SetProperty);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getPropertyJSON", GetPropertyJSON);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setPropertyJSON", SetPropertyJSON);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "observeProperty", ObserveProperty);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "unobserveProperty", UnobserveProperty);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "getObservedSnapshot", GetObservedSnapshot);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "mirrorProperties", MirrorProperties);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "unmirrorProperties", UnmirrorProperties);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "watch", Watch);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "unwatch", Unwatch);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "on", On);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "off", Off);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setLogSink", SetLogSink);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "drainLogs", DrainLogs);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setRenderTarget", SetRenderTarget);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "addMirror", AddMirror);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "removeMirror", RemoveMirror);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setViewport", SetViewport);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "dispose", Dispose);
+  tpl->InstanceTemplate()->SetAccessor(make_string(i, "cmds"), CommandsAccessor);
+  tpl->InstanceTemplate()->SetAccessor(make_string(i, "props"), PropsAccessor);
+
+  addon->constructor.Reset(i, tpl->GetFunction(ctx).ToLocalChecked());
+  exports->Set(ctx, make_string(i, MPV_PLAYER_CLASS), tpl->GetFunction(ctx).ToLocalChecked());
+}
+
+/**
+ * Mapped to MpvPlayer constructor function.
+ * This function should only be called with `new` operator and get a single argument.
+ * This argument should be an object representing a valid DOM canvas element.
+ */
+ void MpvPlayer::New(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  Local<Context> ctx = i->GetCurrentContext();
+
+  if (!args.IsConstructCall()) {
+    // our constructor function is called as a function, without new
+    i->ThrowException(make_string(i, "MpvPlayer constructor should be called with new"));
+    return;
+  }
+
+  if (args.Length() < 1) {
+    i->ThrowException(
+      Exception::TypeError(make_string(i, "MpvPlayer: invalid number of arguments for constructor: canvas DOM element expected")));
+    return;
+  }
+
+  Local<Value> arg = args[0];
+  if (!arg->IsObject()) {
+    i->ThrowException(
+      Exception::TypeError(make_string(i, "MpvPlayer: invalid argument, canvas DOM element expected")));
+    return;
+  }
+
+  PlayerOptions opts;
+  if (args.Length() > 1) {
+    Local<Object> options = args[1].As<Object>();
+    if (options.IsEmpty()) {
+      throw_js(i, "MpvPlayer: invalid argument, option object expected");
+      return;
+    }
+
+    // enumerate option properties
+    Local<Array> op_props = options->GetOwnPropertyNames(ctx).ToLocalChecked();
+    for (uint32_t q = 0; q < op_props->Length(); ++q) {
+      Local<String> prop_name = op_props->Get(ctx, q).ToLocalChecked().As<String>();
+      string prop_name_cc = string_to_cc(prop_name);
+      if (prop_name_cc == "onEvents") {
+        // handler for batched events
+        Local<Value> prop_value = options->Get(ctx, prop_name).ToLocalChecked();
+        if (!prop_value->IsFunction()) {
+          throw_js(i, "MpvPlayer: invalid handler for onEvents, not a function");
+          return;
+        }
+
+        opts.batch_handler = pers_ptr(new Persistent<Function>(i, prop_value.As<Function>()));
+      } else if (prop_name_cc.size() > 2 && prop_name_cc.substr(0, 2) == "on") {
+        // event handler
+        auto he_iter = handler_events.find(prop_name_cc);
+        if (he_iter == handler_events.end()) {
+          throw_js(i, ("MpvPlayer: unknown event handler " + prop_name_cc).c_str());
+          return;
+        }
 
-      callMethod(webgl_method, object_iter->second->Get(_isolate));
-      if (glGetError() == GL_NO_ERROR) {
-        store.erase(object_iter);
+        Local<Function> prop_value = options->Get(ctx, prop_name).ToLocalChecked().As<Function>();
+        if (prop_name.IsEmpty()) {
+          throw_js(i, ("MpvPlayer: invalid handler for " + prop_name_cc + ", not a function").c_str());
+          return;
+        }
+
+        opts.event_handlers[he_iter->second] = pers_ptr(new Persistent<Function>(i, prop_value));
+      } else if (prop_name_cc == "viewport") {
+        if (!rect_from_object(i, options->Get(ctx, prop_name).ToLocalChecked(), opts.viewport)) {
+          throw_js(i, "MpvPlayer: invalid argument type for option viewport: an object with x, y, width and height expected");
+          return;
+        }
+        opts.has_viewport = true;
+      } else if (prop_name_cc == "logLevel") {
+        // log level
+        Local<String> prop_value = options->Get(ctx, prop_name).ToLocalChecked().As<String>();
+        if (prop_value.IsEmpty()) {
+          throw_js(i, "MpvPlayer: invalid argument type for option logLevel: string expected");
+          return;
+        }
+        opts.log_level = string_to_cc(prop_value);
+      } else if (prop_name_cc == "eventBudgetMs") {
+        Local<Value> prop_value = options->Get(ctx, prop_name).ToLocalChecked();
+        double budget = prop_value->IsNumber() ? prop_value->NumberValue(ctx).FromMaybe(-1) : -1;
+        if (!std::isfinite(budget) || budget < 0) {
+          throw_js(i, "MpvPlayer: invalid argument type for option eventBudgetMs: non-negative number expected");
+          return;
+        }
+        // larger budgets are no different from no budget, and the limit keeps nanoseconds within uint64_t
+        opts.event_budget_ms = std::min(budget, static_cast<double>(UINT32_MAX));
+      } else if (prop_name_cc == "eventBudgetCount") {
+        Local<Value> prop_value = options->Get(ctx, prop_name).ToLocalChecked();
+        double budget = prop_value->IsNumber() ? prop_value->NumberValue(ctx).FromMaybe(-1) : -1;
+        if (!std::isfinite(budget) || budget < 0) {
+          throw_js(i, "MpvPlayer: invalid argument type for option eventBudgetCount: non-negative number expected");
+          return;
+        }
+        opts.event_budget_count = static_cast<uint32_t>(std::min(budget, static_cast<double>(UINT32_MAX)));
       }
     }
   }
 
-  void callLocationMethod(const string &webgl_method, GLint location_id, int argc, Local<Value> *args) {
-    auto uni_iter = _uniforms.find(location_id);
-    if (uni_iter == _uniforms.end()) {
-      // set GL_INVALID_VALUE
-      return;
-    }
+  // extract object pointing to canvas
+  auto canvas = pers_ptr(new Persistent<Object>(i, arg->ToObject(ctx).ToLocalChecked()));
 
-    args[0] = uni_iter->second->Get(_isolate);
-    callMethod(webgl_method, argc, args);
+  // find getContext method on canvas object
+  Local<Object> get_context_func = canvas->Get(i)->Get(ctx, make_string(i, "getContext"))
+      .ToLocalChecked()->ToObject(ctx).ToLocalChecked();
+  if (get_context_func.IsEmpty() || get_context_func->IsUndefined()) {
+    throw_js(i, "MpvPlayer::create: failed to create WebGL rendering context");
+    return;
   }
 
-  void uniformMatrix(const string &method, int matrix_size, GLint location, GLboolean transpose,
-                     const GLfloat *value) {
-    auto loc_iter = _uniforms.find(location);
-    if (loc_iter == _uniforms.end()) {
-      // set GL_INVALID_VALUE
-      return;
-    }
-
-    int matrix_elem_count = matrix_size * matrix_size;
+  // and call canvas.getContext to get webgl rendering context.
+  // Context attributes are given only for a context shared by players drawing into regions of a canvas, so other
+  // canvases keep the attributes the app expects
+  Local<Object> context_opts = Object::New(i);
+  int get_context_argc = 1;
+  if (opts.has_viewport) {
+    context_opts->Set(i->GetCurrentContext(), make_string(i, "premultipliedAlpha"), Boolean::New(i, true));
+    context_opts->Set(i->GetCurrentContext(), make_string(i, "alpha"), Boolean::New(i, false));
+    context_opts->Set(i->GetCurrentContext(), make_string(i, "antialias"), Boolean::New(i, false));
+    // players present frames independently, so the drawing buffer should not be cleared after one of them presents
+    // its frame
+    context_opts->Set(i->GetCurrentContext(), make_string(i, "preserveDrawingBuffer"), Boolean::New(i, true));
+    get_context_argc = 2;
+  }
+  Local<Value> get_context_args[] = { make_string(i, "webgl2"), context_opts };
+  TryCatch try_catch(i);
 
-    auto buf = backingBuffer(matrix_elem_count * sizeof(GLfloat), BB_UNIFORM);
-    memcpy(buf->GetContents().Data(), value, matrix_elem_count * sizeof(GLfloat));
-    auto buf_view = Float32Array::New(buf, 0, static_cast<size_t>(matrix_elem_count));
+  MaybeLocal<Value> maybe_context = get_context_func->CallAsFunction(i->GetCurrentContext(), canvas->Get(i),
+                                                                     get_context_argc, get_context_args);
 
-    Local<Value> args[3] = { loc_iter->second->Get(_isolate), Boolean::New(_isolate, transpose), buf_view };
-    callMethod(method, ARG_COUNT, args);
+  if (try_catch.HasCaught()) {
+    try_catch.ReThrow();
+    return;
   }
-
-  void _throw_js(const char *msg) {
-    throw_js(_isolate, msg);
+  if (maybe_context.IsEmpty() ||
+      (maybe_context.ToLocalChecked()->IsNull() || maybe_context.ToLocalChecked()->IsUndefined())) {
+    throw_js(i, "MpvPlayer::create: failed to initialize WebGL");
+    return;
   }
 
-  static MPImpl *singleton() {
-    return _singleton;
-  }
+  Local<Value> context = maybe_context.ToLocalChecked();
 
-  mpv_opengl_cb_context *gl()const { return _mpv_gl; }
-  mpv_handle *mpv()const { return _mpv; }
+  // create C++ player object
 
-  Local<ArrayBuffer> backingBuffer(size_t size, BUF_ROLE buf_role) {
-    auto it = _backing_bufs.find(buf_role);
-    if (it != _backing_bufs.end() && it->second && !it->second->IsEmpty()) {
-      Local<ArrayBuffer> buf = it->second->Get(_isolate);
-      if (buf->ByteLength() >= size) {
-        return buf;
-      }
-    }
+  auto addon = static_cast<AddonData*>(args.Data().As<External>()->Value());
+  auto gl_context = SharedGlContext::forContext(i, context.As<Object>(), addon->gl_contexts);
+  auto player_obj = new MpvPlayer(i, canvas, gl_context, opts);
+  player_obj->d->_loop = addon->loop;
+  player_obj->d->_addon = addon;
+  player_obj->Wrap(args.This());
+  player_obj->Ref(); // do not GC this object if there are no handles, we are going to deref it inside dispose
 
-    Local<ArrayBuffer> buf = ArrayBuffer::New(_isolate, size);
-    auto pers = pers_ptr(new Persistent<ArrayBuffer>(_isolate, buf));
+  args.GetReturnValue().Set(args.This());
+}
 
-    if (it != _backing_bufs.end()) {
-      it->second.reset();
-      it->second = pers;
-    } else {
-      _backing_bufs[buf_role] = pers;
-    }
+/**
+ * Mapped to MpvPlayer.create function.
+ * Initializes MPV player instance.
+ */
+void MpvPlayer::Create(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-    return buf;
+  if (self->d->_mpv) {
+    throw_js(i, "MpvPlayer::create: player already created, cannot call this method twice on the same object");
+    return;
   }
 
-  /** Data members **/
-
-  static MPImpl *_singleton;
-  PlayerOptions _options;
-  multimap<string, shared_ptr<Persistent<Object>>> _observers;
-  Isolate *_isolate;
-  shared_ptr<Persistent<Object>> _canvas;
-  shared_ptr<Persistent<Object>> _renderingContext;
-  mpv_handle *_mpv = nullptr;
-  mpv_opengl_cb_context *_mpv_gl = nullptr;
-  map<int, string> gl_props;
-  map<string, shared_ptr<Persistent<Function>>> _webgl_methods;
-  ObjectStore _programs;
-  ObjectStore _shaders;
-  ObjectStore _buffers;
-  ObjectStore _textures;
-  ObjectStore _framebuffers;
-  map<GLint, shared_ptr<Persistent<Value>>> _uniforms;
-  GLuint _last_id = 0;
-  size_t unpack_alignment = 1, pack_alignment = 1;
-  bool pixel_unpack_buffer_bound = false, pixel_pack_buffer_bound = false;
-  map<BUF_ROLE, shared_ptr<Persistent<ArrayBuffer>>> _backing_bufs;
-  ctx_dim _dim;
+  // create mpv object
+  self->d->_mpv = mpv_create();
+  if (!self->d->_mpv) {
+    throw_js(i, "MpvPlayer::create: failed to initialize mpv");
+    return;
+  }
 
-  GLuint newId() { return ++_last_id; }
-};
+  // to speed up things (in electron, yeah) we disable events js code hasn't subscribed to.
+  // events are enabled again when js code subscribes to them with on.
+  for (int q = MPV_EVENT_LOG_MESSAGE; q <= MPV_EVENT_QUEUE_OVERFLOW; ++q) {
+    self->d->updateEventRequest((mpv_event_id)q, true);
+  }
+  // wow, such fast
 
-MPImpl *MPImpl::_singleton = nullptr;
+  // set default logging params
+  const char *log_level = self->d->_options.log_level.empty() ? "warn" : self->d->_options.log_level.c_str();
+  mpv_request_log_messages(self->d->_mpv, log_level);
+  // initialize libuv async callbacks, each player has its own ones
+  self->d->initAsyncHandles(do_update, do_wakeup);
+  self->d->_addon->players.push_back(self->d.get());
+  self->d->startEventThread();
 
-/*************************************************************************************
- * Some helpers
- *************************************************************************************/
+  // initialize mpv
+  if (mpv_initialize(self->d->_mpv) < 0) {
+    throw_js(i, "MpvPlayer::create: failed to initialize mpv");
+    return;
+  }
 
-Persistent<Function> MpvPlayer::constructor;
+  // set default options
+  mpv_set_option_string(self->d->_mpv, "vo", "opengl-cb");
+  mpv_set_option_string(self->d->_mpv, "hwdec", "auto");
+  mpv_set_option_string(self->d->_mpv, "sub-auto", "no");
+  mpv_set_option_string(self->d->_mpv, "input-vo-keyboard", "no");
 
-static const char *MPV_PLAYER_CLASS = "MpvPlayer";
+  // initialize opengl callback api
+  self->d->_mpv_gl = static_cast<mpv_opengl_cb_context*>(mpv_get_sub_api(self->d->_mpv, MPV_SUB_API_OPENGL_CB));
+  if (!self->d->_mpv_gl) {
+    throw_js(i, "MpvPlayer::create: falied to initialize opengl subapi");
+    return;
+  }
 
-static uv_async_t async_handle, async_wakeup_handle;
+  MPImpl::CurrentScope current(self->d.get());
+  if (mpv_opengl_cb_init_gl(self->d->_mpv_gl, nullptr, get_proc_address, self) < 0) {
+    throw_js(i, "MpvPlayer::create: falied to initialize WebGL functions");
+    return;
+  }
 
-/*************************************************************************************
- * MpvPlayer
- *************************************************************************************/
+  mpv_opengl_cb_set_update_callback(self->d->_mpv_gl, mpv_async_update_cb, self->d.get());
+}
 
-/**
- * This function is called by libuv to process new lbimpv frames.
- * It is always called on the main thread.
- */
-void do_update(uv_async_t *) {
-  if (MPImpl::singleton()) {
-    GL_DEBUG("mpv_opengl_cb_draw: drawing a frame...\n");
+void MpvPlayer::Command(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-    MPImpl *impl = MPImpl::singleton();
+  if (!self->d->_mpv) {
+    throw_js(i, "MpvPlayer::command: player object is not initialized");
+    return;
+  }
 
-    HandleScope scope(impl->_isolate);
+  if (args.Length() < 1) {
+    throw_js(i, "MpvPlayer::command: not enough arguments, at least one is expected");
+    return;
+  }
 
-    const ctx_dim &dim = impl->getContextDims();
-    mpv_opengl_cb_draw(impl->gl(), 0, dim.width, -dim.height);
+  if (!args[0]->IsString() && !args[0]->IsStringObject()) {
+    throw_js(i, "MpvPlayer::command: invalid arguments, first arguments should be a command name");
+    return;
   }
-}
 
-/**
- * This function is called by mpv itself when it has something to draw.
- * It can be called from any thread, so we should ask libuv to call the corresponding callback registered with uv_async_init.
- */
-void mpv_async_update_cb(void *) {
-  uv_async_send(&async_handle);
-}
+  AutoForeignMpvNode mpv_result;
+  int err_code;
+  if (args.Length() == 1) {
+    Utf8String command_name(i, args[0]);
+    err_code = mpv_command_string(self->d->_mpv, command_name.c_str());
+  } else {
+    AutoMpvNode mpv_args(args, 0, &self->d->_node_arena);
+    if (!mpv_args.valid()) {
+      throw_js(i, "MpvPlayer::command: invalid arguments");
+      return;
+    }
 
-/**
- * This function is called by libuv to process new libmpv events.
- * it is always called on the main thread.
- */
-void do_wakeup(uv_async_t *) {
-  if (MPImpl::singleton()) {
-    while (true) {
-      mpv_event *event = mpv_wait_event(MPImpl::singleton()->mpv(), 0);
+    err_code = mpv_command_node(self->d->_mpv, mpv_args.ptr(), &mpv_result.node);
+  }
 
-      if (event->event_id == MPV_EVENT_NONE || event->event_id == MPV_EVENT_SHUTDOWN) {
-        break;
-      } else if (event->event_id == MPV_EVENT_PROPERTY_CHANGE) {
-        MPImpl::singleton()->handlePropertyChange(static_cast<const mpv_event_property*>(event->data));
-      } else {
-        MPImpl::singleton()->handleEvent(event);
-      }
-    }
+  if (err_code != MPV_ERROR_SUCCESS) {
+    throw_js(i, mpv_error_string(err_code));
+    return;
   }
-}
 
-/**
- * This function is called by mpv itself when it has unprocessed events.
- * It can be called from any thread, so we should ask libuv to call the corresponding callback registered with uv_async_init.
- */
-void mpv_async_wakeup_cb(void *) {
-  uv_async_send(&async_wakeup_handle);
+  args.GetReturnValue().Set(mpv_node_to_v8_value(i, mpv_result));
 }
 
-/*************************************************************************************
- * Crazy bunch of wrappers around gl methods on MpvPlayerImpl class
- *************************************************************************************/
-
-#define QUOTE(arg) #arg
-#define DEF_FN(FUN_NAME) { QUOTE(gl##FUN_NAME), (void*)GlWrappers::gl##FUN_NAME }
-
-namespace GlWrappers {
-  void glActiveTexture(GLenum texture) { MPImpl::singleton()->glActiveTexture(texture); }
+void MpvPlayer::GetProperty(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  Local<Context> ctx = i->GetCurrentContext();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  const GLubyte *glGetString(GLenum name) { return MPImpl::singleton()->glGetString(name); }
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::getProperty: player object is not initialized");
+    return;
+  }
 
-  GLuint glCreateProgram() { return MPImpl::singleton()->glCreateProgram(); }
+  if (args.Length() != 1 && args.Length() != 2) {
+    throw_js(i, "MpvPlayer::getProperty: incorrect number of arguments, a property name and options expected");
+    return;
+  }
 
-  void glDeleteProgram(GLuint program) { MPImpl::singleton()->glDeleteProgram(program); }
+  bool lazy = false;
+  if (args.Length() == 2 && !args[1]->IsUndefined()) {
+    if (!args[1]->IsObject()) {
+      throw_js(i, "MpvPlayer::getProperty: second argument is incorrect, an options object expected");
+      return;
+    }
 
-  void glGetProgramInfoLog(GLuint program, GLsizei max_length, GLsizei *length, GLchar *info_log) {
-    MPImpl::singleton()->glGetProgramInfoLog(program, max_length, length, info_log);
+    Local<Value> lazy_option = args[1].As<Object>()->Get(ctx, make_string(i, "lazy")).ToLocalChecked();
+    lazy = lazy_option->BooleanValue(ctx).FromMaybe(false);
   }
 
-  void glGetProgramiv(GLuint program, GLenum pname, GLint *params) {
-    MPImpl::singleton()->glGetProgramiv(program, pname, params);
+  Utf8String arg_c(i, args[0]);
+  if (!arg_c.valid()) {
+    throw_js(i, "MpvPlayer::getProperty: incorrect arguments, a single property name expected");
+    return;
   }
 
-  void glLinkProgram(GLuint program) { MPImpl::singleton()->glLinkProgram(program); }
+  if (arg_c.empty()) {
+    throw_js(i, "MpvPlayer::getProperty: fail");
+    return;
+  }
 
-  void glUseProgram(GLuint program) { MPImpl::singleton()->glUseProgram(program); }
+  AutoForeignMpvNode node;
+  auto err_code = mpv_get_property(self->d->_mpv, arg_c.c_str(), MPV_FORMAT_NODE, &node.node);
+  if (err_code != MPV_ERROR_SUCCESS) {
+    throw_js(i, mpv_error_string(err_code));
+    return;
+  }
 
-  GLuint glCreateShader(GLenum shader_type) { return MPImpl::singleton()->glCreateShader(shader_type); }
+  args.GetReturnValue().Set(lazy ? mpv_node_to_lazy_v8_value(i, node) : mpv_node_to_v8_value(i, node));
+}
 
-  void glDeleteShader(GLuint shader_id) { MPImpl::singleton()->glDeleteShader(shader_id); }
+void MpvPlayer::SetProperty(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  void glAttachShader(GLuint program_id, GLuint shader_id) {
-    MPImpl::singleton()->glAttachShader(program_id, shader_id);
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::setProperty: player object is not initialized");
+    return;
   }
 
-  void glCompileShader(GLuint shader_id) { MPImpl::singleton()->glCompileShader(shader_id); }
+  if (args.Length() != 2) {
+    throw_js(i, "MpvPlayer::setProperty: incorrect number of arguments, two arguments are expected");
+    return;
+  }
 
-  void glBindAttribLocation(GLuint program_id, GLuint index, const GLchar *name) {
-    MPImpl::singleton()->glBindAttribLocation(program_id, index, name);
+  if (!args[0]->IsString() && !args[0]->IsStringObject()) {
+    throw_js(i, "MpvPlayer::setProperty: first argument is incorrect, a string expected");
+    return;
   }
 
-  void glBindBuffer(GLenum target, GLuint buffer) { MPImpl::singleton()->glBindBuffer(target, buffer); }
+  Utf8String prop_name_c(i, args[0]);
+  if (prop_name_c.empty()) {
+    throw_js(i, "MpvPlayer::setProperty: fail");
+    return;
+  }
 
-  void glBindTexture(GLenum target, GLuint texture) { MPImpl::singleton()->glBindTexture(target, texture); }
+  AutoMpvNode anode(i, args[1], &self->d->_node_arena);
+  if (!anode.valid()) {
+    throw_js(i, "MpvPlayer::setProperty: failed to convert js value to one of mpv_node formats");
+    return;
+  }
 
-  void glBlendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAplha, GLenum dstAplha) {
-    MPImpl::singleton()->glBlendFuncSeparate(srcRGB, dstRGB, srcAplha, dstAplha);
+  auto err_code = mpv_set_property(self->d->_mpv, prop_name_c.c_str(), MPV_FORMAT_NODE, anode.ptr());
+  if (err_code != MPV_ERROR_SUCCESS) {
+    throw_js(i, mpv_error_string(err_code));
+    return;
   }
+}
 
-  void glBufferData(GLenum target, GLsizeiptr size, const GLvoid *data,
-                        GLenum usage) { MPImpl::singleton()->glBufferData(target, size, data, usage); }
+void MpvPlayer::GetPropertyJSON(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size,
-                           const GLvoid *data) { MPImpl::singleton()->glBufferSubData(target, offset, size, data); }
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::getPropertyJSON: player object is not initialized");
+    return;
+  }
 
-  void glClear(GLbitfield mask) { MPImpl::singleton()->glClear(mask); }
+  if (args.Length() != 1 || (!args[0]->IsString() && !args[0]->IsStringObject())) {
+    throw_js(i, "MpvPlayer::getPropertyJSON: incorrect arguments, a single property name expected");
+    return;
+  }
 
-  void glClearColor(GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) {
-    MPImpl::singleton()->glClearColor(red, green, blue, alpha);
+  Utf8String prop_name_c(i, args[0]);
+  if (prop_name_c.empty()) {
+    throw_js(i, "MpvPlayer::getPropertyJSON: fail");
+    return;
   }
 
-  void glDeleteBuffers(GLsizei n, const GLuint *buffers) { MPImpl::singleton()->glDeleteBuffers(n, buffers); }
+  AutoForeignMpvNode node;
+  auto err_code = mpv_get_property(self->d->_mpv, prop_name_c.c_str(), MPV_FORMAT_NODE, &node.node);
+  if (err_code != MPV_ERROR_SUCCESS) {
+    throw_js(i, mpv_error_string(err_code));
+    return;
+  }
 
-  void glDeleteTextures(GLsizei n, const GLuint *textures) { MPImpl::singleton()->glDeleteTextures(n, textures); }
+  string json;
+  write_node_json(node.node, json);
 
-  void glEnable(GLenum cap) { MPImpl::singleton()->glEnable(cap); }
+  if (json.size() > static_cast<size_t>(String::kMaxLength)) {
+    throw_js(i, "MpvPlayer::getPropertyJSON: property value is too large");
+    return;
+  }
+  args.GetReturnValue().Set(mpv_string_to_v8(i, json.data(), json.size()));
+}
 
-  void glDisable(GLenum cap) { MPImpl::singleton()->glDisable(cap); }
+void MpvPlayer::SetPropertyJSON(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  void glDisableVertexAttribArray(GLuint index) { MPImpl::singleton()->glDisableVertexAttribArray(index); }
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::setPropertyJSON: player object is not initialized");
+    return;
+  }
 
-  void glEnableVertexAttribArray(GLuint index) { MPImpl::singleton()->glEnableVertexAttribArray(index); }
+  if (args.Length() != 2 || (!args[0]->IsString() && !args[0]->IsStringObject())
+      || (!args[1]->IsString() && !args[1]->IsStringObject())) {
+    throw_js(i, "MpvPlayer::setPropertyJSON: incorrect arguments, a property name and a json string expected");
+    return;
+  }
 
-  void glDrawArrays(GLenum mode, GLint first, GLsizei count) {
-    MPImpl::singleton()->glDrawArrays(mode, first, count);
+  Utf8String prop_name_c(i, args[0]);
+  if (prop_name_c.empty()) {
+    throw_js(i, "MpvPlayer::setPropertyJSON: fail");
+    return;
   }
 
-  void glFinish() { MPImpl::singleton()->glFinish(); }
+  Utf8String json(i, args[1]);
+  if (!json.valid()) {
+    throw_js(i, "MpvPlayer::setPropertyJSON: fail");
+    return;
+  }
 
-  void glFlush() { MPImpl::singleton()->glFlush(); }
+  string error;
+  AutoMpvNode anode(json.c_str(), json.length(), error, &self->d->_node_arena);
+  if (!error.empty()) {
+    throw_js(i, ("MpvPlayer::setPropertyJSON: invalid json, " + error).c_str());
+    return;
+  }
 
-  void glGenBuffers(GLsizei n, GLuint *buffers) { MPImpl::singleton()->glGenBuffers(n, buffers); }
+  auto err_code = mpv_set_property(self->d->_mpv, prop_name_c.c_str(), MPV_FORMAT_NODE, anode.ptr());
+  if (err_code != MPV_ERROR_SUCCESS) {
+    throw_js(i, mpv_error_string(err_code));
+    return;
+  }
+}
 
-  void glGenTextures(GLsizei n, GLuint *textures) { MPImpl::singleton()->glGenTextures(n, textures); }
+void MpvPlayer::ObserveProperty(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  Local<Context> ctx = i->GetCurrentContext();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  GLint glGetAttribLocation(GLuint program_id, const GLchar *name) {
-    return MPImpl::singleton()->glGetAttribLocation(program_id, name);
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::observeProperty: player object is not initialized");
+    return;
   }
 
-  GLenum glGetError() { return MPImpl::singleton()->glGetError(); }
-
-  void glGetIntegerv(GLenum pname, GLint *params) { MPImpl::singleton()->glGetIntegerv(pname, params); }
+  if (args.Length() != 2 && args.Length() != 3) {
+    throw_js(i, "MpvPlayer::observeProperty: incorrect number of arguments, two or three arguments are expected");
+    return;
+  }
 
-  void glGetShaderInfoLog(GLuint shader_id, GLsizei max_length, GLsizei *length, GLchar *info_log) {
-    MPImpl::singleton()->glGetShaderInfoLog(shader_id, max_length, length, info_log);
+  if (!args[0]->IsString() && !args[0]->IsStringObject()) {
+    throw_js(i, "MpvPlayer::observeProperty: first argument is incorrect, a string expected");
+    return;
   }
 
-  void glGetShaderiv(GLuint shader_id, GLenum pname, GLint *params) {
-    MPImpl::singleton()->glGetShaderiv(shader_id, pname, params);
+  string prop_name = string_to_cc(args[0]);
+  if (prop_name.empty()) {
+    throw_js(i, "MpvPlayer::setProperty: fail");
+    return;
   }
 
-  GLint glGetUniformLocation(GLuint program, const GLchar *name) {
-    return MPImpl::singleton()->glGetUniformLocation(program, name);
+  Local<Object> handler = args[1].As<Object>();
+  if (handler.IsEmpty() || !handler->IsCallable()) {
+    throw_js(i, "MpvPlayer::observeProperty: second argument is invalid, a callable expected");
+    return;
   }
 
-  void glPixelStorei(GLenum pname, GLint param) { MPImpl::singleton()->glPixelStorei(pname, param); }
+  auto observer = make_shared<PropertyObserver>();
+  observer->handler = pers_ptr(new Persistent<Object>(i, handler));
 
-  void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type,
-                        GLvoid *data) { MPImpl::singleton()->glReadPixels(x, y, width, height, format, type, data); }
+  if (args.Length() > 2 && !args[2]->IsUndefined()) {
+    if (!args[2]->IsObject()) {
+      throw_js(i, "MpvPlayer::observeProperty: third argument is invalid, an options object expected");
+      return;
+    }
 
-  void glShaderSource(GLuint shader_id, GLsizei count, const GLchar **str, const GLint *length) {
-    MPImpl::singleton()->glShaderSource(shader_id, count, str, length);
-  }
+    Local<Object> options = args[2].As<Object>();
 
-  void glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
-    MPImpl::singleton()->glScissor(x, y, width, height);
-  }
+    Local<Value> min_interval = options->Get(ctx, make_string(i, "minIntervalMs")).ToLocalChecked();
+    if (!min_interval->IsUndefined()) {
+      if (!min_interval->IsNumber() || min_interval->NumberValue(ctx).FromMaybe(-1) < 0) {
+        throw_js(i, "MpvPlayer::observeProperty: invalid minIntervalMs option, a non-negative number expected");
+        return;
+      }
+      observer->min_interval = static_cast<uint64_t>(min_interval->NumberValue(ctx).FromMaybe(0));
+    }
 
-  void glTexImage2D(GLenum target, GLint level, GLint internal_format, GLsizei width, GLsizei height, GLint border,
-                        GLenum format, GLenum type, const GLvoid *data) {
-    MPImpl::singleton()->glTexImage2D(target, level, internal_format, width, height, border, format, type, data);
-  }
+    Local<Value> latest_only = options->Get(ctx, make_string(i, "latestOnly")).ToLocalChecked();
+    if (!latest_only->IsUndefined()) {
+      observer->latest_only = latest_only->BooleanValue(ctx).FromMaybe(true);
+    }
 
-  void glTexParameteri(GLenum target, GLenum pname, GLint param) {
-    MPImpl::singleton()->glTexParameteri(target, pname, param);
+    Local<Value> format = options->Get(ctx, make_string(i, "format")).ToLocalChecked();
+    if (!format->IsUndefined()) {
+      if (!format->IsString() || !mpv_format_from_name(string_to_cc(format), observer->format)) {
+        throw_js(i, "MpvPlayer::observeProperty: invalid format option, one of node, double, int64, flag, string expected");
+        return;
+      }
+    }
+
+    Local<Value> diff = options->Get(ctx, make_string(i, "diff")).ToLocalChecked();
+    if (!diff->IsUndefined()) {
+      observer->diff = diff->BooleanValue(ctx).FromMaybe(false);
+      if (observer->diff && observer->format != MPV_FORMAT_NODE) {
+        throw_js(i, "MpvPlayer::observeProperty: diff option can be used only with node format");
+        return;
+      }
+      if (observer->diff) {
+        // a patch is made against the previous delivery, so there is nothing to gain from delivering each of values
+        observer->latest_only = true;
+      }
+    }
   }
 
-  void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
-                           GLenum format, GLenum type, const GLvoid *pixels) {
-    MPImpl::singleton()->glTexSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+  int err_code = self->d->addObserver(prop_name, observer);
+  if (err_code != MPV_ERROR_SUCCESS) {
+    throw_js(i, mpv_error_string(err_code));
+    return;
   }
 
-  void glUniform1f(GLint location, GLfloat v0) { MPImpl::singleton()->glUniform1f(location, v0); }
+  args.GetReturnValue().Set(Number::New(i, static_cast<double>(observer->id)));
+}
 
-  void glUniform2f(GLint location, GLfloat v0, GLfloat v1) { MPImpl::singleton()->glUniform2f(location, v0, v1); }
+void MpvPlayer::UnobserveProperty(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  void glUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {
-    MPImpl::singleton()->glUniform3f(location, v0, v1, v2);
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::unobserveProperty: player object is not initialized");
+    return;
   }
 
-  void glUniform1i(GLint location, GLint v0) { MPImpl::singleton()->glUniform1i(location, v0); }
-
-  void glUniformMatrix2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
-    MPImpl::singleton()->glUniformMatrix2fv(location, count, transpose, value);
+  if (args.Length() != 1) {
+    throw_js(i, "MpvPlayer::unobserveProperty: incorrect number of arguments, one argument is expected");
+    return;
   }
 
-  void glUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) {
-    MPImpl::singleton()->glUniformMatrix3fv(location, count, transpose, value);
+  if (!args[0]->IsNumber()) {
+    throw_js(i, "MpvPlayer::unobserveProperty: first argument is incorrect, an observer id expected");
+    return;
   }
 
-  void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
-                                 const GLvoid *pointer) {
-    MPImpl::singleton()->glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+  auto id = static_cast<uint64_t>(args[0]->NumberValue(i->GetCurrentContext()).FromMaybe(0));
+  args.GetReturnValue().Set(self->d->removeObserver(id));
+}
+
+void MpvPlayer::GetObservedSnapshot(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
+
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::getObservedSnapshot: player object is not initialized");
+    return;
   }
 
-  void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
-    MPImpl::singleton()->glViewport(x, y, width, height);
+  if (args.Length() != 1 || !args[0]->IsNumber()) {
+    throw_js(i, "MpvPlayer::getObservedSnapshot: incorrect arguments, an observer id expected");
+    return;
   }
 
-  void glBindFramebuffer(GLenum target, GLuint framebuffer) {
-    MPImpl::singleton()->glBindFramebuffer(target, framebuffer);
+  auto id = static_cast<uint64_t>(args[0]->NumberValue(i->GetCurrentContext()).FromMaybe(0));
+  Local<Value> snapshot = self->d->observerSnapshot(id);
+  if (snapshot.IsEmpty()) {
+    throw_js(i, "MpvPlayer::getObservedSnapshot: no diff observer with this id");
+    return;
   }
 
-  void glGenFramebuffers(GLsizei n, GLuint *ids) { MPImpl::singleton()->glGenFramebuffers(n, ids); }
+  args.GetReturnValue().Set(snapshot);
+}
 
-  void glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers) {
-    MPImpl::singleton()->glDeleteFramebuffers(n, framebuffers);
-  }
+void MpvPlayer::MirrorProperties(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  Local<Context> ctx = i->GetCurrentContext();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  GLenum glCheckFramebufferStatus(GLenum target) { return MPImpl::singleton()->glCheckFramebufferStatus(target); }
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::mirrorProperties: player object is not initialized");
+    return;
+  }
 
-  void glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) {
-    MPImpl::singleton()->glFramebufferTexture2D(target, attachment, textarget, texture, level);
+  if (args.Length() != 1) {
+    throw_js(i, "MpvPlayer::mirrorProperties: incorrect number of arguments, one argument is expected");
+    return;
   }
 
-  void glGetFramebufferAttachmentParameteriv(GLenum target, GLenum attachment, GLenum pname, GLint *params) {
-    MPImpl::singleton()->glGetFramebufferAttachmentParameteriv(target, attachment, pname, params);
+  if (!args[0]->IsArray()) {
+    throw_js(i, "MpvPlayer::mirrorProperties: first argument is incorrect, an array of property names expected");
+    return;
   }
-}
 
-static map<string, void*> gl_func_map = {
-  DEF_FN(ActiveTexture),
-  DEF_FN(AttachShader),
-  DEF_FN(BindAttribLocation),
-  DEF_FN(BindBuffer),
-  DEF_FN(BindTexture),
-  DEF_FN(BlendFuncSeparate),
-  DEF_FN(BufferData),
-  DEF_FN(BufferSubData),
-  DEF_FN(Clear),
-  DEF_FN(ClearColor),
-  DEF_FN(CompileShader),
-  DEF_FN(CreateProgram),
-  DEF_FN(CreateShader),
-  DEF_FN(DeleteBuffers),
-  DEF_FN(DeleteProgram),
-  DEF_FN(DeleteShader),
-  DEF_FN(DeleteTextures),
-  DEF_FN(Disable),
-  DEF_FN(DisableVertexAttribArray),
-  DEF_FN(DrawArrays),
-  DEF_FN(Enable),
-  DEF_FN(EnableVertexAttribArray),
-  DEF_FN(Finish),
-  DEF_FN(Flush),
-  DEF_FN(GenBuffers),
-  DEF_FN(GenTextures),
-  DEF_FN(GetAttribLocation),
-  DEF_FN(GetError),
-  DEF_FN(GetIntegerv),
-  DEF_FN(GetProgramInfoLog),
-  DEF_FN(GetProgramiv),
-  DEF_FN(GetShaderInfoLog),
-  DEF_FN(GetShaderiv),
-  DEF_FN(GetString),
-  DEF_FN(GetUniformLocation),
-  DEF_FN(LinkProgram),
-  DEF_FN(PixelStorei),
-  DEF_FN(ReadPixels),
-  DEF_FN(Scissor),
-  DEF_FN(ShaderSource),
-  DEF_FN(TexImage2D),
-  DEF_FN(TexParameteri),
-  DEF_FN(TexSubImage2D),
-  DEF_FN(Uniform1f),
-  DEF_FN(Uniform2f),
-  DEF_FN(Uniform3f),
-  DEF_FN(Uniform1i),
-  DEF_FN(UniformMatrix2fv),
-  DEF_FN(UniformMatrix3fv),
-  DEF_FN(UseProgram),
-  DEF_FN(VertexAttribPointer),
-  DEF_FN(Viewport),
-  DEF_FN(BindFramebuffer),
-  DEF_FN(GenFramebuffers),
-  DEF_FN(DeleteFramebuffers),
-  DEF_FN(CheckFramebufferStatus),
-  DEF_FN(FramebufferTexture2D),
-  DEF_FN(GetFramebufferAttachmentParameteriv),
-};
+  Local<Array> names_arr = args[0].As<Array>();
+  vector<string> names;
+  for (uint32_t q = 0; q < names_arr->Length(); ++q) {
+    Local<Value> name = names_arr->Get(ctx, q).ToLocalChecked();
+    if (!name->IsString()) {
+      throw_js(i, "MpvPlayer::mirrorProperties: property names should be strings");
+      return;
+    }
 
-/**
- * The function used by MPV to get addresses for opengl functions.
- */
-static void *get_proc_address(void *, const char *name) {
-  auto iter = gl_func_map.find(string(name));
-  if (iter == gl_func_map.end()) {
-    fprintf(stderr, "No WebGL wrapper for a function named %s\n", name);
-    return nullptr;
+    names.push_back(string_to_cc(name));
   }
-  return iter->second;
-}
 
-MpvPlayer::MpvPlayer(Isolate *isolate,
-                     const shared_ptr<Persistent<Object>> &canvas,
-                     const shared_ptr<Persistent<Object>> &renderingContext,
-                     const PlayerOptions &opts) :
-    ObjectWrap(),
-    d(new MPImpl(isolate, canvas, renderingContext, opts)) {
+  int err_code;
+  Local<Float64Array> result = self->d->mirrorProperties(names, err_code);
+  if (err_code != MPV_ERROR_SUCCESS) {
+    throw_js(i, mpv_error_string(err_code));
+    return;
+  }
 
+  args.GetReturnValue().Set(result);
 }
 
-mpv_handle *MpvPlayer::mpv()const { return d->_mpv; }
-
-/**
- * Initialize the native module
- */
-void MpvPlayer::Init(Local<Object> exports) {
-  Isolate *i = Isolate::GetCurrent();
-  Local<Context> ctx = i->GetCurrentContext();
-
-  Local<FunctionTemplate> tpl = FunctionTemplate::New(i, New);
-  tpl->SetClassName(make_string(i, MPV_PLAYER_CLASS));
-  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+void MpvPlayer::UnmirrorProperties(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  NODE_SET_PROTOTYPE_METHOD(tpl, "create", Create);
-  NODE_SET_PROTOTYPE_METHOD(tpl, "command", Command);
-  NODE_SET_PROTOTYPE_METHOD(tpl, "getProperty", GetProperty);
-  NODE_SET_PROTOTYPE_METHOD(tpl, "setProperty", SetProperty);
-  NODE_SET_PROTOTYPE_METHOD(tpl, "observeProperty", ObserveProperty);
-  NODE_SET_PROTOTYPE_METHOD(tpl, "dispose", Dispose);
-  tpl->InstanceTemplate()->SetAccessor(make_string(i, "cmds"), CommandsAccessor);
-  tpl->InstanceTemplate()->SetAccessor(make_string(i, "props"), PropsAccessor);
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::unmirrorProperties: player object is not initialized");
+    return;
+  }
 
-  constructor.Reset(i, tpl->GetFunction(ctx).ToLocalChecked());
-  exports->Set(ctx, make_string(i, MPV_PLAYER_CLASS), tpl->GetFunction(ctx).ToLocalChecked());
+  if (args.Length() != 1 || !args[0]->IsFloat64Array()) {
+    throw_js(i, "MpvPlayer::unmirrorProperties: incorrect arguments, an array returned by mirrorProperties expected");
+    return;
+  }
 
-  // initialize libuv async callbacks
-  uv_async_init(uv_default_loop(), &async_handle, do_update);
-  uv_async_init(uv_default_loop(), &async_wakeup_handle, do_wakeup);
+  Local<Value> buffer = CastLocal<Float64Array>(args[0])->Buffer();
+  args.GetReturnValue().Set(self->d->unmirrorProperties(buffer));
 }
 
-/**
- * Mapped to MpvPlayer constructor function.
- * This function should only be called with `new` operator and get a single argument.
- * This argument should be an object representing a valid DOM canvas element.
- */
- void MpvPlayer::New(const FunctionCallbackInfo<Value> &args) {
+void MpvPlayer::Watch(const FunctionCallbackInfo<Value> &args) {
   Isolate *i = args.GetIsolate();
   Local<Context> ctx = i->GetCurrentContext();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  if (!args.IsConstructCall()) {
-    // our constructor function is called as a function, without new
-    i->ThrowException(make_string(i, "MpvPlayer constructor should be called with new"));
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::watch: player object is not initialized");
     return;
   }
 
-  if (args.Length() < 1) {
-    i->ThrowException(
-      Exception::TypeError(make_string(i, "MpvPlayer: invalid number of arguments for constructor: canvas DOM element expected")));
+  if (args.Length() != 3) {
+    throw_js(i, "MpvPlayer::watch: incorrect number of arguments, three arguments are expected");
     return;
   }
 
-  Local<Value> arg = args[0];
-  if (!arg->IsObject()) {
-    i->ThrowException(
-      Exception::TypeError(make_string(i, "MpvPlayer: invalid argument, canvas DOM element expected")));
+  if (!args[0]->IsString()) {
+    throw_js(i, "MpvPlayer::watch: first argument is incorrect, a string expected");
     return;
   }
 
-  PlayerOptions opts;
-  if (args.Length() > 1) {
-    Local<Object> options = args[1].As<Object>();
-    if (options.IsEmpty()) {
-      throw_js(i, "MpvPlayer: invalid argument, option object expected");
-      return;
-    }
-
-    // enumerate option properties
-    Local<Array> op_props = options->GetOwnPropertyNames(ctx).ToLocalChecked();
-    for (uint32_t q = 0; q < op_props->Length(); ++q) {
-      Local<String> prop_name = op_props->Get(ctx, q).ToLocalChecked().As<String>();
-      string prop_name_cc = string_to_cc(prop_name);
-      if (prop_name_cc.size() > 2 && prop_name_cc.substr(0, 2) == "on") {
-        // event handler
-        auto he_iter = handler_events.find(prop_name_cc);
-        if (he_iter == handler_events.end()) {
-          throw_js(i, ("MpvPlayer: unknown event handler " + prop_name_cc).c_str());
-          return;
-        }
-
-        Local<Function> prop_value = options->Get(ctx, prop_name).ToLocalChecked().As<Function>();
-        if (prop_name.IsEmpty()) {
-          throw_js(i, ("MpvPlayer: invalid handler for " + prop_name_cc + ", not a function").c_str());
-          return;
-        }
-
-        opts.event_handlers[he_iter->second] = pers_ptr(new Persistent<Function>(i, prop_value));
-      } else if (prop_name_cc == "logLevel") {
-        // log level
-        Local<String> prop_value = options->Get(ctx, prop_name).ToLocalChecked().As<String>();
-        if (prop_value.IsEmpty()) {
-          throw_js(i, "MpvPlayer: invalid argument type for option logLevel: string expected");
-          return;
-        }
-        opts.log_level = string_to_cc(prop_value);
-      }
-    }
+  if (!args[1]->IsObject()) {
+    throw_js(i, "MpvPlayer::watch: second argument is incorrect, a condition object expected");
+    return;
   }
 
-  // extract object pointing to canvas
-  auto canvas = pers_ptr(new Persistent<Object>(i, arg->ToObject(ctx).ToLocalChecked()));
-
-  // find getContext method on canvas object
-  Local<Object> get_context_func = canvas->Get(i)->Get(ctx, make_string(i, "getContext"))
-      .ToLocalChecked()->ToObject(ctx).ToLocalChecked();
-  if (get_context_func.IsEmpty() || get_context_func->IsUndefined()) {
-    throw_js(i, "MpvPlayer::create: failed to create WebGL rendering context");
+  if (!args[2]->IsFunction()) {
+    throw_js(i, "MpvPlayer::watch: third argument is invalid, a function expected");
     return;
   }
 
-  // and call canvas.getContext to get webgl rendering context
-  Local<Object> context_opts = Object::New(i);
-  context_opts->Set(i->GetCurrentContext(), make_string(i, "premultipliedAlpha"), Boolean::New(i, true));
-  context_opts->Set(i->GetCurrentContext(), make_string(i, "alpha"), Boolean::New(i, false));
-  context_opts->Set(i->GetCurrentContext(), make_string(i, "antialias"), Boolean::New(i, false));
-  Local<Value> get_context_args[] = { make_string(i, "webgl2"), context_opts };
-  TryCatch try_catch(i);
-
-  MaybeLocal<Value> maybe_context = get_context_func->CallAsFunction(i->GetCurrentContext(),
-                                                                     canvas->Get(i), 1, get_context_args);
+  Local<Object> condition = args[1].As<Object>();
+  PropertyWatch watch;
 
-  if (try_catch.HasCaught()) {
-    try_catch.ReThrow();
+  Local<Value> crosses = condition->Get(ctx, make_string(i, "crosses")).ToLocalChecked();
+  Local<Value> below = condition->Get(ctx, make_string(i, "below")).ToLocalChecked();
+  Local<Value> changed = condition->Get(ctx, make_string(i, "changed")).ToLocalChecked();
+  if (crosses->IsArray()) {
+    watch.kind = PropertyWatch::CROSSES;
+    Local<Array> markers = crosses.As<Array>();
+    for (uint32_t q = 0; q < markers->Length(); ++q) {
+      Local<Value> marker = markers->Get(ctx, q).ToLocalChecked();
+      if (!marker->IsNumber()) {
+        throw_js(i, "MpvPlayer::watch: crosses should be an array of numbers");
+        return;
+      }
+      watch.markers.push_back(marker->NumberValue(ctx).FromMaybe(0));
+    }
+    sort(watch.markers.begin(), watch.markers.end());
+  } else if (below->IsNumber()) {
+    watch.kind = PropertyWatch::BELOW;
+    watch.threshold = below->NumberValue(ctx).FromMaybe(0);
+  } else if (changed->IsTrue()) {
+    watch.kind = PropertyWatch::CHANGED;
+  } else {
+    throw_js(i, "MpvPlayer::watch: second argument is incorrect, one of crosses, below or changed conditions expected");
     return;
   }
-  if (maybe_context.IsEmpty() ||
-      (maybe_context.ToLocalChecked()->IsNull() || maybe_context.ToLocalChecked()->IsUndefined())) {
-    throw_js(i, "MpvPlayer::create: failed to initialize WebGL");
+
+  uint64_t id;
+  int err_code = self->d->addWatch(string_to_cc(args[0]), watch, args[2].As<Function>(), id);
+  if (err_code != MPV_ERROR_SUCCESS) {
+    throw_js(i, mpv_error_string(err_code));
     return;
   }
 
-  Local<Value> context = maybe_context.ToLocalChecked();
-
-  // create C++ player object
-
-  auto context_pers = pers_ptr(new Persistent<Object>(i, context.As<Object>()));
-  auto player_obj = new MpvPlayer(i, canvas, context_pers, opts);
-  player_obj->Wrap(args.This());
-  player_obj->Ref(); // do not GC this object if there are no handles, we are going to deref it inside dispose
-
-  args.GetReturnValue().Set(args.This());
+  args.GetReturnValue().Set(Number::New(i, static_cast<double>(id)));
 }
 
-/**
- * Mapped to MpvPlayer.create function.
- * Initializes MPV player instance.
- */
-void MpvPlayer::Create(const FunctionCallbackInfo<Value> &args) {
+void MpvPlayer::Unwatch(const FunctionCallbackInfo<Value> &args) {
   Isolate *i = args.GetIsolate();
   auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  if (self->d->_mpv) {
-    throw_js(i, "MpvPlayer::create: player already created, cannot call this method twice on the same object");
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::unwatch: player object is not initialized");
     return;
   }
 
-  // create mpv object
-  self->d->_mpv = mpv_create();
-  if (!self->d->_mpv) {
-    throw_js(i, "MpvPlayer::create: failed to initialize mpv");
+  if (args.Length() != 1 || !args[0]->IsNumber()) {
+    throw_js(i, "MpvPlayer::unwatch: incorrect arguments, a watch id expected");
     return;
   }
 
-  // to speed up things (in electron, yeah) we disable events js code hasn't subscribed to
-  const map<mpv_event_id, shared_ptr<Persistent<Function>>> &eh = self->d->_options.event_handlers;
-  for (int q = MPV_EVENT_LOG_MESSAGE; q <= MPV_EVENT_QUEUE_OVERFLOW; ++q) {
-    auto it = eh.find((mpv_event_id)q); // so hacky
-    if (it == eh.end() && q != MPV_EVENT_PROPERTY_CHANGE
-#ifdef BUILD_DEBUG
-      && q != MPV_EVENT_LOG_MESSAGE
-#endif
-        ) {
-      mpv_request_event(self->d->_mpv, (mpv_event_id)q, false);
+  auto id = static_cast<uint64_t>(args[0]->NumberValue(i->GetCurrentContext()).FromMaybe(0));
+  args.GetReturnValue().Set(self->d->removeWatch(id));
+}
+
+/**
+ * Finds an event by its mpv name (like file-loaded) or its id.
+ * Property changes are not accepted, observeProperty should be used for them.
+ */
+static bool event_from_value(Isolate *i, const Local<Value> &value, mpv_event_id &event) {
+  if (value->IsNumber()) {
+    int id = static_cast<int>(value->NumberValue(i->GetCurrentContext()).FromMaybe(0));
+    if (id <= MPV_EVENT_SHUTDOWN || id == MPV_EVENT_PROPERTY_CHANGE || !mpv_event_name((mpv_event_id)id)) {
+      return false;
+    }
+    event = (mpv_event_id)id;
+    return true;
+  } else if (value->IsString()) {
+    string name = string_to_cc(value);
+    for (int q = MPV_EVENT_LOG_MESSAGE; q < 64; ++q) {
+      const char *event_name = mpv_event_name((mpv_event_id)q);
+      if (q != MPV_EVENT_PROPERTY_CHANGE && event_name && name == event_name) {
+        event = (mpv_event_id)q;
+        return true;
+      }
     }
   }
-  // wow, such fast
+  return false;
+}
 
-  // set default logging params
-  const char *log_level = self->d->_options.log_level.empty() ? "warn" : self->d->_options.log_level.c_str();
-  mpv_request_log_messages(self->d->_mpv, log_level);
-  mpv_set_wakeup_callback(self->d->_mpv, mpv_async_wakeup_cb, self);
+void MpvPlayer::On(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  // initialize mpv
-  if (mpv_initialize(self->d->_mpv) < 0) {
-    throw_js(i, "MpvPlayer::create: failed to initialize mpv");
+  if (!self) {
+    throw_js(i, "MpvPlayer::on: player object is not initialized");
     return;
   }
 
-  // set default options
-  mpv_set_option_string(self->d->_mpv, "vo", "opengl-cb");
-  mpv_set_option_string(self->d->_mpv, "hwdec", "auto");
-  mpv_set_option_string(self->d->_mpv, "sub-auto", "no");
-  mpv_set_option_string(self->d->_mpv, "input-vo-keyboard", "no");
+  if (args.Length() != 2) {
+    throw_js(i, "MpvPlayer::on: incorrect number of arguments, two arguments are expected");
+    return;
+  }
 
-  // initialize opengl callback api
-  self->d->_mpv_gl = static_cast<mpv_opengl_cb_context*>(mpv_get_sub_api(self->d->_mpv, MPV_SUB_API_OPENGL_CB));
-  if (!self->d->_mpv_gl) {
-    throw_js(i, "MpvPlayer::create: falied to initialize opengl subapi");
+  mpv_event_id event;
+  if (!event_from_value(i, args[0], event)) {
+    throw_js(i, "MpvPlayer::on: first argument is incorrect, an event name or id expected");
     return;
   }
 
-  if (mpv_opengl_cb_init_gl(self->d->_mpv_gl, nullptr, get_proc_address, self) < 0) {
-    throw_js(i, "MpvPlayer::create: falied to initialize WebGL functions");
+  if (!args[1]->IsFunction()) {
+    throw_js(i, "MpvPlayer::on: second argument is invalid, a function expected");
     return;
   }
 
-  mpv_opengl_cb_set_update_callback(self->d->_mpv_gl, mpv_async_update_cb, nullptr);
+  self->d->addEventListener(event, args[1].As<Function>());
 }
 
-void MpvPlayer::Command(const FunctionCallbackInfo<Value> &args) {
+void MpvPlayer::Off(const FunctionCallbackInfo<Value> &args) {
   Isolate *i = args.GetIsolate();
   auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
-  if (!self->d->_mpv) {
-    throw_js(i, "MpvPlayer::command: player object is not initialized");
+  if (!self) {
+    throw_js(i, "MpvPlayer::off: player object is not initialized");
     return;
   }
 
-  if (args.Length() < 1) {
-    throw_js(i, "MpvPlayer::command: not enough arguments, at least one is expected");
+  if (args.Length() != 2) {
+    throw_js(i, "MpvPlayer::off: incorrect number of arguments, two arguments are expected");
     return;
   }
 
-  if (!args[0]->IsString() && !args[0]->IsStringObject()) {
-    throw_js(i, "MpvPlayer::command: invalid arguments, first arguments should be a command name");
+  mpv_event_id event;
+  if (!event_from_value(i, args[0], event)) {
+    throw_js(i, "MpvPlayer::off: first argument is incorrect, an event name or id expected");
     return;
   }
 
-  AutoForeignMpvNode mpv_result;
-  int err_code;
-  if (args.Length() == 1) {
-    string command_name = string_to_cc(args[0]);
-    err_code = mpv_command_string(self->d->_mpv, command_name.c_str());
-  } else {
-    AutoMpvNode mpv_args(args, 0);
-    if (!mpv_args.valid()) {
-      throw_js(i, "MpvPlayer::command: invalid arguments");
-      return;
-    }
-
-    err_code = mpv_command_node(self->d->_mpv, mpv_args.ptr(), &mpv_result.node);
-  }
-
-  if (err_code != MPV_ERROR_SUCCESS) {
-    throw_js(i, mpv_error_string(err_code));
+  if (!args[1]->IsFunction()) {
+    throw_js(i, "MpvPlayer::off: second argument is invalid, a function expected");
     return;
   }
 
-  args.GetReturnValue().Set(mpv_node_to_v8_value(i, &mpv_result.node));
+  args.GetReturnValue().Set(self->d->removeEventListener(event, args[1].As<Function>()));
 }
 
-void MpvPlayer::GetProperty(const FunctionCallbackInfo<Value> &args) {
+void MpvPlayer::SetLogSink(const FunctionCallbackInfo<Value> &args) {
   Isolate *i = args.GetIsolate();
   Local<Context> ctx = i->GetCurrentContext();
   auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
   if (!self || !self->d->_mpv) {
-    throw_js(i, "MpvPlayer::getProperty: player object is not initialized");
+    throw_js(i, "MpvPlayer::setLogSink: player object is not initialized");
     return;
   }
 
   if (args.Length() != 1) {
-    throw_js(i, "MpvPlayer::getProperty: incorrect number of arguments, a single property name expected");
+    throw_js(i, "MpvPlayer::setLogSink: incorrect number of arguments, one argument is expected");
     return;
   }
 
-  MaybeLocal<String> arg = args[0]->ToString(ctx);
-  if (arg.IsEmpty()) {
-    throw_js(i, "MpvPlayer::getProperty: incorrect arguments, a single property name expected");
+  if (args[0]->IsNull() || args[0]->IsUndefined()) {
+    self->d->setLogSink(nullptr, Local<Function>(), 0);
     return;
   }
 
-  string arg_c = string_to_cc(arg.ToLocalChecked());
-  if (arg_c.empty()) {
-    throw_js(i, "MpvPlayer::getProperty: fail");
+  if (!args[0]->IsObject()) {
+    throw_js(i, "MpvPlayer::setLogSink: first argument is incorrect, an options object or null expected");
     return;
   }
 
-  AutoForeignMpvNode node;
-  auto err_code = mpv_get_property(self->d->_mpv, arg_c.c_str(), MPV_FORMAT_NODE, &node.node);
-  if (err_code != MPV_ERROR_SUCCESS) {
-    throw_js(i, mpv_error_string(err_code));
+  Local<Object> options = args[0].As<Object>();
+  LogSink::Options sink_options;
+
+  Local<Value> capacity = options->Get(ctx, make_string(i, "capacity")).ToLocalChecked();
+  if (!capacity->IsUndefined()) {
+    if (!capacity->IsNumber() || capacity->NumberValue(ctx).FromMaybe(0) < 1) {
+      throw_js(i, "MpvPlayer::setLogSink: invalid capacity option, a positive number expected");
+      return;
+    }
+    sink_options.capacity = static_cast<size_t>(capacity->NumberValue(ctx).FromMaybe(0));
+  }
+
+  Local<Value> level = options->Get(ctx, make_string(i, "level")).ToLocalChecked();
+  if (!level->IsUndefined()) {
+    if (!level->IsString() || !LogSink::levelFromName(string_to_cc(level), sink_options.level)) {
+      throw_js(i, "MpvPlayer::setLogSink: invalid level option, mpv log level name expected");
+      return;
+    }
+  }
+
+  Local<Value> prefix_levels = options->Get(ctx, make_string(i, "prefixLevels")).ToLocalChecked();
+  if (!prefix_levels->IsUndefined()) {
+    if (!prefix_levels->IsObject()) {
+      throw_js(i, "MpvPlayer::setLogSink: invalid prefixLevels option, an object expected");
+      return;
+    }
+
+    Local<Array> prefixes = prefix_levels.As<Object>()->GetOwnPropertyNames(ctx).ToLocalChecked();
+    for (uint32_t q = 0; q < prefixes->Length(); ++q) {
+      Local<Value> prefix = prefixes->Get(ctx, q).ToLocalChecked();
+      Local<Value> prefix_level = prefix_levels.As<Object>()->Get(ctx, prefix).ToLocalChecked();
+      mpv_log_level parsed;
+      if (!prefix_level->IsString() || !LogSink::levelFromName(string_to_cc(prefix_level), parsed)) {
+        throw_js(i, ("MpvPlayer::setLogSink: invalid level for prefix " + string_to_cc(prefix)).c_str());
+        return;
+      }
+      sink_options.prefix_levels[string_to_cc(prefix)] = parsed;
+    }
+  }
+
+  Local<Value> rate_limit = options->Get(ctx, make_string(i, "rateLimit")).ToLocalChecked();
+  if (!rate_limit->IsUndefined()) {
+    if (!rate_limit->IsNumber() || rate_limit->NumberValue(ctx).FromMaybe(-1) < 0) {
+      throw_js(i, "MpvPlayer::setLogSink: invalid rateLimit option, a non-negative number expected");
+      return;
+    }
+    sink_options.rate_limit = static_cast<size_t>(rate_limit->NumberValue(ctx).FromMaybe(0));
+  }
+
+  Local<Value> rate_interval = options->Get(ctx, make_string(i, "rateIntervalMs")).ToLocalChecked();
+  if (!rate_interval->IsUndefined()) {
+    if (!rate_interval->IsNumber() || rate_interval->NumberValue(ctx).FromMaybe(0) <= 0) {
+      throw_js(i, "MpvPlayer::setLogSink: invalid rateIntervalMs option, a positive number expected");
+      return;
+    }
+    sink_options.rate_interval_us = static_cast<int64_t>(rate_interval->NumberValue(ctx).FromMaybe(0) * 1000);
+  }
+
+  Local<Function> handler;
+  Local<Value> on_logs = options->Get(ctx, make_string(i, "onLogs")).ToLocalChecked();
+  if (!on_logs->IsUndefined()) {
+    if (!on_logs->IsFunction()) {
+      throw_js(i, "MpvPlayer::setLogSink: invalid onLogs option, a function expected");
+      return;
+    }
+    handler = on_logs.As<Function>();
+  }
+
+  uint64_t deliver_interval = 100;
+  Local<Value> deliver_interval_value = options->Get(ctx, make_string(i, "deliverIntervalMs")).ToLocalChecked();
+  if (!deliver_interval_value->IsUndefined()) {
+    if (!deliver_interval_value->IsNumber() || deliver_interval_value->NumberValue(ctx).FromMaybe(0) < 1) {
+      throw_js(i, "MpvPlayer::setLogSink: invalid deliverIntervalMs option, a positive number expected");
+      return;
+    }
+    deliver_interval = static_cast<uint64_t>(deliver_interval_value->NumberValue(ctx).FromMaybe(0));
+  }
+
+  self->d->setLogSink(make_shared<LogSink>(sink_options), handler, deliver_interval);
+}
+
+void MpvPlayer::DrainLogs(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
+
+  if (!self) {
+    throw_js(i, "MpvPlayer::drainLogs: player object is not initialized");
     return;
   }
 
-  args.GetReturnValue().Set(mpv_node_to_v8_value(i, &node.node));
+  args.GetReturnValue().Set(self->d->drainLogs());
 }
 
-void MpvPlayer::SetProperty(const FunctionCallbackInfo<Value> &args) {
+void MpvPlayer::SetRenderTarget(const FunctionCallbackInfo<Value> &args) {
   Isolate *i = args.GetIsolate();
+  Local<Context> ctx = i->GetCurrentContext();
   auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
   if (!self || !self->d->_mpv) {
-    throw_js(i, "MpvPlayer::setProperty: player object is not initialized");
+    throw_js(i, "MpvPlayer::setRenderTarget: player object is not initialized");
     return;
   }
 
-  if (args.Length() != 2) {
-    throw_js(i, "MpvPlayer::setProperty: incorrect number of arguments, two arguments are expected");
+  if (args.Length() < 1) {
+    throw_js(i, "MpvPlayer::setRenderTarget: incorrect number of arguments, at least one is expected");
     return;
   }
 
-  if (!args[0]->IsString() && !args[0]->IsStringObject()) {
-    throw_js(i, "MpvPlayer::setProperty: first argument is incorrect, a string expected");
-    return;
+  int width = 0, height = 0;
+  if (!args[0]->IsNull() && !args[0]->IsUndefined()) {
+    if (args.Length() != 3 || !args[1]->IsNumber() || !args[2]->IsNumber()) {
+      throw_js(i, "MpvPlayer::setRenderTarget: width and height of the render target are expected");
+      return;
+    }
+
+    width = static_cast<int>(args[1]->IntegerValue(ctx).FromMaybe(0));
+    height = static_cast<int>(args[2]->IntegerValue(ctx).FromMaybe(0));
+    if (width <= 0 || height <= 0) {
+      throw_js(i, "MpvPlayer::setRenderTarget: invalid render target size");
+      return;
+    }
   }
 
-  string prop_name_c = string_to_cc(args[0]);
-  if (prop_name_c.empty()) {
-    throw_js(i, "MpvPlayer::setProperty: fail");
+  self->d->setRenderTarget(args[0], width, height);
+}
+
+void MpvPlayer::AddMirror(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
+
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::addMirror: player object is not initialized");
     return;
   }
 
-  AutoMpvNode anode(i, args[1]);
-  if (!anode.valid()) {
-    throw_js(i, "MpvPlayer::setProperty: failed to convert js value to one of mpv_node formats");
+  if (args.Length() != 1 || !args[0]->IsObject()) {
+    throw_js(i, "MpvPlayer::addMirror: incorrect arguments, a canvas or a viewport object expected");
     return;
   }
 
-  auto err_code = mpv_set_property(self->d->_mpv, prop_name_c.c_str(), MPV_FORMAT_NODE, anode.ptr());
-  if (err_code != MPV_ERROR_SUCCESS) {
-    throw_js(i, mpv_error_string(err_code));
-    return;
+  int mirror_id = self->d->addMirror(args[0].As<Object>());
+  if (mirror_id >= 0) {
+    args.GetReturnValue().Set(Integer::New(i, mirror_id));
   }
 }
 
-void MpvPlayer::ObserveProperty(const FunctionCallbackInfo<Value> &args) {
+void MpvPlayer::RemoveMirror(const FunctionCallbackInfo<Value> &args) {
   Isolate *i = args.GetIsolate();
+  Local<Context> ctx = i->GetCurrentContext();
   auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
 
   if (!self || !self->d->_mpv) {
-    throw_js(i, "MpvPlayer::observeProperty: player object is not initialized");
+    throw_js(i, "MpvPlayer::removeMirror: player object is not initialized");
     return;
   }
 
-  if (args.Length() != 2) {
-    throw_js(i, "MpvPlayer::observeProperty: incorrect number of arguments, two arguments are expected");
+  if (args.Length() != 1 || !args[0]->IsNumber()) {
+    throw_js(i, "MpvPlayer::removeMirror: incorrect arguments, a mirror id expected");
     return;
   }
 
-  if (!args[0]->IsString() && !args[0]->IsStringObject()) {
-    throw_js(i, "MpvPlayer::observeProperty: first argument is incorrect, a string expected");
+  auto mirror_id = static_cast<int>(args[0]->IntegerValue(ctx).FromMaybe(0));
+  args.GetReturnValue().Set(Boolean::New(i, self->d->removeMirror(mirror_id)));
+}
+
+void MpvPlayer::SetViewport(const FunctionCallbackInfo<Value> &args) {
+  Isolate *i = args.GetIsolate();
+  auto self = ObjectWrap::Unwrap<MpvPlayer>(args.Holder());
+
+  if (!self || !self->d->_mpv) {
+    throw_js(i, "MpvPlayer::setViewport: player object is not initialized");
     return;
   }
 
-  string prop_name = string_to_cc(args[0]);
-  if (prop_name.empty()) {
-    throw_js(i, "MpvPlayer::setProperty: fail");
+  if (args.Length() != 1) {
+    throw_js(i, "MpvPlayer::setViewport: incorrect number of arguments, a viewport object or null expected");
     return;
   }
 
-  Local<Object> handler = args[1].As<Object>();
-  if (handler.IsEmpty() || !handler->IsCallable()) {
-    throw_js(i, "MpvPlayer::observeProperty: second argument is invalid, a callable expected");
+  if (args[0]->IsNull() || args[0]->IsUndefined()) {
+    self->d->resetViewport();
     return;
   }
 
-  int err_code = mpv_observe_property(self->d->_mpv, 0, prop_name.c_str(), MPV_FORMAT_NODE);
-  if (err_code != MPV_ERROR_SUCCESS) {
-    throw_js(i, mpv_error_string(err_code));
+  ctx_rect viewport;
+  if (!rect_from_object(i, args[0], viewport)) {
+    throw_js(i, "MpvPlayer::setViewport: invalid viewport, an object with x, y, width and height expected");
     return;
   }
 
-  self->d->_observers.insert({ prop_name, pers_ptr(new Persistent<Object>(i, handler)) });
+  self->d->setViewport(viewport);
 }
 
 void MpvPlayer::Dispose(const FunctionCallbackInfo<Value> &args) {
@@ -2125,9 +4412,7 @@ void MpvPlayer::CommandAccessorCall(const FunctionCallbackInfo<Value> &args) {
   }
 
   MpvPlayer *player = ObjectWrap::Unwrap<MpvPlayer>(player_obj.As<Object>());
-  string cmd_name_cc = string_to_cc(cmd_name.As<String>());
-
-  js_name_for_mpv(cmd_name_cc);
+  Utf8String cmd_name_cc(i, cmd_name, true);
 
   // one final check...
   if (!player || cmd_name_cc.empty()) {
@@ -2141,7 +4426,7 @@ void MpvPlayer::CommandAccessorCall(const FunctionCallbackInfo<Value> &args) {
   if (args.Length() == 0) {
     err_code = mpv_command_string(player->mpv(), cmd_name_cc.c_str());
   } else {
-    AutoMpvNode mpv_args(cmd_name_cc, args);
+    AutoMpvNode mpv_args(cmd_name_cc, args, &player->d->_node_arena);
     if (!mpv_args.valid()) {
       throw_js(i, "MpvPlayer::cmds: invalid arguments");
       return;
@@ -2155,7 +4440,7 @@ void MpvPlayer::CommandAccessorCall(const FunctionCallbackInfo<Value> &args) {
     return;
   }
 
-  args.GetReturnValue().Set(mpv_node_to_v8_value(i, &mpv_result.node));
+  args.GetReturnValue().Set(mpv_node_to_v8_value(i, mpv_result));
 }
 
 void MpvPlayer::PropsAccessor(Local<String>, const PropertyCallbackInfo<Value> &info) {
@@ -2209,30 +4494,33 @@ void MpvPlayer::PropsAccessorGet(Local<Name> prop_name, const PropertyCallbackIn
     return;
   }
 
-  string prop_name_cc = string_to_cc(prop_name.As<String>());
-  if (prop_name_cc.empty()) {
+  Local<String> name = CastLocal<String>(prop_name);
+  if (name->Length() == 0) {
     throw_js(i, "MpvPlayer::props: invalid property accessor, property name is empty");
     return;
   }
 
-  string parent_prop_name_cc = parent_prop_name.IsEmpty() ? "" : string_to_cc(parent_prop_name);
+  bool has_parent = !parent_prop_name.IsEmpty() && parent_prop_name->Length() > 0;
 
   // now check what is current property name is
-  if (prop_name_cc[0] == '$') {
+  uint16_t first_char;
+  name->Write(&first_char, 0, 1, String::NO_NULL_TERMINATION);
+  if (first_char == '$') {
     // we should return an accessor object
-    string qual_name = parent_prop_name_cc.empty()
-                          ? prop_name_cc.substr(1)
-                          : parent_prop_name_cc + "/" + prop_name_cc.substr(1);
+    string prop_name_cc = string_to_cc(name);
+    string qual_name = has_parent
+                          ? string_to_cc(parent_prop_name) + "/" + prop_name_cc.substr(1)
+                          : prop_name_cc.substr(1);
     Local<Object> ac = player->d->_prop_accesser_template->Get(i)->NewInstance(ctx).ToLocalChecked();
     ac->SetInternalField(0, player_obj);
     ac->SetInternalField(1, make_string(i, qual_name));
     info.GetReturnValue().Set(ac);
   } else {
     // we should return a property value from mpv
-    string qual_name = parent_prop_name_cc.empty()
-                          ? prop_name_cc
-                          : parent_prop_name_cc + "/" + prop_name_cc;
-    js_name_for_mpv(qual_name);
+    Utf8String qual_name(i, has_parent ? parent_prop_name : name, true);
+    if (has_parent) {
+      qual_name.append('/', name, true);
+    }
 
     AutoForeignMpvNode mpv_result;
     int err_code = mpv_get_property(player->mpv(), qual_name.c_str(), MPV_FORMAT_NODE, &mpv_result.node);
@@ -2241,7 +4529,7 @@ void MpvPlayer::PropsAccessorGet(Local<Name> prop_name, const PropertyCallbackIn
       return;
     }
 
-    info.GetReturnValue().Set(mpv_node_to_v8_value(i, &mpv_result.node));
+    info.GetReturnValue().Set(mpv_node_to_v8_value(i, mpv_result));
   }
 }
 
@@ -2270,26 +4558,28 @@ void MpvPlayer::PropsAccessorSet(Local<Name> prop_name, Local<Value> value, cons
     return;
   }
 
-  string prop_name_cc = string_to_cc(prop_name.As<String>());
-  if (prop_name_cc.empty()) {
+  Local<String> name = CastLocal<String>(prop_name);
+  if (name->Length() == 0) {
     throw_js(i, "MpvPlayer::props: invalid property accessor, property name is empty");
     return;
   }
 
-  string parent_prop_name_cc = parent_prop_name.IsEmpty() ? "" : string_to_cc(parent_prop_name);
+  bool has_parent = !parent_prop_name.IsEmpty() && parent_prop_name->Length() > 0;
 
-  if (prop_name_cc[0] == '$') {
+  uint16_t first_char;
+  name->Write(&first_char, 0, 1, String::NO_NULL_TERMINATION);
+  if (first_char == '$') {
     // it is impossible to overwrite a property accessor
     throw_js(i, "MpvPlayer::props: cannot overwrite a property accessor");
     return;
   } else {
     // we should set a property value for mpv
-    string qual_name = parent_prop_name_cc.empty()
-                          ? prop_name_cc
-                          : parent_prop_name_cc + "/" + prop_name_cc;
-    js_name_for_mpv(qual_name);
+    Utf8String qual_name(i, has_parent ? parent_prop_name : name, true);
+    if (has_parent) {
+      qual_name.append('/', name, true);
+    }
 
-    AutoMpvNode mpv_value(i, value);
+    AutoMpvNode mpv_value(i, value, &player->d->_node_arena);
     int err_code = mpv_set_property(player->mpv(), qual_name.c_str(), MPV_FORMAT_NODE, mpv_value.ptr());
     if (err_code != MPV_ERROR_SUCCESS) {
       throw_js(i, mpv_error_string(err_code));
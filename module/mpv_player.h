@@ -10,10 +10,11 @@ struct mpv_handle;
 struct mpv_opengl_cb_context;
 class MPImpl;
 struct PlayerOptions;
+struct SharedGlContext;
 
 class MpvPlayer : public node::ObjectWrap {
 public:
-  static void Init(v8::Local<v8::Object> exports);
+  static void Init(v8::Local<v8::Object> exports, v8::Local<v8::Context> context);
 
   mpv_handle *mpv()const;
 
@@ -22,7 +23,7 @@ private:
 
   MpvPlayer(v8::Isolate *isolate,
             const std::shared_ptr<v8::Persistent<v8::Object>> &canvas,
-            const std::shared_ptr<v8::Persistent<v8::Object>> &renderingContext,
+            const std::shared_ptr<SharedGlContext> &glContext,
             const PlayerOptions &opts
   );
   MpvPlayer(const MpvPlayer &); // disable copying
@@ -32,7 +33,23 @@ private:
   static void Command(const v8::FunctionCallbackInfo<v8::Value> &args);
   static void SetProperty(const v8::FunctionCallbackInfo<v8::Value> &args);
   static void GetProperty(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void GetPropertyJSON(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void SetPropertyJSON(const v8::FunctionCallbackInfo<v8::Value> &args);
   static void ObserveProperty(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void UnobserveProperty(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void GetObservedSnapshot(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void MirrorProperties(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void UnmirrorProperties(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void Watch(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void Unwatch(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void On(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void Off(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void SetLogSink(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void DrainLogs(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void SetRenderTarget(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void AddMirror(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void RemoveMirror(const v8::FunctionCallbackInfo<v8::Value> &args);
+  static void SetViewport(const v8::FunctionCallbackInfo<v8::Value> &args);
   static void Dispose(const v8::FunctionCallbackInfo<v8::Value> &args);
   static void CommandsAccessor(v8::Local<v8::String> prop, const v8::PropertyCallbackInfo<v8::Value> &info);
   static void CommandAccessorProp(v8::Local<v8::Name> prop, const v8::PropertyCallbackInfo<v8::Value> &info);
@@ -41,6 +58,4 @@ private:
   static void PropsAccessorGet(v8::Local<v8::Name> prop, const v8::PropertyCallbackInfo<v8::Value> &info);
   static void PropsAccessorSet(v8::Local<v8::Name> prop, v8::Local<v8::Value> value,
                                 const v8::PropertyCallbackInfo<v8::Value> &info);
-
-  static v8::Persistent<v8::Function> constructor;
 };